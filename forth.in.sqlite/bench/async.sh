@@ -0,0 +1,21 @@
+#!/bin/sh
+# Overlapping SQL on I/O threads with computation.
+#
+# Runs the same commit-then-compute steps synchronously and with the
+# commits submitted through async-exec, with one and four I/O threads. The
+# gain is bounded by how long a commit waits on the disk.
+#
+# Usage: bench/async.sh
+
+set -e
+
+BIN=${BIN:-bin}
+RUNS=${RUNS:-10}
+
+echo "# io_sync"
+"$BIN/forth-bench" -b "$BIN/forth-sqlite" -n "$RUNS" -w 1 -S bench/io_sync.fth
+for threads in 1 4; do
+    echo "# io_async, $threads I/O threads"
+    "$BIN/forth-bench" -b "$BIN/forth-sqlite" -n "$RUNS" -w 1 \
+        -S bench/io_async.fth -x "--io-threads=$threads"
+done
@@ -0,0 +1,24 @@
+#!/bin/sh
+# Channel throughput and latency.
+#
+# Producer/consumer pipelines over SPSC and MPMC channels: one producer
+# and one consumer directly and through forwarding stages, then several
+# producers and consumers sharing MPMC channels. Thread counts beyond the
+# available cores measure contention and scheduling rather than the rings.
+#
+# Usage: bench/chan.sh
+
+set -e
+
+BIN=${BIN:-bin}
+MESSAGES=${MESSAGES:-1000000}
+CAPACITY=${CAPACITY:-1024}
+
+for kind in spsc mpmc; do
+    for stages in 0 1 3; do
+        "$BIN/forth-chanbench" -k $kind -S $stages -n "$MESSAGES" -q "$CAPACITY"
+    done
+done
+for threads in 2 4; do
+    "$BIN/forth-chanbench" -k mpmc -p $threads -c $threads -n "$MESSAGES" -q "$CAPACITY"
+done
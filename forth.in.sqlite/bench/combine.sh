@@ -0,0 +1,30 @@
+#!/bin/sh
+# Write combining of insert words.
+#
+# Runs insert_rows (2000 single-row inserts in autocommit mode, counted
+# every 500 rows) row at a time and with --combine-writes at two buffer
+# sizes, and reports inserted rows per second from each median run time.
+# Without combining, every row is a transaction of its own and the run
+# is bound by journal syncs.
+#
+# Usage: bench/combine.sh
+
+set -e
+
+BIN=${BIN:-bin}
+RUNS=${RUNS:-5}
+ROWS=2000
+
+run() {
+    label=$1
+    shift
+    "$BIN/forth-bench" -b "$BIN/forth-sqlite" -n "$RUNS" -w 1 -S bench/insert_rows.fth "$@" |
+        awk -v label="$label" -v rows=$ROWS '/"p50_ms"/ {
+            sub(/.*"p50_ms": /, ""); sub(/,.*/, "")
+            printf "%-22s p50 %10.3f ms  %12.1f rows/sec\n", label, $0, rows * 1000 / $0
+        }'
+}
+
+run "row at a time"
+run "combined, 16 rows" -x --combine-writes=16
+run "combined, 256 rows" -x --combine-writes
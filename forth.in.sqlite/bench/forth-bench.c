@@ -0,0 +1,347 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <ftw.h>
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+// Benchmark runner for bin/forth-sqlite.
+//
+// Every workload runs in its own scratch directory (the interpreter always
+// opens ./forth.db), optionally after a setup script has populated the
+// database. Each measured run is one process: wall time, peak RSS and the
+// number of tokens in the script give ops/sec, p50/p99 and max RSS.
+
+#define MAX_RUNS 1000
+#define MAX_OPTIONS 8
+
+typedef struct {
+    const char *name;
+    const char *script;
+    const char *setup;  // Run once before measuring, or NULL
+} bench_workload_t;
+
+static const bench_workload_t workloads[] = {
+    {"fib",         "fib.fth",         NULL},
+    {"sieve",       "sieve.fth",       NULL},
+    {"bubble",      "bubble.fth",      NULL},
+    {"matmul",      "matmul.fth",      NULL},
+    {"strscan",     "strscan.fth",     NULL},
+    {"bulk_insert", "bulk_insert.fth", NULL},
+    {"cursor_scan", "cursor_scan.fth", "bulk_insert.fth"},
+    {"aggregate",   "aggregate.fth",   NULL},
+};
+
+#define WORKLOAD_COUNT ((int)(sizeof(workloads) / sizeof(workloads[0])))
+
+typedef struct {
+    const char *binary;
+    const char *bench_dir;
+    const char *filter;
+    const char *output;
+    const char *script;   // Custom workload instead of the table above
+    const char *seed_db;  // Database copied into the scratch directory
+    const char *options[MAX_OPTIONS];  // Interpreter options passed before the script
+    int option_count;
+    int runs;
+    int warmup;
+} bench_options_t;
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static int compare_double(const void *a, const void *b) {
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+static double percentile(const double *sorted, int count, double p) {
+    if (count == 0) return 0.0;
+    int idx = (int)(p * (count - 1) + 0.5);
+    return sorted[idx];
+}
+
+// Count the tokens the interpreter will see: comment lines are skipped
+static long count_tokens(const char *path) {
+    FILE *file = fopen(path, "r");
+    if (!file) return -1;
+
+    char line[4096];
+    long tokens = 0;
+    while (fgets(line, sizeof(line), file)) {
+        if (line[0] == '\\') continue;
+        for (char *tok = strtok(line, " \t\n\r"); tok; tok = strtok(NULL, " \t\n\r")) {
+            tokens++;
+        }
+    }
+
+    fclose(file);
+    return tokens;
+}
+
+static int copy_file(const char *from, const char *to) {
+    int in = open(from, O_RDONLY);
+    if (in < 0) return -1;
+    int out = open(to, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (out < 0) {
+        close(in);
+        return -1;
+    }
+
+    char buf[65536];
+    ssize_t n;
+    int result = 0;
+    while ((n = read(in, buf, sizeof(buf))) > 0) {
+        if (write(out, buf, n) != n) {
+            result = -1;
+            break;
+        }
+    }
+
+    close(in);
+    close(out);
+    return (n < 0) ? -1 : result;
+}
+
+// Run the interpreter on one script inside workdir; returns exit status
+static int run_script(const bench_options_t *opts, const char *workdir,
+                      const char *script, double *elapsed_ms, long *max_rss_kb) {
+    double start = now_ms();
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        return -1;
+    }
+
+    if (pid == 0) {
+        if (chdir(workdir) != 0) _exit(127);
+        int devnull = open("/dev/null", O_WRONLY);
+        if (devnull >= 0) {
+            dup2(devnull, STDOUT_FILENO);
+            close(devnull);
+        }
+        char *args[MAX_OPTIONS + 3];
+        int argn = 0;
+        args[argn++] = (char*)opts->binary;
+        for (int i = 0; i < opts->option_count; i++) {
+            args[argn++] = (char*)opts->options[i];
+        }
+        args[argn++] = (char*)script;
+        args[argn] = NULL;
+        execv(opts->binary, args);
+        _exit(127);
+    }
+
+    int status;
+    struct rusage usage;
+    if (wait4(pid, &status, 0, &usage) < 0) {
+        perror("wait4");
+        return -1;
+    }
+
+    *elapsed_ms = now_ms() - start;
+    *max_rss_kb = usage.ru_maxrss;
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+static int remove_entry(const char *path, const struct stat *st, int type, struct FTW *ftw) {
+    (void)st; (void)type; (void)ftw;
+    return remove(path);
+}
+
+// The scratch directory holds whatever the interpreter left next to
+// forth.db: journals, WAL and shm files, shard files
+static void remove_workdir(const char *workdir) {
+    if (nftw(workdir, remove_entry, 16, FTW_DEPTH | FTW_PHYS) != 0) {
+        fprintf(stderr, "forth-bench: cannot remove %s\n", workdir);
+    }
+}
+
+static int run_workload(const bench_options_t *opts, const bench_workload_t *w,
+                        FILE *out, int first) {
+    char script[PATH_MAX * 2];
+    char setup[PATH_MAX * 2];
+    if (w->script[0] == '/') {
+        snprintf(script, sizeof(script), "%s", w->script);
+    } else {
+        snprintf(script, sizeof(script), "%s/%s", opts->bench_dir, w->script);
+    }
+
+    long tokens = count_tokens(script);
+    if (tokens < 0) {
+        fprintf(stderr, "forth-bench: cannot read %s\n", script);
+        return -1;
+    }
+
+    char workdir[] = "/tmp/forth-bench-XXXXXX";
+    if (!mkdtemp(workdir)) {
+        perror("mkdtemp");
+        return -1;
+    }
+
+    double elapsed;
+    long rss;
+    long max_rss = 0;
+    int status = 0;
+
+    char db_path[PATH_MAX * 2];
+    snprintf(db_path, sizeof(db_path), "%s/forth.db", workdir);
+    if (opts->seed_db && copy_file(opts->seed_db, db_path) != 0) {
+        fprintf(stderr, "forth-bench: cannot copy %s\n", opts->seed_db);
+        status = -1;
+    }
+
+    if (w->setup && status == 0) {
+        snprintf(setup, sizeof(setup), "%s/%s", opts->bench_dir, w->setup);
+        status = run_script(opts, workdir, setup, &elapsed, &rss);
+    }
+
+    for (int i = 0; i < opts->warmup && status == 0; i++) {
+        status = run_script(opts, workdir, script, &elapsed, &rss);
+    }
+
+    double samples[MAX_RUNS];
+    double total = 0.0;
+    for (int i = 0; i < opts->runs && status == 0; i++) {
+        status = run_script(opts, workdir, script, &samples[i], &rss);
+        total += samples[i];
+        if (rss > max_rss) max_rss = rss;
+    }
+
+    remove_workdir(workdir);
+
+    if (status != 0) {
+        fprintf(stderr, "forth-bench: %s exited with status %d\n", w->name, status);
+        return -1;
+    }
+
+    qsort(samples, opts->runs, sizeof(double), compare_double);
+    double ops_per_sec = total > 0.0 ? (double)tokens * opts->runs / (total / 1e3) : 0.0;
+
+    fprintf(out, "%s    {\"name\": \"%s\", \"runs\": %d, \"ops_per_run\": %ld, "
+            "\"ops_per_sec\": %.1f, \"p50_ms\": %.3f, \"p99_ms\": %.3f, "
+            "\"peak_rss_kb\": %ld}",
+            first ? "" : ",\n", w->name, opts->runs, tokens, ops_per_sec,
+            percentile(samples, opts->runs, 0.50),
+            percentile(samples, opts->runs, 0.99), max_rss);
+    return 0;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+        "Usage: %s [-b binary] [-d bench_dir] [-n runs] [-w warmup] [-f name] [-o file]\n"
+        "          [-S script] [-D seed_db] [-x interpreter_option]...\n",
+        prog);
+}
+
+int main(int argc, char *argv[]) {
+    bench_options_t opts = {
+        .binary = "bin/forth-sqlite",
+        .bench_dir = "bench",
+        .filter = NULL,
+        .output = NULL,
+        .script = NULL,
+        .seed_db = NULL,
+        .option_count = 0,
+        .runs = 20,
+        .warmup = 2,
+    };
+
+    int opt;
+    while ((opt = getopt(argc, argv, "b:d:n:w:f:o:S:D:x:h")) != -1) {
+        switch (opt) {
+            case 'b': opts.binary = optarg; break;
+            case 'd': opts.bench_dir = optarg; break;
+            case 'n': opts.runs = atoi(optarg); break;
+            case 'w': opts.warmup = atoi(optarg); break;
+            case 'f': opts.filter = optarg; break;
+            case 'o': opts.output = optarg; break;
+            case 'S': opts.script = optarg; break;
+            case 'D': opts.seed_db = optarg; break;
+            case 'x':
+                if (opts.option_count == MAX_OPTIONS) {
+                    fprintf(stderr, "At most %d interpreter options\n", MAX_OPTIONS);
+                    return 1;
+                }
+                opts.options[opts.option_count++] = optarg;
+                break;
+            default:
+                usage(argv[0]);
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    if (opts.runs < 1 || opts.runs > MAX_RUNS) {
+        fprintf(stderr, "forth-bench: runs must be between 1 and %d\n", MAX_RUNS);
+        return 1;
+    }
+
+    // The child chdir()s into a scratch directory, so make paths absolute
+    char binary[PATH_MAX];
+    char bench_dir[PATH_MAX];
+    if (!realpath(opts.binary, binary) || !realpath(opts.bench_dir, bench_dir)) {
+        perror("forth-bench: realpath");
+        return 1;
+    }
+    opts.binary = binary;
+    opts.bench_dir = bench_dir;
+
+    char script[PATH_MAX];
+    char seed_db[PATH_MAX];
+    if (opts.script) {
+        if (!realpath(opts.script, script)) {
+            perror("forth-bench: script");
+            return 1;
+        }
+        opts.script = script;
+    }
+    if (opts.seed_db) {
+        if (!realpath(opts.seed_db, seed_db)) {
+            perror("forth-bench: seed database");
+            return 1;
+        }
+        opts.seed_db = seed_db;
+    }
+
+    FILE *out = stdout;
+    if (opts.output && !(out = fopen(opts.output, "w"))) {
+        perror("forth-bench: fopen");
+        return 1;
+    }
+
+    fprintf(out, "{\n  \"binary\": \"%s\",\n  \"benchmarks\": [\n", opts.binary);
+
+    int failures = 0;
+    int first = 1;
+    if (opts.script) {
+        const char *base = strrchr(opts.script, '/');
+        bench_workload_t custom = {base ? base + 1 : opts.script, opts.script, NULL};
+        failures += run_workload(&opts, &custom, out, first) != 0;
+    }
+
+    for (int i = 0; i < WORKLOAD_COUNT && !opts.script; i++) {
+        if (opts.filter && strcmp(opts.filter, workloads[i].name) != 0) continue;
+        if (run_workload(&opts, &workloads[i], out, first) != 0) {
+            failures++;
+            continue;
+        }
+        first = 0;
+        fflush(out);
+    }
+
+    fprintf(out, "\n  ]\n}\n");
+    if (out != stdout) fclose(out);
+
+    return failures ? 1 : 0;
+}
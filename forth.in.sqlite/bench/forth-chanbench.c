@@ -0,0 +1,202 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sched.h>
+#include <pthread.h>
+
+#include "chan.h"
+
+// Channel throughput and latency under threads.
+//
+// -p producer threads push message numbers through a pipeline of -S
+// forwarding stages (one thread and one more channel each) to -c consumer
+// threads. Producers stamp each message's send time in a table indexed by
+// its number and consumers look it up on arrival, so every message yields
+// an end-to-end latency. Threads spin on the non-blocking operations,
+// yielding the CPU after a failed attempt; parking only applies to Forth
+// tasks. Reports messages/sec and latency percentiles as JSON.
+
+#define MAX_THREADS 64
+#define MAX_STAGES 16
+#define MAX_MESSAGES 10000000
+
+typedef struct {
+    chan_kind_t kind;
+    int producers;
+    int consumers;
+    int stages;
+    int messages;
+    int capacity;
+} chanbench_options_t;
+
+typedef struct {
+    int index;
+    chan_t *in;
+    chan_t *out;
+} chanbench_thread_t;
+
+static chanbench_options_t opts;
+static uint64_t *sent_ns;
+static double *latency_ns;
+static int received = 0;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static int compare_double(const void *a, const void *b) {
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+static double percentile(const double *sorted, int count, double p) {
+    if (count == 0) return 0.0;
+    int idx = (int)(p * (count - 1) + 0.5);
+    return sorted[idx];
+}
+
+static void send_spin(chan_t *chan, int value) {
+    while (chan_try_send(chan, value) != 0) {
+        sched_yield();
+    }
+}
+
+// Message -1 tells a stage or consumer to stop
+static int recv_spin(chan_t *chan) {
+    int value;
+    while (chan_try_recv(chan, &value) != 0) {
+        sched_yield();
+    }
+    return value;
+}
+
+static void *producer(void *arg) {
+    chanbench_thread_t *t = arg;
+    for (int m = t->index; m < opts.messages; m += opts.producers) {
+        __atomic_store_n(&sent_ns[m], now_ns(), __ATOMIC_RELAXED);
+        send_spin(t->out, m);
+    }
+    return NULL;
+}
+
+// Stages forward the consumers' stop messages and then stop themselves
+static void *stage(void *arg) {
+    chanbench_thread_t *t = arg;
+    for (int stops = 0; stops < opts.consumers; ) {
+        int m = recv_spin(t->in);
+        send_spin(t->out, m);
+        if (m < 0) stops++;
+    }
+    return NULL;
+}
+
+static void *consumer(void *arg) {
+    chanbench_thread_t *t = arg;
+    for (;;) {
+        int m = recv_spin(t->in);
+        if (m < 0) return NULL;
+        int slot = __atomic_fetch_add(&received, 1, __ATOMIC_RELAXED);
+        latency_ns[slot] = (double)(now_ns() - __atomic_load_n(&sent_ns[m], __ATOMIC_RELAXED));
+    }
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+        "Usage: %s [-k spsc|mpmc] [-p producers] [-c consumers] [-S stages]\n"
+        "          [-n messages] [-q capacity]\n", prog);
+}
+
+int main(int argc, char *argv[]) {
+    opts.kind = CHAN_MPMC;
+    opts.producers = 1;
+    opts.consumers = 1;
+    opts.stages = 0;
+    opts.messages = 1000000;
+    opts.capacity = 1024;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "k:p:c:S:n:q:h")) != -1) {
+        switch (opt) {
+            case 'k': opts.kind = strcmp(optarg, "spsc") == 0 ? CHAN_SPSC : CHAN_MPMC; break;
+            case 'p': opts.producers = atoi(optarg); break;
+            case 'c': opts.consumers = atoi(optarg); break;
+            case 'S': opts.stages = atoi(optarg); break;
+            case 'n': opts.messages = atoi(optarg); break;
+            case 'q': opts.capacity = atoi(optarg); break;
+            default:
+                usage(argv[0]);
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    if (opts.producers < 1 || opts.consumers < 1 ||
+        opts.producers + opts.consumers + opts.stages > MAX_THREADS ||
+        opts.stages < 0 || opts.stages > MAX_STAGES ||
+        opts.messages < 1 || opts.messages > MAX_MESSAGES) {
+        fprintf(stderr, "forth-chanbench: invalid options\n");
+        return 1;
+    }
+    if (opts.kind == CHAN_SPSC && (opts.producers > 1 || opts.consumers > 1)) {
+        fprintf(stderr, "forth-chanbench: spsc channels take one producer and one consumer\n");
+        return 1;
+    }
+
+    sent_ns = calloc(opts.messages, sizeof(uint64_t));
+    latency_ns = calloc(opts.messages, sizeof(double));
+    chan_t *chans[MAX_STAGES + 1];
+    for (int i = 0; i <= opts.stages; i++) {
+        chans[i] = chan_get(chan_new(opts.capacity, opts.kind));
+        if (!chans[i] || !sent_ns || !latency_ns) {
+            fprintf(stderr, "forth-chanbench: out of memory\n");
+            return 1;
+        }
+    }
+
+    pthread_t threads[MAX_THREADS];
+    chanbench_thread_t args[MAX_THREADS];
+    int count = 0;
+
+    uint64_t start = now_ns();
+    for (int i = 0; i < opts.consumers; i++, count++) {
+        args[count] = (chanbench_thread_t){i, chans[opts.stages], NULL};
+        pthread_create(&threads[count], NULL, consumer, &args[count]);
+    }
+    for (int i = 0; i < opts.stages; i++, count++) {
+        args[count] = (chanbench_thread_t){i, chans[i], chans[i + 1]};
+        pthread_create(&threads[count], NULL, stage, &args[count]);
+    }
+    for (int i = 0; i < opts.producers; i++) {
+        args[count + i] = (chanbench_thread_t){i, NULL, chans[0]};
+        pthread_create(&threads[count + i], NULL, producer, &args[count + i]);
+    }
+
+    for (int i = 0; i < opts.producers; i++) {
+        pthread_join(threads[count + i], NULL);
+    }
+    // One stop message per consumer, forwarded through the stages
+    for (int i = 0; i < opts.consumers; i++) {
+        send_spin(chans[0], -1);
+    }
+    for (int i = 0; i < count; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    double elapsed = (now_ns() - start) / 1e9;
+
+    qsort(latency_ns, received, sizeof(double), compare_double);
+    printf("{\"kind\": \"%s\", \"producers\": %d, \"consumers\": %d, \"stages\": %d, "
+           "\"capacity\": %d, \"messages\": %d, \"messages_per_sec\": %.1f, "
+           "\"p50_ns\": %.0f, \"p99_ns\": %.0f}\n",
+           opts.kind == CHAN_SPSC ? "spsc" : "mpmc", opts.producers, opts.consumers,
+           opts.stages, opts.capacity, received, received / elapsed,
+           percentile(latency_ns, received, 0.50), percentile(latency_ns, received, 0.99));
+
+    free(sent_ns);
+    free(latency_ns);
+    return 0;
+}
@@ -0,0 +1,341 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "forth.h"
+#include "vdbe.h"
+#include "compiler.h"
+
+// Synthetic dictionary and workload generator for scale testing.
+//
+// Writes a forth.db with N compiled words arranged in a call graph of the
+// given depth and fan-out, and a script of M tokens drawn from a
+// configurable mix. Compiled words are flattened into a single SELECT, so a
+// call is generated the way the compiler would have to realise it: the
+// callee's body is inlined, capped at the maximum body length. Output is a
+// pure function of the options and the seed.
+
+#define MAX_BODY 64
+#define LINE_TOKENS 16
+
+typedef struct {
+    const char *db_path;
+    const char *script_path;
+    int words;
+    int depth;
+    int fanout;
+    int body;
+    long tokens;
+    uint64_t seed;
+    // Token mix in percent
+    int mix_lit;
+    int mix_prim;
+    int mix_word;
+    int mix_def;
+    // Dictionary slots left for words after the primitives
+    int room;
+} gen_options_t;
+
+typedef struct {
+    vdbe_instruction_t instructions[MAX_BODY];
+    int count;
+} gen_body_t;
+
+static uint64_t rng_state;
+
+// xorshift64*: reproducible across libc implementations
+static uint64_t rng_next(void) {
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 0x2545F4914F6CDD1Dull;
+}
+
+static int rng_below(int n) {
+    return (int)(rng_next() % (uint64_t)n);
+}
+
+static void gen_word_name(char *buf, size_t size, int index) {
+    snprintf(buf, size, "w%06d", index);
+}
+
+static void body_append(gen_body_t *body, vdbe_opcode_t opcode, int p1) {
+    if (body->count >= MAX_BODY) return;
+    vdbe_instruction_t *instr = &body->instructions[body->count++];
+    instr->opcode = opcode;
+    instr->p1 = p1;
+    instr->p2 = 0;
+    instr->p3 = 0;
+}
+
+static void body_leaf(gen_body_t *body, int length) {
+    static const vdbe_opcode_t ops[] = {VDBE_ADD, VDBE_SUBTRACT, VDBE_MULTIPLY, VDBE_DUP};
+    body->count = 0;
+    body_append(body, VDBE_INTEGER, rng_below(1000));
+    while (body->count < length) {
+        body_append(body, VDBE_INTEGER, rng_below(1000));
+        body_append(body, ops[rng_below(4)], 0);
+    }
+}
+
+// Level 0 words are leaves; a word on level L inlines `fanout` callees from
+// level L-1. Words are spread round-robin over the levels.
+static int generate_dictionary(const gen_options_t *opts, forth_compiler_t *compiler) {
+    gen_body_t *bodies = calloc(opts->words, sizeof(gen_body_t));
+    if (!bodies) return -1;
+
+    if (sqlite3_exec(compiler->vm->db, "BEGIN", NULL, NULL, NULL) != SQLITE_OK) {
+        free(bodies);
+        return -1;
+    }
+
+    vdbe_program_t program;
+    vdbe_init_program(&program);
+
+    int result = 0;
+    for (int i = 0; i < opts->words && result == 0; i++) {
+        int level = i % opts->depth;
+        gen_body_t *body = &bodies[i];
+
+        if (level == 0 || i < opts->depth) {
+            body_leaf(body, opts->body);
+        } else {
+            body->count = 0;
+            for (int f = 0; f < opts->fanout; f++) {
+                // Any earlier word on the level below
+                int candidates = i / opts->depth;
+                int callee = rng_below(candidates) * opts->depth + (level - 1);
+                gen_body_t *src = &bodies[callee];
+                for (int k = 0; k < src->count; k++) {
+                    body_append(body, src->instructions[k].opcode, src->instructions[k].p1);
+                }
+            }
+            body_append(body, VDBE_PRINT, 0);
+        }
+
+        program.instruction_count = 0;
+        for (int k = 0; k < body->count; k++) {
+            vdbe_instruction_t *instr = &body->instructions[k];
+            vdbe_add_instruction(&program, instr->opcode, instr->p1, instr->p2, instr->p3);
+        }
+
+        char name[MAX_WORD_LEN];
+        gen_word_name(name, sizeof(name), i);
+        result = compiler_save_word(compiler, name, &program);
+    }
+
+    vdbe_cleanup_program(&program);
+    free(bodies);
+
+    if (sqlite3_exec(compiler->vm->db, result == 0 ? "COMMIT" : "ROLLBACK",
+                     NULL, NULL, NULL) != SQLITE_OK) {
+        return -1;
+    }
+    return result;
+}
+
+// Tokens on the current script line; definitions need their own lines
+static void flush_line(FILE *out, int *on_line) {
+    if (*on_line > 0) {
+        fputc('\n', out);
+        *on_line = 0;
+    }
+}
+
+static void emit_token(FILE *out, const char *token, int *on_line) {
+    fprintf(out, "%s%s", *on_line ? " " : "", token);
+    if (++*on_line >= LINE_TOKENS) {
+        flush_line(out, on_line);
+    }
+}
+
+static int generate_script(const gen_options_t *opts) {
+    static const char *binary_prims[] = {"+", "-", "*", "swap", "over"};
+    static const char *unary_prims[] = {"dup", "drop", "."};
+
+    FILE *out = fopen(opts->script_path, "w");
+    if (!out) {
+        perror("forth-gen: script");
+        return -1;
+    }
+
+    fprintf(out, "\\ Generated by forth-gen: %ld tokens, seed %llu\n",
+            opts->tokens, (unsigned long long)opts->seed);
+
+    int depth = 0;  // Simulated data stack depth keeps the script error-free
+    int on_line = 0;
+    int defs = 0;
+    char token[MAX_WORD_LEN];
+
+    for (long emitted = 0; emitted < opts->tokens; ) {
+        int pick = rng_below(100);
+
+        if (depth > STACK_SIZE / 2) {
+            emit_token(out, "drop", &on_line);
+            depth--;
+            emitted++;
+        } else if (pick < opts->mix_lit || depth < 2) {
+            snprintf(token, sizeof(token), "%d", rng_below(1000) + 1);
+            emit_token(out, token, &on_line);
+            depth++;
+            emitted++;
+        } else if (pick < opts->mix_lit + opts->mix_prim) {
+            if (rng_below(2)) {
+                const char *prim = binary_prims[rng_below(5)];
+                emit_token(out, prim, &on_line);
+                depth += (strcmp(prim, "swap") == 0) ? 0 : (strcmp(prim, "over") == 0) ? 1 : -1;
+            } else {
+                const char *prim = unary_prims[rng_below(3)];
+                emit_token(out, prim, &on_line);
+                depth += (strcmp(prim, "dup") == 0) ? 1 : -1;
+            }
+            emitted++;
+        } else if (pick < opts->mix_lit + opts->mix_prim + opts->mix_word) {
+            gen_word_name(token, sizeof(token), rng_below(opts->words));
+            emit_token(out, token, &on_line);
+            emitted++;
+        } else if (opts->words + defs >= opts->room) {
+            // The dictionary is full: a literal instead of a definition
+            snprintf(token, sizeof(token), "%d", rng_below(1000) + 1);
+            emit_token(out, token, &on_line);
+            depth++;
+            emitted++;
+        } else {
+            // A new definition, one token per line as the line compiler expects
+            flush_line(out, &on_line);
+            fprintf(out, ": g%06d\n", defs++);
+            int length = 2 + rng_below(6);
+            for (int k = 0; k < length; k++) {
+                fprintf(out, "%d\n", rng_below(1000));
+            }
+            fprintf(out, "+\n.\n;\n");
+            emitted += length + 4;
+        }
+    }
+
+    flush_line(out, &on_line);
+    fclose(out);
+    return 0;
+}
+
+static int parse_mix(gen_options_t *opts, const char *spec) {
+    char buf[128];
+    strncpy(buf, spec, sizeof(buf) - 1);
+    buf[sizeof(buf) - 1] = '\0';
+
+    opts->mix_lit = opts->mix_prim = opts->mix_word = opts->mix_def = 0;
+    for (char *item = strtok(buf, ","); item; item = strtok(NULL, ",")) {
+        char *colon = strchr(item, ':');
+        if (!colon) return -1;
+        *colon = '\0';
+        int value = atoi(colon + 1);
+        if (strcmp(item, "lit") == 0) opts->mix_lit = value;
+        else if (strcmp(item, "prim") == 0) opts->mix_prim = value;
+        else if (strcmp(item, "word") == 0) opts->mix_word = value;
+        else if (strcmp(item, "def") == 0) opts->mix_def = value;
+        else return -1;
+    }
+
+    int total = opts->mix_lit + opts->mix_prim + opts->mix_word + opts->mix_def;
+    return total == 100 ? 0 : -1;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+        "Usage: %s [-o db] [-S script] [-n words] [-d depth] [-f fanout] [-b body]\n"
+        "          [-t tokens] [-m lit:N,prim:N,word:N,def:N] [-s seed]\n", prog);
+}
+
+int main(int argc, char *argv[]) {
+    gen_options_t opts = {
+        .db_path = "forth.db",
+        .script_path = NULL,
+        .words = 1000,
+        .depth = 4,
+        .fanout = 2,
+        .body = 8,
+        .tokens = 10000,
+        .seed = 42,
+        .mix_lit = 40,
+        .mix_prim = 35,
+        .mix_word = 20,
+        .mix_def = 5,
+    };
+
+    int opt;
+    while ((opt = getopt(argc, argv, "o:S:n:d:f:b:t:m:s:h")) != -1) {
+        switch (opt) {
+            case 'o': opts.db_path = optarg; break;
+            case 'S': opts.script_path = optarg; break;
+            case 'n': opts.words = atoi(optarg); break;
+            case 'd': opts.depth = atoi(optarg); break;
+            case 'f': opts.fanout = atoi(optarg); break;
+            case 'b': opts.body = atoi(optarg); break;
+            case 't': opts.tokens = atol(optarg); break;
+            case 's': opts.seed = strtoull(optarg, NULL, 10); break;
+            case 'm':
+                if (parse_mix(&opts, optarg) != 0) {
+                    fprintf(stderr, "forth-gen: mix must name lit/prim/word/def and sum to 100\n");
+                    return 1;
+                }
+                break;
+            default:
+                usage(argv[0]);
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    if (opts.words < 1 || opts.depth < 1 || opts.fanout < 1 ||
+        opts.body < 1 || opts.body > MAX_BODY || opts.tokens < 0) {
+        fprintf(stderr, "forth-gen: invalid options\n");
+        usage(argv[0]);
+        return 1;
+    }
+
+    rng_state = opts.seed ? opts.seed : 1;
+
+    // Start from an empty database so reruns are reproducible
+    unlink(opts.db_path);
+
+    forth_vm_t vm;
+    forth_compiler_t compiler;
+    if (forth_init(&vm, opts.db_path) != 0 || compiler_init(&compiler, &vm) != 0) {
+        fprintf(stderr, "forth-gen: failed to initialize %s\n", opts.db_path);
+        return 1;
+    }
+
+    // Words past the dictionary's capacity would fail to load
+    opts.room = MAX_DICT_SIZE - vm.dict->size;
+    if (opts.words > opts.room) {
+        fprintf(stderr, "forth-gen: %d words do not fit in the dictionary (room for %d)\n",
+                opts.words, opts.room);
+        compiler_cleanup(&compiler);
+        forth_cleanup(&vm);
+        unlink(opts.db_path);
+        return 1;
+    }
+
+    int status = 0;
+    if (generate_dictionary(&opts, &compiler) != 0) {
+        fprintf(stderr, "forth-gen: failed to write dictionary: %s\n", sqlite3_errmsg(vm.db));
+        status = 1;
+    }
+
+    if (status == 0 && opts.script_path && generate_script(&opts) != 0) {
+        status = 1;
+    }
+
+    compiler_cleanup(&compiler);
+    forth_cleanup(&vm);
+
+    if (status == 0) {
+        printf("Generated %d words (depth %d, fan-out %d) in %s\n",
+               opts.words, opts.depth, opts.fanout, opts.db_path);
+        if (opts.script_path) {
+            printf("Generated %ld-token script in %s\n", opts.tokens, opts.script_path);
+        }
+    }
+    return status;
+}
@@ -0,0 +1,395 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#include "protocol.h"
+
+// Load generator for server mode.
+//
+// "serve" sends text request lines to a running `forth-sqlite --serve`
+// over its Unix socket; "frame" sends binary frames, evaluating the request
+// text or, with -W, calling a pre-resolved word with -a arguments. Up to
+// -p requests are kept in flight: every batch of responses read is
+// answered with as many new requests in a single write. "spawn" runs a
+// fresh interpreter process per request instead, the way callers worked
+// before server mode. All modes report requests/sec and per-request
+// latency percentiles as JSON.
+
+#define MAX_REQUESTS 1000000
+#define MAX_DEPTH 4096
+#define MAX_ARGS 16
+
+typedef struct {
+    const char *mode;
+    const char *socket_path;
+    const char *binary;
+    const char *request;
+    const char *word;
+    int args[MAX_ARGS];
+    int arg_count;
+    int requests;
+    int warmup;
+    int depth;
+} loadgen_options_t;
+
+static double now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static int compare_double(const void *a, const void *b) {
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+static double percentile(const double *sorted, int count, double p) {
+    if (count == 0) return 0.0;
+    int idx = (int)(p * (count - 1) + 0.5);
+    return sorted[idx];
+}
+
+static int connect_socket(const char *path) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+        perror("forth-loadgen: connect");
+        if (fd >= 0) close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static int write_all(int fd, const unsigned char *data, size_t size) {
+    while (size > 0) {
+        ssize_t n = write(fd, data, size);
+        if (n <= 0) return -1;
+        data += n;
+        size -= n;
+    }
+    return 0;
+}
+
+// Buffered responses; parsers consume one complete response or return 0
+typedef struct {
+    int fd;
+    unsigned char buf[1 << 16];
+    size_t len;
+    size_t pos;
+} reader_t;
+
+// Text: output lines ending with an "ok" or "error" line
+static size_t parse_text(const unsigned char *data, size_t size, int *status) {
+    size_t line_start = 0;
+    for (size_t i = 0; i < size; i++) {
+        if (data[i] != '\n') continue;
+        size_t line_len = i - line_start;
+        const unsigned char *line = data + line_start;
+        line_start = i + 1;
+        if ((line_len == 2 && memcmp(line, "ok", 2) == 0) ||
+            (line_len == 5 && memcmp(line, "error", 5) == 0)) {
+            *status = line_len == 5;
+            return i + 1;
+        }
+    }
+    return 0;
+}
+
+static size_t parse_frame(const unsigned char *data, size_t size, int *status) {
+    if (size < FRAME_RESPONSE_HEADER) return 0;
+    size_t length = protocol_get_u32(data);
+    if (size < 4 + length) return 0;
+    *status = data[4] != FRAME_STATUS_OK;
+    return 4 + length;
+}
+
+// Read at least one more response into the buffer; -1 on EOF or error
+static int fill(reader_t *r) {
+    if (r->pos > 0) {
+        memmove(r->buf, r->buf + r->pos, r->len - r->pos);
+        r->len -= r->pos;
+        r->pos = 0;
+    }
+    if (r->len == sizeof(r->buf)) return -1;  // Response larger than the buffer
+
+    ssize_t n = read(r->fd, r->buf + r->len, sizeof(r->buf) - r->len);
+    if (n <= 0) return -1;
+    r->len += n;
+    return 0;
+}
+
+static size_t build_call(unsigned char *out, int word_idx, const int *args, int count) {
+    size_t length = 1 + 6 + (size_t)count * VALUE_INT_SIZE;
+    protocol_put_u32(out, (uint32_t)length);
+    out[4] = FRAME_CALL;
+    protocol_put_u32(out + 5, (uint32_t)word_idx);
+    protocol_put_u16(out + 9, (uint16_t)count);
+    for (int i = 0; i < count; i++) {
+        unsigned char *value = out + 11 + i * VALUE_INT_SIZE;
+        value[0] = VALUE_INT;
+        protocol_put_u32(value + 1, (uint32_t)args[i]);
+    }
+    return 4 + length;
+}
+
+static size_t build_text_frame(unsigned char *out, int type, const char *text) {
+    size_t text_len = strlen(text);
+    protocol_put_u32(out, (uint32_t)(1 + text_len));
+    out[4] = (unsigned char)type;
+    memcpy(out + 5, text, text_len);
+    return 5 + text_len;
+}
+
+// Resolve a word id with a lookup frame before the run
+static int lookup_word(int fd, reader_t *reader, const char *name) {
+    unsigned char frame[PROTOCOL_MAX_FRAME];
+    size_t size = build_text_frame(frame, FRAME_LOOKUP, name);
+    if (write_all(fd, frame, size) != 0) return -1;
+
+    int status;
+    size_t used;
+    while ((used = parse_frame(reader->buf + reader->pos, reader->len - reader->pos, &status)) == 0) {
+        if (fill(reader) != 0) return -1;
+    }
+    const unsigned char *response = reader->buf + reader->pos;
+    reader->pos += used;
+
+    uint32_t output_len = protocol_get_u32(response + 8);
+    if (status != 0 || protocol_get_u16(response + 6) != 1) return -1;
+    return (int)protocol_get_u32(response + FRAME_RESPONSE_HEADER + output_len + 1);
+}
+
+static int run_serve(const loadgen_options_t *opts, int binary, double *latencies, int *errors) {
+    int fd = connect_socket(opts->socket_path);
+    if (fd < 0) return -1;
+
+    static reader_t reader;
+    reader.fd = fd;
+    reader.len = reader.pos = 0;
+
+    // Every request is the same; build it once
+    unsigned char request[PROTOCOL_MAX_FRAME];
+    size_t request_len;
+    if (binary) {
+        if (write_all(fd, (const unsigned char*)PROTOCOL_MAGIC, PROTOCOL_MAGIC_LEN) != 0) {
+            close(fd);
+            return -1;
+        }
+        if (opts->word) {
+            int word_idx = lookup_word(fd, &reader, opts->word);
+            if (word_idx < 0) {
+                fprintf(stderr, "forth-loadgen: unknown word %s\n", opts->word);
+                close(fd);
+                return -1;
+            }
+            request_len = build_call(request, word_idx, opts->args, opts->arg_count);
+        } else {
+            request_len = build_text_frame(request, FRAME_EVAL, opts->request);
+        }
+    } else {
+        request_len = snprintf((char*)request, sizeof(request), "%s\n", opts->request);
+    }
+
+    static unsigned char batch[MAX_DEPTH * 64];
+    static double sent_at[MAX_DEPTH];
+    int total = opts->warmup + opts->requests;
+    int sent = 0;
+    int done = 0;
+    int to_send = opts->depth < total ? opts->depth : total;
+
+    while (done < total) {
+        // Refill the window in one write
+        if (to_send > 0) {
+            size_t batch_len = 0;
+            double now = now_us();
+            for (int i = 0; i < to_send; i++) {
+                memcpy(batch + batch_len, request, request_len);
+                batch_len += request_len;
+                sent_at[(sent + i) % opts->depth] = now;
+            }
+            if (write_all(fd, batch, batch_len) != 0) {
+                perror("forth-loadgen: write");
+                close(fd);
+                return -1;
+            }
+            sent += to_send;
+        }
+
+        if (fill(&reader) != 0) {
+            fprintf(stderr, "forth-loadgen: server closed the connection\n");
+            close(fd);
+            return -1;
+        }
+
+        int received = 0;
+        int status;
+        size_t used;
+        double now = now_us();
+        while ((used = (binary ? parse_frame : parse_text)(reader.buf + reader.pos,
+                                                          reader.len - reader.pos, &status)) > 0) {
+            reader.pos += used;
+            if (done >= opts->warmup) {
+                latencies[done - opts->warmup] = now - sent_at[done % opts->depth];
+                *errors += status;
+            }
+            done++;
+            received++;
+        }
+
+        to_send = received < total - sent ? received : total - sent;
+    }
+
+    close(fd);
+    return 0;
+}
+
+static int run_spawn(const loadgen_options_t *opts, double *latencies, int *errors) {
+    char script[] = "/tmp/forth-loadgen-XXXXXX.fth";
+    int fd = mkstemps(script, 4);
+    if (fd < 0) {
+        perror("forth-loadgen: mkstemps");
+        return -1;
+    }
+    dprintf(fd, "%s\n", opts->request);
+    close(fd);
+
+    int result = 0;
+    for (int i = 0; i < opts->warmup + opts->requests; i++) {
+        double start = now_us();
+        pid_t pid = fork();
+        if (pid < 0) {
+            perror("fork");
+            result = -1;
+            break;
+        }
+        if (pid == 0) {
+            int devnull = open("/dev/null", O_WRONLY);
+            if (devnull >= 0) {
+                dup2(devnull, STDOUT_FILENO);
+                close(devnull);
+            }
+            execl(opts->binary, opts->binary, script, (char*)NULL);
+            _exit(127);
+        }
+
+        int status;
+        if (waitpid(pid, &status, 0) < 0) {
+            perror("waitpid");
+            result = -1;
+            break;
+        }
+        if (i >= opts->warmup) {
+            latencies[i - opts->warmup] = now_us() - start;
+            *errors += !(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+        }
+    }
+
+    unlink(script);
+    return result;
+}
+
+static int parse_args(loadgen_options_t *opts, const char *spec) {
+    char buf[256];
+    snprintf(buf, sizeof(buf), "%s", spec);
+    opts->arg_count = 0;
+    for (char *item = strtok(buf, ","); item; item = strtok(NULL, ",")) {
+        if (opts->arg_count == MAX_ARGS) return -1;
+        opts->args[opts->arg_count++] = atoi(item);
+    }
+    return 0;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+        "Usage: %s [-m serve|frame|spawn] [-s socket] [-b binary] [-r request]\n"
+        "          [-W word] [-a arg,arg...] [-p depth] [-n requests] [-w warmup]\n", prog);
+}
+
+int main(int argc, char *argv[]) {
+    loadgen_options_t opts = {
+        .mode = "serve",
+        .socket_path = "forth.sock",
+        .binary = "bin/forth-sqlite",
+        .request = "1 2 + .",
+        .word = NULL,
+        .arg_count = 0,
+        .requests = 10000,
+        .warmup = 100,
+        .depth = 1,
+    };
+
+    int opt;
+    while ((opt = getopt(argc, argv, "m:s:b:r:W:a:p:n:w:h")) != -1) {
+        switch (opt) {
+            case 'm': opts.mode = optarg; break;
+            case 's': opts.socket_path = optarg; break;
+            case 'b': opts.binary = optarg; break;
+            case 'r': opts.request = optarg; break;
+            case 'W': opts.word = optarg; break;
+            case 'p': opts.depth = atoi(optarg); break;
+            case 'a':
+                if (parse_args(&opts, optarg) != 0) {
+                    fprintf(stderr, "forth-loadgen: at most %d arguments\n", MAX_ARGS);
+                    return 1;
+                }
+                break;
+            case 'n': opts.requests = atoi(optarg); break;
+            case 'w': opts.warmup = atoi(optarg); break;
+            default:
+                usage(argv[0]);
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    int spawn = strcmp(opts.mode, "spawn") == 0;
+    int binary = strcmp(opts.mode, "frame") == 0;
+    if ((!spawn && !binary && strcmp(opts.mode, "serve") != 0) ||
+        opts.requests < 1 || opts.requests > MAX_REQUESTS || opts.warmup < 0 ||
+        opts.depth < 1 || opts.depth > MAX_DEPTH ||
+        strlen(opts.request) + 8 > PROTOCOL_MAX_FRAME) {
+        fprintf(stderr, "forth-loadgen: invalid options\n");
+        usage(argv[0]);
+        return 1;
+    }
+
+    double *latencies = malloc(opts.requests * sizeof(double));
+    if (!latencies) return 1;
+
+    int errors = 0;
+    double start = now_us();
+    int result = spawn ? run_spawn(&opts, latencies, &errors)
+                       : run_serve(&opts, binary, latencies, &errors);
+    if (result != 0) {
+        free(latencies);
+        return 1;
+    }
+
+    // Pipelined requests overlap, so throughput comes from wall time
+    double wall_us = now_us() - start;
+    int total = opts.warmup + opts.requests;
+    qsort(latencies, opts.requests, sizeof(double), compare_double);
+
+    printf("{\"mode\": \"%s\", \"depth\": %d, \"requests\": %d, \"errors\": %d, "
+           "\"requests_per_sec\": %.1f, "
+           "\"p50_us\": %.1f, \"p99_us\": %.1f, \"max_us\": %.1f, \"wall_ms\": %.1f}\n",
+           opts.mode, opts.depth, opts.requests, errors, total / wall_us * 1e6,
+           percentile(latencies, opts.requests, 0.50),
+           percentile(latencies, opts.requests, 0.99),
+           latencies[opts.requests - 1], wall_us / 1e3);
+
+    free(latencies);
+    return 0;
+}
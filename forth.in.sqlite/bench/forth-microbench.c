@@ -0,0 +1,403 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "forth.h"
+#include "vdbe.h"
+#include "compiler.h"
+#include "profile.h"
+#include "task.h"
+#include "chan.h"
+#include "budget.h"
+
+// Microbenchmarks for the runtime's hot paths, linked against the same
+// objects as bin/forth-sqlite.
+//
+// Each case is timed in samples of `batch` calls. Warmup samples are
+// discarded, then samples further than 3 MADs above the median are
+// rejected as outliers (interrupts, migrations, page faults). Cases whose
+// body has to prepare the stack name a baseline case whose median is
+// subtracted, so the reported figure is the operation alone.
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define CYCLE_UNIT "cycles"
+static inline uint64_t read_cycles(void) {
+    return __rdtsc();
+}
+#else
+#define CYCLE_UNIT "ns"
+static inline uint64_t read_cycles(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+#endif
+
+#define MAX_SAMPLES 10000
+
+typedef struct {
+    const char *name;
+    void (*body)(void);
+    const char *baseline;  // Case whose cost is subtracted, or NULL
+} microbench_case_t;
+
+typedef struct {
+    double median;
+    double mean;
+    double min;
+    int kept;
+} microbench_result_t;
+
+static forth_vm_t vm;
+static forth_compiler_t compiler;
+static vdbe_program_t program;
+static vdbe_program_t sample_program;
+static volatile int sink;
+
+// Case bodies
+static void bench_push_pop(void) {
+    push(&vm, 1);
+    sink = pop(&vm);
+}
+
+// Stack setup is undone by resetting the stack pointer rather than popping,
+// so the baselines below cost exactly the pushes a primitive case performs.
+static void bench_push1(void) {
+    push(&vm, 7);
+    vm.stack_ptr = 0;
+}
+
+static void bench_push2(void) {
+    push(&vm, 6);
+    push(&vm, 3);
+    vm.stack_ptr = 0;
+}
+
+static void bench_prim_add(void)      { push(&vm, 6); push(&vm, 3); prim_add();      vm.stack_ptr = 0; }
+static void bench_prim_subtract(void) { push(&vm, 6); push(&vm, 3); prim_subtract(); vm.stack_ptr = 0; }
+static void bench_prim_multiply(void) { push(&vm, 6); push(&vm, 3); prim_multiply(); vm.stack_ptr = 0; }
+static void bench_prim_divide(void)   { push(&vm, 6); push(&vm, 3); prim_divide();   vm.stack_ptr = 0; }
+static void bench_prim_dup(void)      { push(&vm, 7); prim_dup();  vm.stack_ptr = 0; }
+static void bench_prim_drop(void)     { push(&vm, 7); prim_drop(); vm.stack_ptr = 0; }
+static void bench_prim_swap(void)     { push(&vm, 6); push(&vm, 3); prim_swap(); vm.stack_ptr = 0; }
+static void bench_prim_over(void)     { push(&vm, 6); push(&vm, 3); prim_over(); vm.stack_ptr = 0; }
+static void bench_prim_dot(void)      { push(&vm, 7); prim_dot();  vm.stack_ptr = 0; }
+static void bench_prim_emit(void)     { push(&vm, 'A'); prim_emit(); vm.stack_ptr = 0; }
+static void bench_prim_stack_show(void) { prim_stack_show(); }
+
+static int drop_idx;
+
+static void bench_execute_word(void) { push(&vm, 7); forth_execute_word(&vm, drop_idx); }
+
+static void bench_execute_word_profiled(void) {
+    profile_active = 1;
+    push(&vm, 7);
+    forth_execute_word(&vm, drop_idx);
+    profile_active = 0;
+}
+
+static void bench_execute_word_budgeted(void) {
+    budget_active = 1;
+    push(&vm, 7);
+    forth_execute_word(&vm, drop_idx);
+    budget_active = 0;
+}
+
+// One ready task whose body is nothing but pause: every round is a switch
+// into the task and back out
+#define SWITCH_TASK_LENGTH 4096
+
+static void start_switch_task(void) {
+    forth_task_t *task = task_new(&vm);
+    for (int i = 0; i < SWITCH_TASK_LENGTH; i++) {
+        task_append_token(task, "pause");
+    }
+    task_start(task);
+}
+
+static void bench_task_switch(void) {
+    if (task_run_round() == 0) {
+        start_switch_task();
+    }
+}
+
+// Uncontended send/receive pairs on each ring
+static chan_t *spsc_chan;
+static chan_t *mpmc_chan;
+
+static void bench_chan_spsc(void) {
+    int value;
+    chan_try_send(spsc_chan, 7);
+    chan_try_recv(spsc_chan, &value);
+    sink = value;
+}
+
+static void bench_chan_mpmc(void) {
+    int value;
+    chan_try_send(mpmc_chan, 7);
+    chan_try_recv(mpmc_chan, &value);
+    sink = value;
+}
+
+// Two tasks passing a message back and forth over capacity-1 channels:
+// every round trip parks and wakes each task once
+#define PINGPONG_ROUNDS 512
+
+static void start_pingpong_tasks(void) {
+    char ping[16], pong[16];
+    snprintf(ping, sizeof(ping), "%d", chan_new(1, CHAN_SPSC));
+    snprintf(pong, sizeof(pong), "%d", chan_new(1, CHAN_SPSC));
+
+    forth_task_t *a = task_new(&vm);
+    forth_task_t *b = task_new(&vm);
+    for (int i = 0; i < PINGPONG_ROUNDS; i++) {
+        const char *send_ping[] = {"1", ping, "chan-send", pong, "chan-recv", "drop"};
+        const char *send_pong[] = {ping, "chan-recv", pong, "chan-send"};
+        for (int k = 0; k < 6; k++) task_append_token(a, send_ping[k]);
+        for (int k = 0; k < 4; k++) task_append_token(b, send_pong[k]);
+    }
+    task_start(a);
+    task_start(b);
+}
+
+static void bench_chan_pingpong(void) {
+    if (task_run_round() == 0) {
+        start_pingpong_tasks();
+    }
+}
+
+// Name of the last word registered, found first by the backward scan
+static char recent_word[MAX_WORD_LEN];
+
+static void bench_find_word_recent(void) { sink = find_word(&vm, recent_word); }
+static void bench_find_word_oldest(void) { sink = find_word(&vm, "+"); }
+static void bench_find_word_miss(void)   { sink = find_word(&vm, "no-such-word"); }
+
+static void bench_vdbe_add_instruction(void) {
+    if (program.instruction_count >= 4096) {
+        program.instruction_count = 0;
+    }
+    sink = vdbe_add_instruction(&program, VDBE_ADD, 0, 0, 0);
+}
+
+static void bench_vdbe_program_to_sql(void) {
+    char sql[2048];
+    sink = vdbe_program_to_sql(&sample_program, sql, sizeof(sql));
+}
+
+static void bench_vdbe_compile_to_sqlite(void) {
+    sqlite3_stmt *stmt = NULL;
+    sink = vdbe_compile_to_sqlite(&sample_program, vm.db, &stmt);
+    sqlite3_finalize(stmt);
+}
+
+static void bench_compiler_save_word(void) {
+    sink = compiler_save_word(&compiler, "microbench-word", &sample_program);
+}
+
+static const microbench_case_t cases[] = {
+    {"push_pop",               bench_push_pop,               NULL},
+    {"push1",                  bench_push1,                  NULL},
+    {"push2",                  bench_push2,                  NULL},
+    {"prim_add",               bench_prim_add,               "push2"},
+    {"prim_subtract",          bench_prim_subtract,          "push2"},
+    {"prim_multiply",          bench_prim_multiply,          "push2"},
+    {"prim_divide",            bench_prim_divide,            "push2"},
+    {"prim_dup",               bench_prim_dup,               "push1"},
+    {"prim_drop",              bench_prim_drop,              "push1"},
+    {"prim_swap",              bench_prim_swap,              "push2"},
+    {"prim_over",              bench_prim_over,              "push2"},
+    {"prim_dot",               bench_prim_dot,               "push1"},
+    {"prim_emit",              bench_prim_emit,              "push1"},
+    {"prim_stack_show",        bench_prim_stack_show,        NULL},
+    {"execute_word",           bench_execute_word,           "push1"},
+    {"execute_word_profiled",  bench_execute_word_profiled,  "push1"},
+    {"execute_word_budgeted",  bench_execute_word_budgeted,  "push1"},
+    {"task_switch",            bench_task_switch,            NULL},
+    {"chan_spsc",              bench_chan_spsc,              NULL},
+    {"chan_mpmc",              bench_chan_mpmc,              NULL},
+    {"chan_pingpong",          bench_chan_pingpong,          NULL},
+    {"find_word_recent",       bench_find_word_recent,       NULL},
+    {"find_word_oldest",       bench_find_word_oldest,       NULL},
+    {"find_word_miss",         bench_find_word_miss,         NULL},
+    {"vdbe_add_instruction",   bench_vdbe_add_instruction,   NULL},
+    {"vdbe_program_to_sql",    bench_vdbe_program_to_sql,    NULL},
+    {"vdbe_compile_to_sqlite", bench_vdbe_compile_to_sqlite, NULL},
+    {"compiler_save_word",     bench_compiler_save_word,     NULL},
+};
+
+#define CASE_COUNT ((int)(sizeof(cases) / sizeof(cases[0])))
+
+static int compare_double(const void *a, const void *b) {
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+static double median_of(double *values, int count) {
+    qsort(values, count, sizeof(double), compare_double);
+    return values[count / 2];
+}
+
+static void run_case(const microbench_case_t *c, int samples, int warmup, int batch,
+                     microbench_result_t *result) {
+    static double times[MAX_SAMPLES];
+    static double deviations[MAX_SAMPLES];
+
+    for (int s = 0; s < warmup + samples; s++) {
+        uint64_t start = read_cycles();
+        for (int i = 0; i < batch; i++) {
+            c->body();
+        }
+        uint64_t end = read_cycles();
+        if (s >= warmup) {
+            times[s - warmup] = (double)(end - start) / batch;
+        }
+    }
+
+    // Reject samples more than 3 median absolute deviations above the median
+    double median = median_of(times, samples);
+    for (int s = 0; s < samples; s++) {
+        deviations[s] = times[s] > median ? times[s] - median : median - times[s];
+    }
+    double mad = median_of(deviations, samples);
+    double limit = median + 3.0 * (mad > 0.0 ? mad : median * 0.01);
+
+    int kept = 0;
+    double sum = 0.0;
+    for (int s = 0; s < samples; s++) {
+        if (times[s] <= limit) {
+            times[kept++] = times[s];
+            sum += times[s];
+        }
+    }
+
+    result->median = median_of(times, kept);
+    result->mean = sum / kept;
+    result->min = times[0];
+    result->kept = kept;
+}
+
+static int find_case(const char *name) {
+    for (int i = 0; i < CASE_COUNT; i++) {
+        if (strcmp(cases[i].name, name) == 0) return i;
+    }
+    return -1;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+        "Usage: %s [-s samples] [-w warmup] [-b batch] [-f name] [-d db_path]\n", prog);
+}
+
+int main(int argc, char *argv[]) {
+    int samples = 200;
+    int warmup = 20;
+    int batch = 1000;
+    const char *filter = NULL;
+    const char *db_path = ":memory:";
+
+    int opt;
+    while ((opt = getopt(argc, argv, "s:w:b:f:d:h")) != -1) {
+        switch (opt) {
+            case 's': samples = atoi(optarg); break;
+            case 'w': warmup = atoi(optarg); break;
+            case 'b': batch = atoi(optarg); break;
+            case 'f': filter = optarg; break;
+            case 'd': db_path = optarg; break;
+            default:
+                usage(argv[0]);
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    if (samples < 1 || samples > MAX_SAMPLES || batch < 1 || warmup < 0) {
+        fprintf(stderr, "forth-microbench: invalid sample configuration\n");
+        return 1;
+    }
+
+    // Primitives and the compiler print to stdout; keep the report separate
+    FILE *report = fdopen(dup(STDOUT_FILENO), "w");
+    if (!report || !freopen("/dev/null", "w", stdout)) {
+        perror("forth-microbench: redirect stdout");
+        return 1;
+    }
+
+    if (forth_init(&vm, db_path) != 0 || compiler_init(&compiler, &vm) != 0) {
+        fprintf(stderr, "forth-microbench: failed to initialize runtime\n");
+        return 1;
+    }
+
+    drop_idx = find_word(&vm, "drop");
+    snprintf(recent_word, sizeof(recent_word), "%s", forth_word(&vm, dict_size(&vm) - 1)->name);
+    start_switch_task();
+    spsc_chan = chan_get(chan_new(16, CHAN_SPSC));
+    mpmc_chan = chan_get(chan_new(16, CHAN_MPMC));
+
+    // A far deadline, so the budgeted case reads the clock as a real run
+    // would; the flag is only raised inside that case
+    budget_limits_t budget = {0, 3600ull * 1000000000ull, 0};
+    budget_enable(&vm, &budget);
+    budget_active = 0;
+    budget_begin(&vm);
+    profile_enable(PROFILE_DEFAULT_PERIOD);
+    profile_disable();
+
+    vdbe_init_program(&program);
+    vdbe_init_program(&sample_program);
+    for (int i = 0; i < 8; i++) {
+        vdbe_emit_literal(&sample_program, i);
+    }
+    vdbe_emit_arithmetic(&sample_program, "+");
+    vdbe_emit_arithmetic(&sample_program, "*");
+    vdbe_emit_stack_operation(&sample_program, "dup");
+    vdbe_emit_io(&sample_program, ".");
+
+    microbench_result_t results[CASE_COUNT];
+    int ran[CASE_COUNT] = {0};
+
+    fprintf(report, "{\n  \"unit\": \"%s\",\n  \"samples\": %d,\n  \"batch\": %d,\n"
+            "  \"cases\": [\n", CYCLE_UNIT, samples, batch);
+
+    int first = 1;
+    for (int i = 0; i < CASE_COUNT; i++) {
+        if (filter && strcmp(filter, cases[i].name) != 0) continue;
+
+        // The slow database cases get fewer calls per sample
+        int case_batch = strncmp(cases[i].name, "vdbe_compile", 12) == 0 ||
+                         strncmp(cases[i].name, "compiler_", 9) == 0 ?
+                         (batch + 99) / 100 : batch;
+        run_case(&cases[i], samples, warmup, case_batch, &results[i]);
+        ran[i] = 1;
+
+        double net = results[i].median;
+        if (cases[i].baseline) {
+            int b = find_case(cases[i].baseline);
+            if (!ran[b]) {
+                run_case(&cases[b], samples, warmup, batch, &results[b]);
+                ran[b] = 1;
+            }
+            net -= results[b].median;
+        }
+
+        fprintf(report, "%s    {\"name\": \"%s\", \"median\": %.2f, \"mean\": %.2f, "
+                "\"min\": %.2f, \"net\": %.2f, \"kept\": %d}",
+                first ? "" : ",\n", cases[i].name, results[i].median, results[i].mean,
+                results[i].min, net, results[i].kept);
+        first = 0;
+    }
+
+    fprintf(report, "\n  ]\n}\n");
+    fclose(report);
+
+    vdbe_cleanup_program(&program);
+    vdbe_cleanup_program(&sample_program);
+    compiler_cleanup(&compiler);
+    forth_cleanup(&vm);
+    return 0;
+}
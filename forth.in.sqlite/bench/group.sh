@@ -0,0 +1,72 @@
+#!/bin/sh
+# Group commit: write throughput against the number of writers.
+#
+# For each writer count, generates a script in which that many tasks each
+# make WRITES single-row inserts in WAL mode, and runs it with every write
+# committing on its own and with --group-commit. Prints writes per second
+# from each median run time, then a bar plot of both series.
+#
+# Usage: bench/group.sh [window_us]   (default: the built-in window)
+
+set -e
+
+BIN=${BIN:-bin}
+RUNS=${RUNS:-5}
+WRITES=${WRITES:-32}
+WRITERS=${WRITERS:-"1 2 4 8 16 32"}
+GROUP_OPTION=--group-commit${1:+=$1}
+
+WORK=$(mktemp -d /tmp/forth-group-XXXXXX)
+trap 'rm -rf "$WORK"' EXIT
+
+# Script with $1 writer tasks
+generate() {
+    echo "sql: gc-wal PRAGMA journal_mode=WAL"
+    echo "gc-wal"
+    echo "sql: gc-setup CREATE TABLE IF NOT EXISTS gc_log (writer INTEGER, seq INTEGER)"
+    echo "gc-setup"
+    echo "sql: gc-write INSERT INTO gc_log (writer, seq) VALUES (?1, ?2)"
+    echo "sql: gc-count SELECT count(*) FROM gc_log"
+    writer=1
+    while [ $writer -le $1 ]; do
+        line="0 spawn{"
+        seq=1
+        while [ $seq -le $WRITES ]; do
+            line="$line $writer $seq gc-write"
+            seq=$((seq + 1))
+        done
+        echo "$line } drop"
+        writer=$((writer + 1))
+    done
+    echo "run-tasks"
+    echo "gc-count ."
+}
+
+# Writes per second of the median run
+rate() {
+    "$BIN/forth-bench" -b "$BIN/forth-sqlite" -n "$RUNS" -w 1 -S "$1" $2 |
+        awk -v writes="$3" '/"p50_ms"/ {
+            sub(/.*"p50_ms": /, ""); sub(/,.*/, "")
+            printf "%.1f\n", writes * 1000 / $0
+        }'
+}
+
+printf "%-8s %14s %14s\n" writers "solo/sec" "grouped/sec"
+for writers in $WRITERS; do
+    generate "$writers" > "$WORK/writers_$writers.fth"
+    total=$((writers * WRITES))
+    solo=$(rate "$WORK/writers_$writers.fth" "" $total)
+    grouped=$(rate "$WORK/writers_$writers.fth" "-x $GROUP_OPTION" $total)
+    printf "%-8s %14s %14s\n" "$writers" "$solo" "$grouped"
+    echo "$writers $solo $grouped" >> "$WORK/results"
+done
+
+echo
+echo "# writes/sec (s = solo, g = grouped)"
+awk '{ if ($2 > max) max = $2; if ($3 > max) max = $3; n[NR] = $1; s[NR] = $2; g[NR] = $3 }
+     END {
+         for (i = 1; i <= NR; i++) {
+             printf "%4d s |", n[i]; for (j = 0; j < s[i] * 50 / max; j++) printf "#"; printf " %.0f\n", s[i]
+             printf "     g |"; for (j = 0; j < g[i] * 50 / max; j++) printf "="; printf " %.0f\n", g[i]
+         }
+     }' "$WORK/results"
@@ -0,0 +1,51 @@
+#!/bin/sh
+# In-memory mode against the on-disk database.
+#
+# Latency: the SQL-heavy workloads of the suite and insert_rows, each run
+# on the file and with --memory. Recovery: for synthetic dictionaries of
+# increasing size, the time to start up and be ready with the database
+# loaded, and the load itself as the interpreter reports it.
+#
+# Usage: bench/memdb.sh [sizes...]   (default: 1000 10000 100000)
+
+set -e
+
+BIN=${BIN:-bin}
+RUNS=${RUNS:-5}
+SEED=${SEED:-42}
+SIZES=${*:-"1000 10000 100000"}
+
+WORK=$(mktemp -d /tmp/forth-memdb-XXXXXX)
+trap 'rm -rf "$WORK"' EXIT
+
+p50() {
+    awk '/"p50_ms"/ { sub(/.*"p50_ms": /, ""); sub(/,.*/, ""); print }'
+}
+
+echo "# latency, p50 ms"
+printf "%-14s %10s %10s\n" workload disk memory
+for name in bulk_insert cursor_scan aggregate; do
+    disk=$("$BIN/forth-bench" -b "$BIN/forth-sqlite" -n "$RUNS" -w 1 -f $name | p50)
+    memory=$("$BIN/forth-bench" -b "$BIN/forth-sqlite" -n "$RUNS" -w 1 -f $name -x --memory | p50)
+    printf "%-14s %10s %10s\n" $name "$disk" "$memory"
+done
+disk=$("$BIN/forth-bench" -b "$BIN/forth-sqlite" -n "$RUNS" -w 1 -S bench/insert_rows.fth | p50)
+memory=$("$BIN/forth-bench" -b "$BIN/forth-sqlite" -n "$RUNS" -w 1 -S bench/insert_rows.fth -x --memory | p50)
+printf "%-14s %10s %10s\n" insert_rows "$disk" "$memory"
+
+echo
+echo "# recovery: startup with the database loaded"
+printf '1 drop\n' > "$WORK/startup.fth"
+printf "%-8s %12s %14s %14s %10s\n" words "db bytes" "disk p50 ms" "memory p50 ms" "load ms"
+for n in $SIZES; do
+    db="$WORK/words-$n.db"
+    "$BIN/forth-gen" -o "$db" -S "$WORK/unused.fth" -n "$n" -t 1 -s "$SEED" > /dev/null
+    disk=$("$BIN/forth-bench" -b "$BIN/forth-sqlite" -n "$RUNS" -w 1 -S "$WORK/startup.fth" -D "$db" | p50)
+    memory=$("$BIN/forth-bench" -b "$BIN/forth-sqlite" -n "$RUNS" -w 1 -S "$WORK/startup.fth" -D "$db" -x --memory | p50)
+
+    mkdir -p "$WORK/load"
+    cp "$db" "$WORK/load/forth.db"
+    load=$(cd "$WORK/load" && "$BIN/forth-sqlite" --memory "$WORK/startup.fth" 2>/dev/null |
+        awk '/bytes into memory/ { print $2, $(NF - 1) }')
+    printf "%-8s %12s %14s %14s %10s\n" "$n" "${load% *}" "$disk" "$memory" "${load#* }"
+done
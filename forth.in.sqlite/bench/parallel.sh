@@ -0,0 +1,22 @@
+#!/bin/sh
+# Task scaling over the worker pool.
+#
+# Runs the parallel sum and sort workloads with no pool (tasks take turns
+# on the interpreter's thread) and with increasing worker counts. Speedup
+# is bounded by the cores available.
+#
+# Usage: bench/parallel.sh
+
+set -e
+
+BIN=${BIN:-bin}
+RUNS=${RUNS:-5}
+WORKERS=${WORKERS:-"0 1 2 4 8"}
+
+for workers in $WORKERS; do
+    for script in par_sum par_sort; do
+        echo "# $script, $workers workers"
+        "$BIN/forth-bench" -b "$BIN/forth-sqlite" -n "$RUNS" -w 1 \
+            -S "bench/$script.fth" -x "--workers=$workers"
+    done
+done
@@ -0,0 +1,70 @@
+#!/bin/sh
+# Job queue: jobs per second against the dequeue batch size.
+#
+# In WAL mode, fills a queue with JOBS jobs in one statement, then
+# CONSUMERS tasks drain it with dequeue-batch and ack-batch, each claiming
+# its share of the jobs in batches of the given size. Runs each script as
+# is, with --group-commit, and with --group-commit on WORKERS pool
+# workers, and prints jobs per second from the median run time less that
+# of a script that only fills the queue.
+#
+# Usage: bench/queue.sh [batch sizes...]   (default: 1 4 16)
+
+set -e
+
+BIN=${BIN:-bin}
+RUNS=${RUNS:-5}
+JOBS=${JOBS:-1024}
+CONSUMERS=${CONSUMERS:-64}
+WORKERS=${WORKERS:-4}
+BATCHES=${*:-"1 4 16"}
+
+WORK=$(mktemp -d /tmp/forth-queue-XXXXXX)
+trap 'rm -rf "$WORK"' EXIT
+
+# Script whose consumers claim batches of $1 jobs; none without $1
+generate() {
+    echo "sql: q-wal PRAGMA journal_mode=WAL"
+    echo "q-wal"
+    echo "queue-init"
+    echo "sql: q-fill WITH RECURSIVE n(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM n WHERE i < ?1) INSERT INTO forth_jobs (queue, payload, visible_at) SELECT 0, i, 0 FROM n"
+    echo "$JOBS q-fill"
+    [ -n "$1" ] || return 0
+    consumer=0
+    while [ $consumer -lt $CONSUMERS ]; do
+        line="0 spawn{"
+        round=0
+        while [ $round -lt $((JOBS / CONSUMERS / $1)) ]; do
+            line="$line $1 0 30000 dequeue-batch ack-batch"
+            round=$((round + 1))
+        done
+        echo "$line } drop"
+        consumer=$((consumer + 1))
+    done
+    echo "run-tasks"
+    echo "0 job-count ."
+}
+
+# Median run time in milliseconds
+p50() {
+    "$BIN/forth-bench" -b "$BIN/forth-sqlite" -n "$RUNS" -w 1 -S "$1" $2 |
+        awk '/"p50_ms"/ { sub(/.*"p50_ms": /, ""); sub(/,.*/, ""); print }'
+}
+
+rate() {
+    awk -v jobs="$JOBS" -v ms="$1" -v fill="$2" 'BEGIN { printf "%.1f\n", jobs * 1000 / (ms - fill) }'
+}
+
+generate > "$WORK/fill.fth"
+fill=$(p50 "$WORK/fill.fth" "")
+fill_grouped=$(p50 "$WORK/fill.fth" "-x --group-commit")
+fill_workers=$(p50 "$WORK/fill.fth" "-x --group-commit -x --workers=$WORKERS")
+
+printf "%-8s %14s %14s %14s\n" batch "direct/sec" "grouped/sec" "workers/sec"
+for batch in $BATCHES; do
+    generate "$batch" > "$WORK/batch_$batch.fth"
+    direct=$(rate "$(p50 "$WORK/batch_$batch.fth" "")" "$fill")
+    grouped=$(rate "$(p50 "$WORK/batch_$batch.fth" "-x --group-commit")" "$fill_grouped")
+    workers=$(rate "$(p50 "$WORK/batch_$batch.fth" "-x --group-commit -x --workers=$WORKERS")" "$fill_workers")
+    printf "%-8s %14s %14s %14s\n" "$batch" "$direct" "$grouped" "$workers"
+done
@@ -0,0 +1,62 @@
+#!/bin/sh
+# Scale benchmarks over synthetic dictionaries.
+#
+# For each dictionary size, forth-gen builds a database and two scripts from
+# a fixed seed, then forth-bench times:
+#   startup      - a trivial script, dominated by loading the dictionary
+#   lookup       - a call-heavy script resolving generated words
+#   persistence  - a definition-heavy script writing new words
+#
+# Sizes must fit in the dictionary (MAX_DICT_SIZE slots, less the
+# primitives); forth-gen refuses larger ones. Each script is run once
+# first, and the benchmark stops if it reports an error, since
+# forth-sqlite exits 0 after a failed line.
+#
+# Usage: bench/scale.sh [sizes...]   (default: 1000 10000 100000)
+
+set -e
+
+BIN=${BIN:-bin}
+RUNS=${RUNS:-5}
+SEED=${SEED:-42}
+SIZES=${*:-"1000 10000 100000"}
+
+WORK=$(mktemp -d /tmp/forth-scale-XXXXXX)
+trap 'rm -rf "$WORK"' EXIT
+
+printf '1 drop\n' > "$WORK/startup.fth"
+
+# Run $2 once on a copy of database $1 and fail if it reported an error
+check() {
+    rm -rf "$WORK/check"
+    mkdir "$WORK/check"
+    cp "$1" "$WORK/check/forth.db"
+    script=$(cd "$(dirname "$2")" && pwd)/$(basename "$2")
+    bin=$(cd "$BIN" && pwd)
+    (cd "$WORK/check" && "$bin/forth-sqlite" "$script" > /dev/null 2> errors)
+    if grep -q . "$WORK/check/errors"; then
+        echo "scale.sh: $(basename "$2") failed with $(basename "$1"):" >&2
+        head -5 "$WORK/check/errors" >&2
+        exit 1
+    fi
+}
+
+for n in $SIZES; do
+    db="$WORK/words-$n.db"
+    "$BIN/forth-gen" -o "$db" -S "$WORK/lookup-$n.fth" -n "$n" -t 20000 \
+        -m lit:30,prim:20,word:50,def:0 -s "$SEED" > /dev/null
+    "$BIN/forth-gen" -o "$WORK/unused.db" -S "$WORK/persist-$n.fth" -n "$n" -t 2000 \
+        -m lit:40,prim:20,word:0,def:40 -s "$SEED" > /dev/null
+
+    for phase in startup lookup persist; do
+        case $phase in
+            startup) script="$WORK/startup.fth" ;;
+            *)       script="$WORK/$phase-$n.fth" ;;
+        esac
+        check "$db" "$script"
+        printf '{"words": %s, "phase": "%s", "result": ' "$n" "$phase"
+        "$BIN/forth-bench" -b "$BIN/forth-sqlite" -n "$RUNS" -w 1 \
+            -S "$script" -D "$db" | tr -d '\n' | tr -s ' '
+        printf '}\n'
+    done
+done
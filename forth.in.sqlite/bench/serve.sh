@@ -0,0 +1,35 @@
+#!/bin/sh
+# Server mode against per-request process spawning.
+#
+# Starts `forth-sqlite --serve` on a scratch database and socket, then
+# forth-loadgen sends the same request by spawning one interpreter per
+# request, and through the socket as text lines and as binary frames
+# (evaluated text and pre-resolved word calls) at increasing pipeline
+# depths.
+#
+# Usage: bench/serve.sh [request]   (default: "1 2 + .")
+
+set -e
+
+BIN=$(cd "${BIN:-bin}" && pwd)
+REQUESTS=${REQUESTS:-10000}
+SPAWN_REQUESTS=${SPAWN_REQUESTS:-200}
+REQUEST=${1:-"1 2 + ."}
+
+WORK=$(mktemp -d /tmp/forth-serve-XXXXXX)
+cd "$WORK"
+"$BIN/forth-sqlite" --serve="$WORK/forth.sock" > server.log 2>&1 &
+SERVER=$!
+trap 'kill $SERVER 2>/dev/null; wait $SERVER 2>/dev/null; rm -rf "$WORK"' EXIT
+
+while [ ! -S "$WORK/forth.sock" ]; do sleep 0.05; done
+
+DEPTHS=${DEPTHS:-"1 4 16 64 256"}
+SOCK="$WORK/forth.sock"
+
+"$BIN/forth-loadgen" -m spawn -b "$BIN/forth-sqlite" -n "$SPAWN_REQUESTS" -w 5 -r "$REQUEST"
+for depth in $DEPTHS; do
+    "$BIN/forth-loadgen" -m serve -s "$SOCK" -n "$REQUESTS" -p "$depth" -r "$REQUEST"
+    "$BIN/forth-loadgen" -m frame -s "$SOCK" -n "$REQUESTS" -p "$depth" -r "$REQUEST"
+    "$BIN/forth-loadgen" -m frame -s "$SOCK" -n "$REQUESTS" -p "$depth" -W + -a 1,2
+done
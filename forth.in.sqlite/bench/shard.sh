@@ -0,0 +1,73 @@
+#!/bin/sh
+# Sharded writes: write throughput against the number of shards.
+#
+# In WAL mode, WRITERS tasks each make WRITES single-row inserts of
+# distinct keys, routed with shard-for and shard-exec and awaited, so
+# every shard's thread commits its own writes to its own file. Runs the script with
+# each shard count, and for reference the same inserts run directly on
+# the one database. Prints writes per second from each median run time.
+#
+# Usage: bench/shard.sh [shard counts...]   (default: 1 2 4 8)
+
+set -e
+
+BIN=${BIN:-bin}
+RUNS=${RUNS:-5}
+WRITERS=${WRITERS:-32}
+WRITES=${WRITES:-16}
+SHARDS=${*:-"1 2 4 8"}
+
+WORK=$(mktemp -d /tmp/forth-shard-XXXXXX)
+trap 'rm -rf "$WORK"' EXIT
+
+# Script whose writers run each insert through $1 (a word list taking
+# key value on the stack)
+generate() {
+    echo "sql: sh-wal PRAGMA journal_mode=WAL"
+    echo "sh-wal"
+    echo "sql: sh-setup CREATE TABLE IF NOT EXISTS sh_rows (k INTEGER PRIMARY KEY, v INTEGER)"
+    echo "sh-setup"
+    echo "sql: sh-clear DELETE FROM sh_rows"
+    echo "sh-clear"
+    if [ "$1" = sharded ]; then
+        echo "' sh-wal shard-all"
+        echo "' sh-setup shard-all"
+        echo "' sh-clear shard-all"
+    fi
+    echo "sql: sh-write INSERT INTO sh_rows (k, v) VALUES (?1, ?2)"
+    writer=0
+    while [ $writer -lt $WRITERS ]; do
+        line="0 spawn{"
+        seq=0
+        while [ $seq -lt $WRITES ]; do
+            key=$((writer * WRITES + seq))
+            if [ "$1" = sharded ]; then
+                line="$line $key $seq $key shard-for ' sh-write shard-exec await"
+            else
+                line="$line $key $seq sh-write"
+            fi
+            seq=$((seq + 1))
+        done
+        echo "$line } drop"
+        writer=$((writer + 1))
+    done
+    echo "run-tasks"
+}
+
+# Writes per second of the median run
+rate() {
+    "$BIN/forth-bench" -b "$BIN/forth-sqlite" -n "$RUNS" -w 1 -S "$1" $2 |
+        awk -v writes=$((WRITERS * WRITES)) '/"p50_ms"/ {
+            sub(/.*"p50_ms": /, ""); sub(/,.*/, "")
+            printf "%.1f\n", writes * 1000 / $0
+        }'
+}
+
+generate direct > "$WORK/direct.fth"
+generate sharded > "$WORK/sharded.fth"
+
+printf "%-10s %12s\n" shards "writes/sec"
+printf "%-10s %12s\n" none "$(rate "$WORK/direct.fth" "")"
+for shards in $SHARDS; do
+    printf "%-10s %12s\n" "$shards" "$(rate "$WORK/sharded.fth" "-x --shards=$shards")"
+done
@@ -0,0 +1,93 @@
+#!/bin/sh
+# Read snapshots: analytic tasks against concurrent writers.
+#
+# In WAL mode, WRITERS tasks make single-row inserts while READERS tasks
+# each run QUERIES aggregates over a table of ROWS rows, on --workers.
+# Each script runs with the aggregates on the workers' connections and
+# with each reader's aggregates inside one snapshot-begin/snapshot-end.
+# Also times snapshot-begin snapshot-end pairs alone, which reuse one
+# connection after the first.
+#
+# Usage: bench/snapshot.sh
+
+set -e
+
+BIN=${BIN:-bin}
+RUNS=${RUNS:-5}
+ROWS=${ROWS:-20000}
+WRITERS=${WRITERS:-4}
+WRITES=${WRITES:-50}
+READERS=${READERS:-4}
+QUERIES=${QUERIES:-10}
+WORKERS=${WORKERS:-4}
+PAIRS=${PAIRS:-1000}
+
+WORK=$(mktemp -d /tmp/forth-snapshot-XXXXXX)
+trap 'rm -rf "$WORK"' EXIT
+
+p50() {
+    awk '/"p50_ms"/ { sub(/.*"p50_ms": /, ""); sub(/,.*/, ""); print }'
+}
+
+# Script with readers bracketing their queries by $1 and $2
+generate() {
+    echo "sql: sb-wal PRAGMA journal_mode=WAL"
+    echo "sb-wal"
+    echo "sql: sb-setup CREATE TABLE IF NOT EXISTS sb_rows (k INTEGER, v INTEGER)"
+    echo "sb-setup"
+    echo "sql: sb-clear DELETE FROM sb_rows"
+    echo "sb-clear"
+    echo "sql: sb-seed WITH RECURSIVE n(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM n WHERE i < $ROWS) INSERT INTO sb_rows SELECT i, i % 97 FROM n"
+    echo "sb-seed"
+    echo "sql: sb-write INSERT INTO sb_rows (k, v) VALUES (?1, ?2)"
+    echo "sql: sb-agg SELECT sum(v) % 1000 FROM sb_rows WHERE v > 10"
+    writer=1
+    while [ $writer -le $WRITERS ]; do
+        line="0 spawn{"
+        seq=1
+        while [ $seq -le $WRITES ]; do
+            line="$line $writer $seq sb-write"
+            seq=$((seq + 1))
+        done
+        echo "$line } drop"
+        writer=$((writer + 1))
+    done
+    reader=1
+    while [ $reader -le $READERS ]; do
+        line="0 spawn{ $1"
+        query=1
+        while [ $query -le $QUERIES ]; do
+            line="$line sb-agg drop"
+            query=$((query + 1))
+        done
+        echo "$line $2 } drop"
+        reader=$((reader + 1))
+    done
+    echo "run-tasks"
+}
+
+generate "" "" > "$WORK/plain.fth"
+generate snapshot-begin snapshot-end > "$WORK/snapshot.fth"
+
+{
+    echo "sql: sb-wal PRAGMA journal_mode=WAL"
+    echo "sb-wal"
+    pair=1
+    while [ $pair -le $PAIRS ]; do
+        echo "snapshot-begin snapshot-end"
+        pair=$((pair + 1))
+    done
+} > "$WORK/pairs.fth"
+printf '1 drop\n' > "$WORK/empty.fth"
+
+printf "%-24s %10s\n" run "p50 ms"
+plain=$("$BIN/forth-bench" -b "$BIN/forth-sqlite" -n "$RUNS" -w 1 -S "$WORK/plain.fth" -x --workers=$WORKERS | p50)
+printf "%-24s %10s\n" "readers, no snapshot" "$plain"
+snapshot=$("$BIN/forth-bench" -b "$BIN/forth-sqlite" -n "$RUNS" -w 1 -S "$WORK/snapshot.fth" -x --workers=$WORKERS | p50)
+printf "%-24s %10s\n" "readers in snapshots" "$snapshot"
+
+pairs=$("$BIN/forth-bench" -b "$BIN/forth-sqlite" -n "$RUNS" -w 1 -S "$WORK/pairs.fth" | p50)
+empty=$("$BIN/forth-bench" -b "$BIN/forth-sqlite" -n "$RUNS" -w 1 -S "$WORK/empty.fth" | p50)
+echo
+awk -v pairs="$pairs" -v empty="$empty" -v n="$PAIRS" \
+    'BEGIN { printf "snapshot-begin snapshot-end: %.1f us per pair\n", (pairs - empty) * 1000 / n }'
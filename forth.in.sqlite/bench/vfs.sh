@@ -0,0 +1,64 @@
+#!/bin/sh
+# The write-coalescing VFS against SQLite's own.
+#
+# Commit latency: insert_rows, where each of 2000 inserts commits on its
+# own in rollback-journal mode, as the median time per commit. Throughput:
+# bulk_insert and a WAL script in which WRITERS tasks make single-row
+# inserts under --group-commit, as writes per second of the median run.
+# Each is run with --vfs=default, --vfs=coalesce and --vfs=uring.
+#
+# Usage: bench/vfs.sh
+
+set -e
+
+BIN=${BIN:-bin}
+RUNS=${RUNS:-5}
+WRITES=${WRITES:-64}
+WRITERS=${WRITERS:-8}
+MODES="default coalesce uring"
+
+WORK=$(mktemp -d /tmp/forth-vfs-XXXXXX)
+trap 'rm -rf "$WORK"' EXIT
+
+p50() {
+    awk '/"p50_ms"/ { sub(/.*"p50_ms": /, ""); sub(/,.*/, ""); print }'
+}
+
+# $1 per median run, as a rate or a time per item
+per_second() {
+    p50 | awk -v n="$1" '{ printf "%.1f\n", n * 1000 / $0 }'
+}
+per_item() {
+    p50 | awk -v n="$1" '{ printf "%.3f\n", $0 / n }'
+}
+
+{
+    echo "sql: vw-wal PRAGMA journal_mode=WAL"
+    echo "vw-wal"
+    echo "sql: vw-setup CREATE TABLE IF NOT EXISTS vw_log (writer INTEGER, seq INTEGER)"
+    echo "vw-setup"
+    echo "sql: vw-write INSERT INTO vw_log (writer, seq) VALUES (?1, ?2)"
+    writer=1
+    while [ $writer -le $WRITERS ]; do
+        line="0 spawn{"
+        seq=1
+        while [ $seq -le $WRITES ]; do
+            line="$line $writer $seq vw-write"
+            seq=$((seq + 1))
+        done
+        echo "$line } drop"
+        writer=$((writer + 1))
+    done
+    echo "run-tasks"
+} > "$WORK/writers.fth"
+
+printf "%-10s %18s %18s %18s\n" vfs "commit p50 ms" "bulk_insert p50 ms" "grouped writes/sec"
+for mode in $MODES; do
+    commit=$("$BIN/forth-bench" -b "$BIN/forth-sqlite" -n "$RUNS" -w 1 -S bench/insert_rows.fth \
+        -x --vfs=$mode | per_item 2000)
+    bulk=$("$BIN/forth-bench" -b "$BIN/forth-sqlite" -n "$RUNS" -w 1 -f bulk_insert \
+        -x --vfs=$mode | p50)
+    grouped=$("$BIN/forth-bench" -b "$BIN/forth-sqlite" -n "$RUNS" -w 1 -S "$WORK/writers.fth" \
+        -x --vfs=$mode -x --group-commit | per_second $((WRITERS * WRITES)))
+    printf "%-10s %18s %18s %18s\n" $mode "$commit" "$bulk" "$grouped"
+done
@@ -0,0 +1,420 @@
+#define _GNU_SOURCE
+#include "async.h"
+#include "pool.h"
+#include "combine.h"
+#include "trace.h"
+
+// Asynchronous SQL execution.
+//
+// One lock guards the job queue, the future table and every future's done
+// flag and waiter; I/O threads sleep on job_available, and code outside
+// any task that awaits a future sleeps on job_done. A job carries a copy
+// of the word's SQL and the generation it was taken from, so the I/O
+// threads never read the dictionary: each keeps its own statement per
+// dictionary slot and prepares it again when the generation changes.
+//
+// Every completion is announced to the task scheduler, either by waking
+// the task parked on the future or with task_notify, so that a scheduler
+// idling until tasks can run again notices futures finishing as well.
+
+typedef struct {
+    pthread_t thread;
+    sqlite3 *db;
+    forth_stmt_cache_t *stmts;
+} async_thread_t;
+
+int async_threads = 0;
+
+static pthread_mutex_t async_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t job_available = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t job_done = PTHREAD_COND_INITIALIZER;
+static async_future_t *queue_head = NULL;
+static async_future_t *queue_tail = NULL;
+static async_future_t *futures[ASYNC_MAX_FUTURES];
+static int next_future_id = 1;
+
+static async_thread_t *threads = NULL;
+static int thread_count = 0;
+static int stopping = 0;
+
+static void future_free(async_future_t *future) {
+    free(future->sql);
+    free(future->values);
+    free(future->text);
+    free(future->error);
+    free(future);
+}
+
+static void append_value(async_future_t *future, int value) {
+    if (future->value_count == future->value_capacity) {
+        int capacity = future->value_capacity ? future->value_capacity * 2 : 16;
+        int *grown = realloc(future->values, capacity * sizeof(int));
+        if (!grown) return;
+        future->values = grown;
+        future->value_capacity = capacity;
+    }
+    future->values[future->value_count++] = value;
+}
+
+static void append_text(async_future_t *future, const char *text) {
+    size_t len = strlen(text) + 1;  // Followed by a space, as SQL words print
+    if (future->text_len + len + 1 > future->text_capacity) {
+        size_t capacity = future->text_capacity ? future->text_capacity : 256;
+        while (capacity < future->text_len + len + 1) capacity *= 2;
+        char *grown = realloc(future->text, capacity);
+        if (!grown) return;
+        future->text = grown;
+        future->text_capacity = capacity;
+    }
+    memcpy(future->text + future->text_len, text, len - 1);
+    future->text_len += len;
+    future->text[future->text_len - 1] = ' ';
+    future->text[future->text_len] = '\0';
+}
+
+static sqlite3_stmt *thread_statement(sqlite3 *db, forth_stmt_cache_t *stmts,
+                                      async_future_t *future) {
+    forth_stmt_cache_t *entry = &stmts[future->word_idx];
+    if (entry->stmt && entry->generation == future->generation) {
+        return entry->stmt;
+    }
+
+    sqlite3_finalize(entry->stmt);
+    entry->stmt = NULL;
+    if (trace_active) trace_begin(TRACE_SQL, "prepare");
+    int rc = sqlite3_prepare_v2(db, future->sql, -1, &entry->stmt, NULL);
+    if (trace_active) trace_end(TRACE_SQL, "prepare");
+    if (rc != SQLITE_OK) {
+        sqlite3_finalize(entry->stmt);
+        entry->stmt = NULL;
+        return NULL;
+    }
+    entry->generation = future->generation;
+    return entry->stmt;
+}
+
+// Run a job the way execute_sql_word runs an SQL word, into the future
+void async_run(sqlite3 *db, forth_stmt_cache_t *stmts, async_future_t *future) {
+    sqlite3_stmt *stmt = thread_statement(db, stmts, future);
+    if (!stmt) {
+        future->error = strdup(sqlite3_errmsg(db));
+        return;
+    }
+
+    for (int i = 0; i < future->param_count; i++) {
+        sqlite3_bind_int(stmt, i + 1, future->params[i]);
+    }
+
+    if (trace_active) trace_begin(TRACE_SQL, "step");
+    int rc;
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        int column_count = sqlite3_column_count(stmt);
+        for (int i = 0; i < column_count; i++) {
+            switch (sqlite3_column_type(stmt, i)) {
+                case SQLITE_INTEGER:
+                case SQLITE_FLOAT:
+                    append_value(future, sqlite3_column_int(stmt, i));
+                    break;
+                case SQLITE_TEXT:
+                    append_text(future, (const char*)sqlite3_column_text(stmt, i));
+                    break;
+                default:
+                    break;
+            }
+        }
+    }
+    if (trace_active) trace_end(TRACE_SQL, "step");
+    if (rc != SQLITE_DONE) {
+        future->error = strdup(sqlite3_errmsg(db));
+    }
+    sqlite3_reset(stmt);
+    sqlite3_clear_bindings(stmt);
+}
+
+void async_complete(async_future_t *future) {
+    pthread_mutex_lock(&async_lock);
+    future->done = 1;
+    forth_task_t *waiter = future->waiter;
+    future->waiter = NULL;
+    pthread_cond_broadcast(&job_done);
+    pthread_mutex_unlock(&async_lock);
+
+    if (waiter) {
+        task_wake_remote(waiter);
+    } else {
+        task_notify();
+    }
+}
+
+static void *io_main(void *arg) {
+    async_thread_t *thread = arg;
+
+    pthread_mutex_lock(&async_lock);
+    for (;;) {
+        while (!queue_head && !stopping) {
+            pthread_cond_wait(&job_available, &async_lock);
+        }
+        async_future_t *future = queue_head;
+        if (!future) break;  // Stopping with nothing left to run
+        queue_head = future->next;
+        if (!queue_head) queue_tail = NULL;
+        pthread_mutex_unlock(&async_lock);
+
+        async_run(thread->db, thread->stmts, future);
+        async_complete(future);
+        pthread_mutex_lock(&async_lock);
+    }
+    pthread_mutex_unlock(&async_lock);
+    return NULL;
+}
+
+int async_open(forth_vm_t *vm, sqlite3 **db, forth_stmt_cache_t **stmts) {
+    const char *path = sqlite3_db_filename(vm->db, "main");
+    if (!path || !path[0]) {
+        forth_error("Asynchronous statements need an on-disk database");
+        return -1;
+    }
+
+    *db = NULL;
+    *stmts = calloc(MAX_DICT_SIZE, sizeof(forth_stmt_cache_t));
+    if (!*stmts || sqlite3_open(path, db) != SQLITE_OK) {
+        fprintf(stderr, "Failed to open I/O connection: %s\n",
+                *db ? sqlite3_errmsg(*db) : "out of memory");
+        async_close(*db, *stmts);
+        return -1;
+    }
+    sqlite3_busy_timeout(*db, POOL_BUSY_TIMEOUT_MS);
+    trace_connection(*db);
+
+    // The submitting connection now shares the file with another thread
+    sqlite3_busy_timeout(vm->db, POOL_BUSY_TIMEOUT_MS);
+    return 0;
+}
+
+void async_close(sqlite3 *db, forth_stmt_cache_t *stmts) {
+    if (stmts) {
+        for (int i = 0; i < MAX_DICT_SIZE; i++) {
+            sqlite3_finalize(stmts[i].stmt);
+        }
+        free(stmts);
+    }
+    sqlite3_close(db);
+}
+
+// Callers hold async_lock
+static int start_threads(forth_vm_t *vm) {
+    int count = async_threads ? async_threads : ASYNC_DEFAULT_THREADS;
+    if (count < 1 || count > ASYNC_MAX_THREADS) {
+        forth_error("I/O thread count out of range");
+        return -1;
+    }
+    threads = calloc(count, sizeof(async_thread_t));
+    if (!threads) return -1;
+
+    for (int i = 0; i < count; i++) {
+        async_thread_t *thread = &threads[i];
+        if (async_open(vm, &thread->db, &thread->stmts) != 0) {
+            break;
+        }
+        if (pthread_create(&thread->thread, NULL, io_main, thread) != 0) {
+            async_close(thread->db, thread->stmts);
+            break;
+        }
+        thread_count++;
+    }
+
+    if (thread_count == 0) {
+        free(threads);
+        threads = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+void async_stop(void) {
+    pthread_mutex_lock(&async_lock);
+    stopping = 1;
+    pthread_cond_broadcast(&job_available);
+    pthread_mutex_unlock(&async_lock);
+
+    for (int i = 0; i < thread_count; i++) {
+        pthread_join(threads[i].thread, NULL);
+        async_close(threads[i].db, threads[i].stmts);
+    }
+    free(threads);
+    threads = NULL;
+    thread_count = 0;
+
+    for (int i = 0; i < ASYNC_MAX_FUTURES; i++) {
+        if (futures[i]) {
+            future_free(futures[i]);
+            futures[i] = NULL;
+        }
+    }
+    stopping = 0;
+}
+
+int async_park(forth_task_t *task, async_future_t *future) {
+    pthread_mutex_lock(&async_lock);
+    int pending = !future->done;
+    if (pending) {
+        task->state = TASK_BLOCKED;
+        future->waiter = task;
+    }
+    pthread_mutex_unlock(&async_lock);
+    return pending;
+}
+
+async_future_t *async_future_new(forth_vm_t *vm, int word_idx, forth_word_t *word) {
+    int param_count = sqlite3_bind_parameter_count(word->data.compiled);
+    async_future_t *future = calloc(1, sizeof(async_future_t));
+    if (!future || !(future->sql = strdup(sqlite3_sql(word->data.compiled)))) {
+        free(future);
+        forth_error("Failed to allocate future");
+        return NULL;
+    }
+    future->word_idx = word_idx;
+    future->generation = word->generation;
+    future->param_count = param_count;
+
+    pthread_mutex_lock(&async_lock);
+    int id = next_future_id;
+    if (futures[id % ASYNC_MAX_FUTURES]) {
+        pthread_mutex_unlock(&async_lock);
+        future_free(future);
+        forth_error("Too many pending futures");
+        return NULL;
+    }
+    next_future_id = id + 1 > 0 ? id + 1 : 1;
+    future->id = id;
+    futures[id % ASYNC_MAX_FUTURES] = future;
+    pthread_mutex_unlock(&async_lock);
+
+    vm->stack_ptr -= param_count;
+    memcpy(future->params, vm->data_stack + vm->stack_ptr, param_count * sizeof(int));
+    return future;
+}
+
+// async-exec ( x1..xn word -- future ): run an SQL word (by index, from ')
+// on an I/O thread
+void prim_async_exec(void) {
+    forth_vm_t *vm = forth_current();
+    if (stack_depth(vm) < 1) {
+        forth_error("Stack underflow in async-exec");
+        return;
+    }
+    int word_idx = pop(vm);
+    if (word_idx < 0 || word_idx >= dict_size(vm)) {
+        forth_error("Unknown word in async-exec");
+        return;
+    }
+    forth_word_t *word = forth_word(vm, word_idx);
+    if (word->type != WORD_SQL) {
+        forth_error("async-exec needs an SQL word");
+        return;
+    }
+
+    int param_count = sqlite3_bind_parameter_count(word->data.compiled);
+    if (param_count > ASYNC_MAX_PARAMS) {
+        forth_error("Too many parameters for async-exec");
+        return;
+    }
+    if (stack_depth(vm) < param_count) {
+        forth_error("Stack underflow in async-exec");
+        return;
+    }
+
+    // The I/O threads' connections see only what has been written out
+    if (combine_active) {
+        combine_flush_all(vm);
+    }
+
+    async_future_t *future = async_future_new(vm, word_idx, word);
+    if (!future) return;
+
+    pthread_mutex_lock(&async_lock);
+    if (!threads && start_threads(vm) != 0) {
+        futures[future->id % ASYNC_MAX_FUTURES] = NULL;
+        pthread_mutex_unlock(&async_lock);
+        future_free(future);
+        return;
+    }
+
+    if (queue_tail) queue_tail->next = future;
+    else queue_head = future;
+    queue_tail = future;
+    pthread_cond_signal(&job_available);
+    pthread_mutex_unlock(&async_lock);
+
+    push(vm, future->id);
+}
+
+// await ( future -- x1..xn ): wait for an asynchronous call and take its
+// results. A task parks until the future is done; outside a task, ready
+// tasks run meanwhile.
+void prim_await(void) {
+    forth_vm_t *vm = forth_current();
+    if (stack_depth(vm) < 1) {
+        forth_error("Stack underflow in await");
+        return;
+    }
+    int id = pop(vm);
+
+    pthread_mutex_lock(&async_lock);
+    async_future_t *future = id > 0 ? futures[id % ASYNC_MAX_FUTURES] : NULL;
+    if (!future || future->id != id) {
+        pthread_mutex_unlock(&async_lock);
+        forth_error("Unknown future");
+        return;
+    }
+
+    if (!future->done && vm->task) {
+        // Park, then run await again once the future is done
+        pthread_mutex_unlock(&async_lock);
+        push(vm, id);
+        vm->task->ip--;
+        vm->yield = 1;
+        vm->wake_ns = 0;
+        vm->wait_future = future;
+        return;
+    }
+
+    // An event loop cannot wait for the statement; a task can, or the
+    // client once it is done
+    if (!future->done && vm->event_loop) {
+        pthread_mutex_unlock(&async_lock);
+        task_refuse_wait(vm, "await");
+        push(vm, id);  // Still awaitable
+        return;
+    }
+    for (int attempt = 0; !future->done; attempt++) {
+        pthread_mutex_unlock(&async_lock);
+        int idle = task_help(attempt) != 0;
+        forth_set_current(vm);
+        pthread_mutex_lock(&async_lock);
+        if (idle) {
+            while (!future->done) {
+                pthread_cond_wait(&job_done, &async_lock);
+            }
+        }
+    }
+    futures[id % ASYNC_MAX_FUTURES] = NULL;
+    pthread_mutex_unlock(&async_lock);
+
+    if (future->text) {
+        fputs(future->text, vm->out);
+    }
+    if (future->error) {
+        fprintf(stderr, "SQL word error: %s\n", future->error);
+    }
+    int count = future->value_count;
+    if (vm->stack_ptr + count > STACK_SIZE) {
+        forth_error("Stack overflow in await");
+        count = STACK_SIZE - vm->stack_ptr;
+    }
+    if (count > 0) {
+        memcpy(vm->data_stack + vm->stack_ptr, future->values, count * sizeof(int));
+        vm->stack_ptr += count;
+    }
+    future_free(future);
+}
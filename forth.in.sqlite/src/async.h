@@ -0,0 +1,80 @@
+#ifndef ASYNC_H
+#define ASYNC_H
+
+#include <pthread.h>
+#include "forth.h"
+#include "task.h"
+
+// Asynchronous SQL words.
+//
+// `async-exec` hands an SQL word and its arguments to a pool of I/O
+// threads, each with its own connection to the database file, and pushes
+// a future; `await` exchanges the future for the word's results. A task
+// awaiting a future that is not done yet parks until the I/O thread that
+// finishes it wakes the task, so other tasks (and the interpreter) keep
+// computing while the statement runs. Futures are named by ids so they
+// can live on the stack; each is freed by the await that collects it.
+
+#define ASYNC_MAX_THREADS 64
+#define ASYNC_DEFAULT_THREADS 2
+
+// Futures that may be pending or uncollected at once
+#define ASYNC_MAX_FUTURES 4096
+
+// Arguments an asynchronous call takes from the stack
+#define ASYNC_MAX_PARAMS 32
+
+typedef struct async_future {
+    int id;
+    int word_idx;
+    uint64_t generation;  // Of the definition the SQL was taken from
+    char *sql;
+    int params[ASYNC_MAX_PARAMS];
+    int param_count;
+
+    // Results: numeric columns to push, text columns to print
+    int *values;
+    int value_count;
+    int value_capacity;
+    char *text;
+    size_t text_len;
+    size_t text_capacity;
+    char *error;  // Set when the statement failed
+
+    int done;                       // Under async_lock
+    forth_task_t *waiter;           // Task parked on the future
+    struct async_future *next;      // Job queue
+} async_future_t;
+
+// I/O threads started on the first async-exec; 0 for the default
+extern int async_threads;
+
+// Future for an SQL word, registered under a new id, with its arguments
+// taken off the stack (at most ASYNC_MAX_PARAMS, which the caller has
+// checked are there); NULL, reported, if the future table is full
+async_future_t *async_future_new(forth_vm_t *vm, int word_idx, forth_word_t *word);
+
+// Connection to vm's database file for a thread that runs futures, with a
+// statement cache for every dictionary slot
+int async_open(forth_vm_t *vm, sqlite3 **db, forth_stmt_cache_t **stmts);
+void async_close(sqlite3 *db, forth_stmt_cache_t *stmts);
+
+// Run a future's statement on such a connection, filling in its results
+void async_run(sqlite3 *db, forth_stmt_cache_t *stmts, async_future_t *future);
+
+// Mark a future done and wake whoever waits on it
+void async_complete(async_future_t *future);
+
+// Park a task that found the future pending; returns 0 without parking if
+// it completed meanwhile
+int async_park(forth_task_t *task, async_future_t *future);
+
+// Stop the I/O threads once the queued statements have run, and free
+// every uncollected future
+void async_stop(void);
+
+// Primitives
+void prim_async_exec(void);
+void prim_await(void);
+
+#endif
@@ -0,0 +1,91 @@
+#include "budget.h"
+#include "task.h"
+
+// Execution budgets.
+//
+// Each VM carries the state of its current run: instructions charged so
+// far, the instruction limit, and the deadlines for the run and, in a
+// task, for its time slice. Word calls count instructions inline and read
+// the clock every BUDGET_CLOCK_INTERVAL calls. The progress handler covers
+// time spent inside SQLite: it charges the VM current on the calling
+// thread, and returning nonzero makes the statement fail with
+// SQLITE_INTERRUPT.
+
+int budget_active = 0;
+
+static budget_limits_t limits;
+static uint64_t aborted = 0;
+static uint64_t preempted = 0;
+
+static int progress_callback(void *ctx) {
+    (void)ctx;
+    forth_vm_t *vm = forth_current();
+    if (!vm || !vm->budget_running) return 0;
+    vm->budget_insns += BUDGET_PROGRESS_STEPS;
+    return budget_check(vm);
+}
+
+void budget_attach(sqlite3 *db) {
+    sqlite3_progress_handler(db, BUDGET_PROGRESS_STEPS, progress_callback, NULL);
+}
+
+int budget_enable(forth_vm_t *vm, const budget_limits_t *budget) {
+    if (!budget->insns && !budget->time_ns && !budget->slice_ns) {
+        return -1;
+    }
+    limits = *budget;
+    budget_attach(vm->db);
+    budget_active = 1;
+    return 0;
+}
+
+void budget_begin(forth_vm_t *vm) {
+    uint64_t now = (limits.time_ns || limits.slice_ns) ? task_now_ns() : 0;
+    vm->budget_insns = 0;
+    vm->budget_insn_limit = limits.insns ? limits.insns : UINT64_MAX;
+    vm->budget_deadline_ns = limits.time_ns ? now + limits.time_ns : 0;
+    vm->budget_slice_end_ns = (limits.slice_ns && vm->task) ? now + limits.slice_ns : 0;
+    vm->budget_exhausted = 0;
+    vm->budget_running = 1;
+}
+
+void budget_end(forth_vm_t *vm) {
+    vm->budget_running = 0;
+}
+
+// Slow path of budget_charge and the progress handler: abort the run past
+// a limit, or ask a task past its slice to yield
+int budget_check(forth_vm_t *vm) {
+    if (vm->budget_exhausted) return 1;
+
+    const char *limit = NULL;
+    if (vm->budget_insns > vm->budget_insn_limit) {
+        limit = "instruction";
+    } else if (vm->budget_deadline_ns || vm->budget_slice_end_ns) {
+        uint64_t now = task_now_ns();
+        if (vm->budget_deadline_ns && now >= vm->budget_deadline_ns) {
+            limit = "time";
+        } else if (vm->budget_slice_end_ns && now >= vm->budget_slice_end_ns) {
+            // Takes effect once the word about to run returns
+            vm->budget_slice_end_ns = 0;
+            vm->yield = 1;
+            vm->wake_ns = 0;
+            __atomic_add_fetch(&preempted, 1, __ATOMIC_RELAXED);
+        }
+    }
+
+    if (!limit) return 0;
+    vm->budget_exhausted = 1;
+    __atomic_add_fetch(&aborted, 1, __ATOMIC_RELAXED);
+    fprintf(stderr, "Forth Error: %s budget exhausted%s\n", limit,
+            vm->task ? ", task aborted" : "");
+    return 1;
+}
+
+uint64_t budget_aborted_count(void) {
+    return __atomic_load_n(&aborted, __ATOMIC_RELAXED);
+}
+
+uint64_t budget_preempted_count(void) {
+    return __atomic_load_n(&preempted, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,61 @@
+#ifndef BUDGET_H
+#define BUDGET_H
+
+#include "forth.h"
+
+// Execution budgets.
+//
+// A run is one interpreted line, one server request or one turn of a task
+// between yields. A run may execute at most `insns` instructions and take
+// at most `time_ns` of wall time; past either limit it is aborted: the
+// rest of the line is skipped, or the task ends with an empty stack. Word
+// calls count one instruction and are where the budget is checked. SQL is
+// charged BUDGET_PROGRESS_STEPS instructions per progress callback, which
+// interrupts the statement once the budget is gone. A task that has run
+// for `slice_ns` yields at its next word, so long tasks take turns.
+
+// SQLite VDBE instructions between progress callbacks
+#define BUDGET_PROGRESS_STEPS 1000
+
+// Word calls between clock reads
+#define BUDGET_CLOCK_INTERVAL 64
+
+// Zero means no limit
+typedef struct {
+    uint64_t insns;
+    uint64_t time_ns;
+    uint64_t slice_ns;
+} budget_limits_t;
+
+// Checked on every word call; zero unless budgets were enabled
+extern int budget_active;
+
+// Start charging runs on vm's connection; budget_attach adds another
+// connection (a pool worker's), whose statements are charged to the VM
+// running on the calling thread
+int budget_enable(forth_vm_t *vm, const budget_limits_t *limits);
+void budget_attach(sqlite3 *db);
+
+// Bracket a run of vm
+void budget_begin(forth_vm_t *vm);
+void budget_end(forth_vm_t *vm);
+
+// Runs aborted and task turns cut short so far
+uint64_t budget_aborted_count(void);
+uint64_t budget_preempted_count(void);
+
+int budget_check(forth_vm_t *vm);
+
+// Charge one word call; nonzero if the run is out of budget and the word
+// must not run
+static inline int budget_charge(forth_vm_t *vm) {
+    if (!vm->budget_running) return 0;
+    if (vm->budget_exhausted) return 1;
+    uint64_t insns = ++vm->budget_insns;
+    if (insns > vm->budget_insn_limit || insns % BUDGET_CLOCK_INTERVAL == 0) {
+        return budget_check(vm);
+    }
+    return 0;
+}
+
+#endif
@@ -0,0 +1,305 @@
+#define _POSIX_C_SOURCE 200112L
+#include "chan.h"
+
+// Channel implementation.
+//
+// Both ring buffers use free-running 64-bit head and tail counters masked
+// into the slot array. A successful operation checks for parked tasks with
+// a full fence between its own publication and reading `waiting`, and
+// chan_park bumps `waiting` before re-checking the ring, so either the
+// operation sees the waiter or the waiter sees the operation.
+
+static chan_t *channels[CHAN_MAX];
+static int channel_count = 0;
+
+int chan_new(int capacity, chan_kind_t kind) {
+    if (capacity < 1 || capacity > CHAN_MAX_CAPACITY) {
+        return -1;
+    }
+    // An MPMC slot's sequence tells a full slot from an empty one only
+    // with at least two slots
+    uint64_t size = kind == CHAN_MPMC ? 2 : 1;
+    while (size < (uint64_t)capacity) size <<= 1;
+
+    void *memory;
+    if (posix_memalign(&memory, CHAN_CACHE_LINE, sizeof(chan_t)) != 0) {
+        return -1;
+    }
+    chan_t *chan = memory;
+    memset(chan, 0, sizeof(chan_t));
+    chan->kind = kind;
+    chan->mask = size - 1;
+
+    if (kind == CHAN_MPMC) {
+        chan->slots = malloc(size * sizeof(chan_slot_t));
+        if (chan->slots) {
+            for (uint64_t i = 0; i < size; i++) {
+                chan->slots[i].sequence = i;
+            }
+        }
+    } else {
+        chan->cells = malloc(size * sizeof(int));
+    }
+    if (!chan->slots && !chan->cells) {
+        free(chan);
+        return -1;
+    }
+    pthread_mutex_init(&chan->wait_lock, NULL);
+
+    int id = __atomic_add_fetch(&channel_count, 1, __ATOMIC_RELAXED);
+    if (id >= CHAN_MAX) {
+        pthread_mutex_destroy(&chan->wait_lock);
+        free(chan->slots);
+        free(chan->cells);
+        free(chan);
+        return -1;
+    }
+    __atomic_store_n(&channels[id], chan, __ATOMIC_RELEASE);
+    return id;
+}
+
+chan_t *chan_get(int id) {
+    if (id <= 0 || id >= CHAN_MAX) return NULL;
+    return __atomic_load_n(&channels[id], __ATOMIC_ACQUIRE);
+}
+
+static int has_items(chan_t *chan) {
+    uint64_t tail = __atomic_load_n(&chan->tail, __ATOMIC_SEQ_CST);
+    return tail != __atomic_load_n(&chan->head, __ATOMIC_SEQ_CST);
+}
+
+static int has_space(chan_t *chan) {
+    uint64_t head = __atomic_load_n(&chan->head, __ATOMIC_SEQ_CST);
+    return __atomic_load_n(&chan->tail, __ATOMIC_SEQ_CST) - head <= chan->mask;
+}
+
+static void wake_one(chan_t *chan, int senders) {
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (!__atomic_load_n(&chan->waiting, __ATOMIC_SEQ_CST)) {
+        return;
+    }
+
+    pthread_mutex_lock(&chan->wait_lock);
+    forth_task_t **list = senders ? &chan->senders : &chan->receivers;
+    forth_task_t *task = *list;
+    if (task) {
+        *list = task->next;
+        chan->waiting--;
+    }
+    pthread_mutex_unlock(&chan->wait_lock);
+
+    if (task) {
+        task_wake(task);
+    }
+}
+
+int chan_try_send(chan_t *chan, int value) {
+    if (chan->kind == CHAN_SPSC) {
+        uint64_t tail = __atomic_load_n(&chan->tail, __ATOMIC_RELAXED);
+        if (tail - chan->cached_head > chan->mask) {
+            chan->cached_head = __atomic_load_n(&chan->head, __ATOMIC_ACQUIRE);
+            if (tail - chan->cached_head > chan->mask) return -1;
+        }
+        chan->cells[tail & chan->mask] = value;
+        __atomic_store_n(&chan->tail, tail + 1, __ATOMIC_RELEASE);
+    } else {
+        uint64_t pos = __atomic_load_n(&chan->tail, __ATOMIC_RELAXED);
+        chan_slot_t *slot;
+        for (;;) {
+            slot = &chan->slots[pos & chan->mask];
+            uint64_t sequence = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+            int64_t diff = (int64_t)(sequence - pos);
+            if (diff == 0) {
+                if (__atomic_compare_exchange_n(&chan->tail, &pos, pos + 1, 1,
+                                                __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return -1;  // Full
+            } else {
+                pos = __atomic_load_n(&chan->tail, __ATOMIC_RELAXED);
+            }
+        }
+        slot->value = value;
+        __atomic_store_n(&slot->sequence, pos + 1, __ATOMIC_RELEASE);
+    }
+
+    wake_one(chan, 0);
+    return 0;
+}
+
+int chan_try_recv(chan_t *chan, int *value) {
+    if (chan->kind == CHAN_SPSC) {
+        uint64_t head = __atomic_load_n(&chan->head, __ATOMIC_RELAXED);
+        if (head == chan->cached_tail) {
+            chan->cached_tail = __atomic_load_n(&chan->tail, __ATOMIC_ACQUIRE);
+            if (head == chan->cached_tail) return -1;
+        }
+        *value = chan->cells[head & chan->mask];
+        __atomic_store_n(&chan->head, head + 1, __ATOMIC_RELEASE);
+    } else {
+        uint64_t pos = __atomic_load_n(&chan->head, __ATOMIC_RELAXED);
+        chan_slot_t *slot;
+        for (;;) {
+            slot = &chan->slots[pos & chan->mask];
+            uint64_t sequence = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+            int64_t diff = (int64_t)(sequence - (pos + 1));
+            if (diff == 0) {
+                if (__atomic_compare_exchange_n(&chan->head, &pos, pos + 1, 1,
+                                                __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return -1;  // Empty
+            } else {
+                pos = __atomic_load_n(&chan->head, __ATOMIC_RELAXED);
+            }
+        }
+        *value = slot->value;
+        __atomic_store_n(&slot->sequence, pos + chan->mask + 1, __ATOMIC_RELEASE);
+    }
+
+    wake_one(chan, 1);
+    return 0;
+}
+
+int chan_park(forth_task_t *task, chan_t *chan, int send) {
+    pthread_mutex_lock(&chan->wait_lock);
+    __atomic_add_fetch(&chan->waiting, 1, __ATOMIC_SEQ_CST);
+    if (send ? has_space(chan) : has_items(chan)) {
+        __atomic_sub_fetch(&chan->waiting, 1, __ATOMIC_SEQ_CST);
+        pthread_mutex_unlock(&chan->wait_lock);
+        return 0;
+    }
+
+    task->state = TASK_BLOCKED;
+    task->next = NULL;
+    forth_task_t **link = send ? &chan->senders : &chan->receivers;
+    while (*link) {
+        link = &(*link)->next;
+    }
+    *link = task;
+    pthread_mutex_unlock(&chan->wait_lock);
+    return 1;
+}
+
+// Channel words
+
+static void chan_new_word(chan_kind_t kind, const char *name) {
+    forth_vm_t *vm = forth_current();
+    if (stack_depth(vm) < 1) {
+        char message[64];
+        snprintf(message, sizeof(message), "Stack underflow in %s", name);
+        forth_error(message);
+        return;
+    }
+    int id = chan_new(pop(vm), kind);
+    if (id < 0) {
+        forth_error("Cannot create channel");
+        return;
+    }
+    push(vm, id);
+}
+
+// chan-new ( capacity -- chan ): any number of senders and receivers
+void prim_chan_new(void) {
+    chan_new_word(CHAN_MPMC, "chan-new");
+}
+
+// chan-new-spsc ( capacity -- chan ): one sender task, one receiver task
+void prim_chan_new_spsc(void) {
+    chan_new_word(CHAN_SPSC, "chan-new-spsc");
+}
+
+static chan_t *pop_chan(forth_vm_t *vm, int *id) {
+    *id = pop(vm);
+    chan_t *chan = chan_get(*id);
+    if (!chan) {
+        forth_error("Unknown channel");
+    }
+    return chan;
+}
+
+// Block the running task on chan: it parks, and the word is run again once
+// the channel wakes it. Outside a task, run tasks until they make room.
+static int wait_for(forth_vm_t *vm, chan_t *chan, int id, int send, int attempt) {
+    if (vm->task) {
+        push(vm, id);
+        vm->task->ip--;
+        vm->yield = 1;
+        vm->wake_ns = 0;
+        vm->wait_chan = chan;
+        vm->wait_send = send;
+        return 1;
+    }
+    if (task_refuse_wait(vm, send ? "chan-send" : "chan-recv")) {
+        push(vm, id);
+        return 1;
+    }
+    if (task_help(attempt) != 0) {
+        forth_error(send ? "chan-send would wait forever: channel is full"
+                         : "chan-recv would wait forever: channel is empty");
+        return 1;
+    }
+    forth_set_current(vm);
+    return 0;
+}
+
+// chan-send ( x chan -- ): wait while the channel is full
+void prim_chan_send(void) {
+    forth_vm_t *vm = forth_current();
+    if (stack_depth(vm) < 2) {
+        forth_error("Stack underflow in chan-send");
+        return;
+    }
+    int id;
+    chan_t *chan = pop_chan(vm, &id);
+    if (!chan) {
+        pop(vm);
+        return;
+    }
+    int value = vm->data_stack[vm->stack_ptr - 1];
+
+    for (int attempt = 0; chan_try_send(chan, value) != 0; attempt++) {
+        if (wait_for(vm, chan, id, 1, attempt)) return;
+    }
+    pop(vm);
+}
+
+// chan-recv ( chan -- x ): wait while the channel is empty
+void prim_chan_recv(void) {
+    forth_vm_t *vm = forth_current();
+    if (stack_depth(vm) < 1) {
+        forth_error("Stack underflow in chan-recv");
+        return;
+    }
+    int id;
+    chan_t *chan = pop_chan(vm, &id);
+    if (!chan) return;
+
+    int value;
+    for (int attempt = 0; chan_try_recv(chan, &value) != 0; attempt++) {
+        if (wait_for(vm, chan, id, 0, attempt)) return;
+    }
+    push(vm, value);
+}
+
+// chan-try-recv ( chan -- x -1 | 0 )
+void prim_chan_try_recv(void) {
+    forth_vm_t *vm = forth_current();
+    if (stack_depth(vm) < 1) {
+        forth_error("Stack underflow in chan-try-recv");
+        return;
+    }
+    int id;
+    chan_t *chan = pop_chan(vm, &id);
+    if (!chan) return;
+
+    int value;
+    if (chan_try_recv(chan, &value) == 0) {
+        push(vm, value);
+        push(vm, -1);
+    } else {
+        push(vm, 0);
+    }
+}
@@ -0,0 +1,75 @@
+#ifndef CHAN_H
+#define CHAN_H
+
+#include <pthread.h>
+#include "forth.h"
+#include "task.h"
+
+// Channels passing cells between tasks.
+//
+// A channel is a bounded ring buffer, either single-producer
+// single-consumer (a Lamport ring whose ends each cache the other's index)
+// or multi-producer multi-consumer (Vyukov's bounded queue, one sequence
+// number per slot). Sends and receives are lock-free; only a task that has
+// to wait takes the channel's wait lock, to park itself until the other
+// side wakes it. Channels are named by ids so they can live on the stack
+// and be passed to spawned tasks; ids are never reused.
+
+#define CHAN_MAX 4096
+#define CHAN_MAX_CAPACITY (1 << 20)
+#define CHAN_CACHE_LINE 64
+
+typedef enum {
+    CHAN_SPSC,
+    CHAN_MPMC
+} chan_kind_t;
+
+typedef struct {
+    uint64_t sequence;
+    int value;
+} chan_slot_t;
+
+typedef struct chan {
+    chan_kind_t kind;
+    uint64_t mask;
+    chan_slot_t *slots;  // MPMC
+    int *cells;          // SPSC
+
+    // Consumer end, then producer end, on their own cache lines
+    char pad0[CHAN_CACHE_LINE];
+    uint64_t head;
+    uint64_t cached_tail;
+    char pad1[CHAN_CACHE_LINE];
+    uint64_t tail;
+    uint64_t cached_head;
+    char pad2[CHAN_CACHE_LINE];
+
+    // Parked tasks, linked through task->next
+    pthread_mutex_t wait_lock;
+    int waiting;
+    forth_task_t *receivers;
+    forth_task_t *senders;
+} chan_t;
+
+// Channel lifecycle; capacity is rounded up to a power of two (at least
+// two for MPMC)
+int chan_new(int capacity, chan_kind_t kind);
+chan_t *chan_get(int id);
+
+// Non-blocking operations; 0 on success, -1 when full or empty. Either
+// wakes a task parked on the other side.
+int chan_try_send(chan_t *chan, int value);
+int chan_try_recv(chan_t *chan, int *value);
+
+// Park a task that found the channel full (send) or empty; returns 0
+// without parking if the channel became ready meanwhile
+int chan_park(forth_task_t *task, chan_t *chan, int send);
+
+// Primitives
+void prim_chan_new(void);
+void prim_chan_new_spsc(void);
+void prim_chan_send(void);
+void prim_chan_recv(void);
+void prim_chan_try_recv(void);
+
+#endif
@@ -0,0 +1,515 @@
+#define _GNU_SOURCE
+#include <ctype.h>
+#include <strings.h>
+#include "combine.h"
+
+// Write combining.
+//
+// Each dictionary slot is analysed the first time its current definition
+// runs: preparing the statement again under an authorizer lists the
+// tables it reads and writes (views and triggers included), and a small
+// scanner decides whether the text is a single-row INSERT whose VALUES
+// tuple can be repeated. The tuple becomes a template in which every
+// parameter is numbered explicitly, so row k of a batch binds its values
+// at k * width + 1 onwards.
+//
+// A table's buffer holds rows for one insert word at a time, in call
+// order; a different word inserting into the same table flushes it first.
+// The buffer owns the statements it flushes with, prepared on first use
+// from a copy of the word's SQL, so a redefined or freed word leaves
+// buffered rows intact: one for a full batch and one for each halving of
+// it down to the single-row statement, which write out any remainder in a
+// handful of statements.
+
+#define COMBINE_MAX_SQL 4096
+#define COMBINE_MAX_NAME 128
+
+// Batch sizes from the full batch down to one row, halving each time
+#define COMBINE_LEVELS 17
+
+typedef enum {
+    SLOT_OTHER,    // Runs normally after flushing its tables
+    SLOT_INSERT,   // Combinable insert
+    SLOT_BARRIER   // Flushes every buffer first
+} combine_kind_t;
+
+typedef struct {
+    uint64_t generation;  // Definition analysed, 0 before the first run
+    combine_kind_t kind;
+    int table;            // SLOT_INSERT: buffer of the target table
+    int width;            // SLOT_INSERT: parameters per row
+    int table_count;      // SLOT_OTHER: buffers to flush first
+    int tables[COMBINE_WORD_TABLES];
+} combine_slot_t;
+
+typedef struct {
+    char name[COMBINE_MAX_NAME];
+    int word_idx;          // Word whose rows are buffered, -1 when empty
+    uint64_t generation;
+    int width;
+    int *values;
+    int rows;
+    char *sql;             // Of the word, for preparing batches
+    int batch_rows;        // Rows per statement at level 0
+    sqlite3_stmt *batches[COMBINE_LEVELS];
+} combine_table_t;
+
+int combine_active = 0;
+
+static sqlite3 *combine_db = NULL;
+static int buffer_rows = COMBINE_DEFAULT_ROWS;
+static combine_slot_t slots[MAX_DICT_SIZE];
+static combine_table_t tables[COMBINE_MAX_TABLES];
+static int table_count = 0;
+static uint64_t rows_combined = 0;
+static uint64_t statements_run = 0;
+
+// Tables and actions seen by the authorizer while analysing a statement
+static struct {
+    char names[COMBINE_WORD_TABLES][COMBINE_MAX_NAME];
+    int count;
+    int inserts;
+    int reads;
+    int writes_other;  // Updates or deletes, or inserts into a second table
+    int barrier;
+} seen;
+
+static int find_table(const char *name, int create) {
+    for (int i = 0; i < table_count; i++) {
+        if (strcasecmp(tables[i].name, name) == 0) return i;
+    }
+    if (!create || table_count == COMBINE_MAX_TABLES) return -1;
+
+    combine_table_t *table = &tables[table_count];
+    memset(table, 0, sizeof(*table));
+    snprintf(table->name, sizeof(table->name), "%s", name);
+    table->word_idx = -1;
+    return table_count++;
+}
+
+static void note_table(const char *name) {
+    if (!name || strncmp(name, "sqlite_", 7) == 0) return;
+    for (int i = 0; i < seen.count; i++) {
+        if (strcasecmp(seen.names[i], name) == 0) return;
+    }
+    if (seen.count == COMBINE_WORD_TABLES) {
+        seen.barrier = 1;
+        return;
+    }
+    snprintf(seen.names[seen.count++], COMBINE_MAX_NAME, "%s", name);
+}
+
+static int authorizer(void *ctx, int action, const char *arg1, const char *arg2,
+                      const char *database, const char *trigger) {
+    (void)ctx;
+    (void)database;
+    (void)trigger;
+    switch (action) {
+        case SQLITE_READ:
+            if (arg1 && strncmp(arg1, "sqlite_", 7) != 0) seen.reads++;
+            note_table(arg1);
+            break;
+        case SQLITE_INSERT:
+            if (seen.inserts && seen.count && strcasecmp(seen.names[0], arg1) != 0) {
+                seen.writes_other = 1;
+            }
+            seen.inserts++;
+            note_table(arg1);
+            break;
+        case SQLITE_UPDATE:
+        case SQLITE_DELETE:
+            seen.writes_other = 1;
+            note_table(arg1);
+            break;
+        case SQLITE_FUNCTION:
+            // These report on the inserts made so far
+            if (strcasecmp(arg2, "changes") == 0 || strcasecmp(arg2, "total_changes") == 0 ||
+                strcasecmp(arg2, "last_insert_rowid") == 0) {
+                seen.barrier = 1;
+            }
+            break;
+        case SQLITE_SELECT:
+        case SQLITE_RECURSIVE:
+            break;
+        default:
+            // Transactions, savepoints, schema changes, pragmas, attach
+            seen.barrier = 1;
+            break;
+    }
+    return SQLITE_OK;
+}
+
+static const char *skip_space(const char *p) {
+    while (isspace((unsigned char)*p)) p++;
+    return p;
+}
+
+static int keyword(const char **p, const char *word) {
+    size_t len = strlen(word);
+    if (strncasecmp(*p, word, len) != 0 || isalnum((unsigned char)(*p)[len]) || (*p)[len] == '_') {
+        return 0;
+    }
+    *p = skip_space(*p + len);
+    return 1;
+}
+
+// Skip a quoted string or identifier starting at p
+static const char *skip_quoted(const char *p) {
+    char quote = *p == '[' ? ']' : *p;
+    for (p++; *p; p++) {
+        if (*p == quote) {
+            if (quote != ']' && p[1] == quote) {
+                p++;
+                continue;
+            }
+            return p + 1;
+        }
+    }
+    return NULL;
+}
+
+// End of the parenthesised group starting at p, or NULL
+static const char *skip_group(const char *p) {
+    int depth = 0;
+    while (*p) {
+        if (*p == '\'' || *p == '"' || *p == '`' || *p == '[') {
+            if (!(p = skip_quoted(p))) return NULL;
+            continue;
+        }
+        if (*p == '(') depth++;
+        if (*p == ')' && --depth == 0) return p + 1;
+        p++;
+    }
+    return NULL;
+}
+
+// Append the VALUES tuple [start, end) for row `row` of a batch, every
+// parameter renumbered past the rows before it; -1 if the tuple has named
+// parameters or the text does not fit
+static int append_tuple(char *out, size_t size, size_t *len, const char *start,
+                        const char *end, int row, int width) {
+    int next = 0;  // Index an anonymous ? takes, as SQLite numbers them
+    for (const char *p = start; p < end; ) {
+        if (*p == '\'' || *p == '"' || *p == '`' || *p == '[') {
+            const char *q = skip_quoted(p);
+            if (!q || q > end || *len + (q - p) >= size) return -1;
+            memcpy(out + *len, p, q - p);
+            *len += q - p;
+            p = q;
+            continue;
+        }
+        if (*p == ':' || *p == '@' || *p == '$') {
+            return -1;
+        }
+        if (*p == '?') {
+            int index;
+            p++;
+            if (isdigit((unsigned char)*p)) {
+                index = (int)strtol(p, (char**)&p, 10);
+                if (index > next) next = index;
+            } else {
+                index = ++next;
+            }
+            int n = snprintf(out + *len, size - *len, "?%d", row * width + index);
+            if (n < 0 || (size_t)n >= size - *len) return -1;
+            *len += n;
+            continue;
+        }
+        if (*len + 1 >= size) return -1;
+        out[(*len)++] = *p++;
+    }
+    out[*len] = '\0';
+    return 0;
+}
+
+// Split "INSERT [OR x] INTO t [(cols)] VALUES (tuple) [;]" into the text up
+// to and including VALUES and the tuple; -1 for anything else
+static int split_insert(const char *sql, size_t *prefix_len, const char **tuple,
+                        const char **tuple_end) {
+    const char *p = skip_space(sql);
+    if (keyword(&p, "REPLACE")) {
+        // REPLACE INTO is INSERT OR REPLACE INTO
+    } else if (keyword(&p, "INSERT")) {
+        if (keyword(&p, "OR")) {
+            while (isalpha((unsigned char)*p)) p++;
+            p = skip_space(p);
+        }
+    } else {
+        return -1;
+    }
+    if (!keyword(&p, "INTO")) return -1;
+
+    // Table name, possibly schema-qualified or quoted
+    while (*p && !isspace((unsigned char)*p) && *p != '(') {
+        if (*p == '"' || *p == '`' || *p == '[') {
+            if (!(p = skip_quoted(p))) return -1;
+        } else {
+            p++;
+        }
+    }
+    p = skip_space(p);
+    if (*p == '(') {
+        if (!(p = skip_group(p))) return -1;
+        p = skip_space(p);
+    }
+    if (!keyword(&p, "VALUES")) return -1;
+    *prefix_len = p - sql;
+
+    if (*p != '(') return -1;
+    *tuple = p;
+    if (!(*tuple_end = skip_group(p))) return -1;
+
+    // A single row and nothing after it: no upsert, RETURNING or second
+    // statement
+    p = skip_space(*tuple_end);
+    if (*p == ';') p = skip_space(p + 1);
+    return *p ? -1 : 0;
+}
+
+// Statement of a table's insert with `rows` copies of the tuple
+static sqlite3_stmt *prepare_batch(const char *sql, int rows, int width) {
+    static char text[COMBINE_MAX_SQL * 16];
+    size_t prefix_len;
+    const char *tuple, *tuple_end;
+    if (split_insert(sql, &prefix_len, &tuple, &tuple_end) != 0 || prefix_len >= sizeof(text)) {
+        return NULL;
+    }
+    memcpy(text, sql, prefix_len);
+    size_t len = prefix_len;
+    for (int row = 0; row < rows; row++) {
+        if (row > 0) {
+            if (len + 2 >= sizeof(text)) return NULL;
+            text[len++] = ',';
+        }
+        if (append_tuple(text, sizeof(text), &len, tuple, tuple_end, row, width) != 0) {
+            return NULL;
+        }
+    }
+
+    sqlite3_stmt *stmt = NULL;
+    if (sqlite3_prepare_v2(combine_db, text, (int)len, &stmt, NULL) != SQLITE_OK) {
+        sqlite3_finalize(stmt);
+        return NULL;
+    }
+    return stmt;
+}
+
+static void analyse(combine_slot_t *slot, forth_word_t *word, sqlite3_stmt *stmt) {
+    slot->generation = word->generation;
+    slot->kind = SLOT_OTHER;
+    slot->table_count = 0;
+
+    memset(&seen, 0, sizeof(seen));
+    const char *sql = sqlite3_sql(stmt);
+    sqlite3_stmt *probe = NULL;
+    sqlite3_set_authorizer(combine_db, authorizer, NULL);
+    int rc = sql ? sqlite3_prepare_v2(combine_db, sql, -1, &probe, NULL) : SQLITE_ERROR;
+    sqlite3_set_authorizer(combine_db, NULL, NULL);
+    sqlite3_finalize(probe);
+
+    if (rc != SQLITE_OK || seen.barrier) {
+        slot->kind = SLOT_BARRIER;
+        return;
+    }
+
+    size_t prefix_len;
+    const char *tuple, *tuple_end;
+    int width = sqlite3_bind_parameter_count(stmt);
+    if (seen.inserts == 1 && !seen.reads && !seen.writes_other && seen.count == 1 &&
+        width <= sqlite3_limit(combine_db, SQLITE_LIMIT_VARIABLE_NUMBER, -1) &&
+        strlen(sql) < COMBINE_MAX_SQL &&
+        split_insert(sql, &prefix_len, &tuple, &tuple_end) == 0) {
+        char check[COMBINE_MAX_SQL];
+        size_t len = 0;
+        int table = find_table(seen.names[0], 1);
+        if (table >= 0 && append_tuple(check, sizeof(check), &len, tuple, tuple_end, 0, width) == 0) {
+            slot->kind = SLOT_INSERT;
+            slot->table = table;
+            slot->width = width;
+            return;
+        }
+    }
+
+    // Every table gets a buffer, so that inserts combined later are
+    // flushed before this statement too
+    for (int i = 0; i < seen.count; i++) {
+        int table = find_table(seen.names[i], 1);
+        if (table < 0) {
+            slot->kind = SLOT_BARRIER;
+            return;
+        }
+        slot->tables[slot->table_count++] = table;
+    }
+}
+
+// Statement for `level`, prepared on first use; NULL if it cannot be
+// built, in which case smaller batches are used
+static sqlite3_stmt *batch_statement(combine_table_t *table, int level) {
+    if (!table->batches[level]) {
+        int rows = table->batch_rows >> level;
+        if (rows > 1) {
+            table->batches[level] = prepare_batch(table->sql, rows, table->width);
+        } else if (sqlite3_prepare_v2(combine_db, table->sql, -1, &table->batches[level], NULL) != SQLITE_OK) {
+            sqlite3_finalize(table->batches[level]);
+            table->batches[level] = NULL;
+        }
+    }
+    return table->batches[level];
+}
+
+static int flush_table(combine_table_t *table) {
+    if (table->rows == 0) return 0;
+
+    int own_transaction = sqlite3_get_autocommit(combine_db);
+    if (own_transaction) {
+        sqlite3_exec(combine_db, "BEGIN", NULL, NULL, NULL);
+    }
+
+    int status = 0;
+    int row = 0;
+    for (int level = 0; status == 0 && row < table->rows; level++) {
+        int count = table->batch_rows >> level;
+        if (table->rows - row < count) continue;
+        sqlite3_stmt *stmt = batch_statement(table, level);
+        if (!stmt) {
+            if (count > 1) continue;
+            fprintf(stderr, "Combined insert into %s failed: %s\n", table->name,
+                    sqlite3_errmsg(combine_db));
+            status = -1;
+            break;
+        }
+
+        for (; status == 0 && table->rows - row >= count; row += count) {
+            int *values = table->values + (size_t)row * table->width;
+            for (int i = 0; i < count * table->width; i++) {
+                sqlite3_bind_int(stmt, i + 1, values[i]);
+            }
+            if (sqlite3_step(stmt) != SQLITE_DONE) {
+                fprintf(stderr, "Combined insert into %s failed: %s\n", table->name,
+                        sqlite3_errmsg(combine_db));
+                status = -1;
+            }
+            sqlite3_reset(stmt);
+            statements_run++;
+        }
+    }
+
+    if (own_transaction) {
+        sqlite3_exec(combine_db, status == 0 ? "COMMIT" : "ROLLBACK", NULL, NULL, NULL);
+    }
+    table->rows = 0;
+    return status;
+}
+
+static void release_statements(combine_table_t *table) {
+    for (int level = 0; level < COMBINE_LEVELS; level++) {
+        sqlite3_finalize(table->batches[level]);
+        table->batches[level] = NULL;
+    }
+    free(table->sql);
+    table->sql = NULL;
+}
+
+// Point a table's buffer at a new insert word
+static int switch_word(combine_table_t *table, int word_idx,
+                       forth_word_t *word, sqlite3_stmt *stmt, int width) {
+    flush_table(table);
+    release_statements(table);
+    table->word_idx = -1;
+
+    if (!table->values || table->width < width) {
+        int *grown = realloc(table->values, (size_t)buffer_rows * (width ? width : 1) * sizeof(int));
+        if (!grown) return -1;
+        table->values = grown;
+    }
+    if (!(table->sql = strdup(sqlite3_sql(stmt)))) {
+        return -1;
+    }
+
+    // As many rows per statement as its parameters allow
+    int limit = sqlite3_limit(combine_db, SQLITE_LIMIT_VARIABLE_NUMBER, -1);
+    int rows = width ? limit / width : buffer_rows;
+    table->batch_rows = rows < buffer_rows ? rows : buffer_rows;
+    table->width = width;
+    table->word_idx = word_idx;
+    table->generation = word->generation;
+    return 0;
+}
+
+int combine_enable(forth_vm_t *vm, int rows) {
+    if (rows < 1 || rows > COMBINE_MAX_ROWS) {
+        fprintf(stderr, "Combined rows must be between 1 and %d\n", COMBINE_MAX_ROWS);
+        return -1;
+    }
+    combine_db = vm->db;
+    buffer_rows = rows;
+    memset(slots, 0, sizeof(slots));
+    table_count = 0;
+    combine_active = 1;
+    return 0;
+}
+
+void combine_disable(forth_vm_t *vm) {
+    if (!combine_active) return;
+    combine_flush_all(vm);
+    combine_active = 0;
+    for (int i = 0; i < table_count; i++) {
+        release_statements(&tables[i]);
+        free(tables[i].values);
+    }
+    table_count = 0;
+}
+
+int combine_flush_all(forth_vm_t *vm) {
+    (void)vm;
+    int status = 0;
+    for (int i = 0; i < table_count; i++) {
+        if (flush_table(&tables[i]) != 0) status = -1;
+    }
+    return status;
+}
+
+int combine_word(forth_vm_t *vm, int word_idx, forth_word_t *word, sqlite3_stmt *stmt) {
+    combine_slot_t *slot = &slots[word_idx];
+    if (slot->generation != word->generation) {
+        analyse(slot, word, stmt);
+    }
+
+    if (slot->kind == SLOT_BARRIER) {
+        combine_flush_all(vm);
+        return 0;
+    }
+    if (slot->kind == SLOT_OTHER) {
+        for (int i = 0; i < slot->table_count; i++) {
+            flush_table(&tables[slot->tables[i]]);
+        }
+        return 0;
+    }
+
+    combine_table_t *table = &tables[slot->table];
+    if (stack_depth(vm) < slot->width) {
+        return 0;  // Let the word report the underflow
+    }
+    if ((table->word_idx != word_idx || table->generation != word->generation) &&
+        switch_word(table, word_idx, word, stmt, slot->width) != 0) {
+        return 0;
+    }
+
+    vm->stack_ptr -= slot->width;
+    memcpy(table->values + (size_t)table->rows * slot->width,
+           vm->data_stack + vm->stack_ptr, slot->width * sizeof(int));
+    table->rows++;
+    rows_combined++;
+    if (table->rows == buffer_rows) {
+        flush_table(table);
+    }
+    return 1;
+}
+
+uint64_t combine_rows_count(void) {
+    return rows_combined;
+}
+
+uint64_t combine_statements_count(void) {
+    return statements_run;
+}
@@ -0,0 +1,47 @@
+#ifndef COMBINE_H
+#define COMBINE_H
+
+#include "forth.h"
+
+// Write combining for SQL insert words.
+//
+// An SQL word whose statement is a single-row `INSERT ... VALUES (...)`
+// with only positional parameters does not run when called: its arguments
+// are appended to a buffer for the target table. A buffer is written out
+// as multi-row INSERTs in one transaction when it is full, before any
+// statement that reads or writes its table runs, before transaction and
+// schema statements, and whenever the interpreter goes idle or exits, so
+// every statement sees the rows inserted before it. Only the interpreter's
+// own connection combines; insert errors surface when a buffer is flushed.
+
+#define COMBINE_DEFAULT_ROWS 256
+#define COMBINE_MAX_ROWS 65536
+
+// Distinct tables with buffers, and tables one statement may touch before
+// it simply flushes every buffer
+#define COMBINE_MAX_TABLES 64
+#define COMBINE_WORD_TABLES 8
+
+// Checked on every compiled and SQL word; zero unless enabled
+extern int combine_active;
+
+// Start combining inserts on vm's connection, up to `rows` rows per table
+int combine_enable(forth_vm_t *vm, int rows);
+
+// Flush every buffer and stop combining
+void combine_disable(forth_vm_t *vm);
+
+// Called before a compiled or SQL word runs on the interpreter's
+// connection. Buffers the row of a combinable insert and returns 1 (the
+// word is done); otherwise flushes the buffers the statement depends on
+// and returns 0.
+int combine_word(forth_vm_t *vm, int word_idx, forth_word_t *word, sqlite3_stmt *stmt);
+
+// Write out every buffer; -1 if an insert failed (its rows are dropped)
+int combine_flush_all(forth_vm_t *vm);
+
+// Rows buffered and statements that wrote them so far
+uint64_t combine_rows_count(void);
+uint64_t combine_statements_count(void);
+
+#endif
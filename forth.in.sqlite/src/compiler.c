@@ -1,4 +1,7 @@
 #include "compiler.h"
+#include "trace.h"
+#include "startup.h"
+#include "shard.h"
 
 // Initialize compiler
 int compiler_init(forth_compiler_t *compiler, forth_vm_t *vm) {
@@ -30,7 +33,7 @@ int compiler_start_word(forth_compiler_t *compiler, const char *word_name) {
     vdbe_cleanup_program(&compiler->current_program);
     vdbe_init_program(&compiler->current_program);
 
-    printf("Compiling word: %s\n", word_name);
+    fprintf(compiler->vm->out, "Compiling word: %s\n", word_name);
     return 0;
 }
 
@@ -44,14 +47,16 @@ int compiler_end_word(forth_compiler_t *compiler) {
         compiler_error(compiler, "Failed to compile word to SQLite");
         return -1;
     }
+    fprintf(compiler->vm->out, "Compiling SQL: %s\n", sqlite3_sql(stmt));
 
-    // Add word to dictionary
-    add_word(compiler->vm, compiler->current_word, WORD_COMPILED, stmt);
+    // Add word to dictionary, keeping its program for see and hot-spot counts
+    define_word(compiler->vm, compiler->current_word, WORD_COMPILED, stmt,
+                vdbe_copy_program(&compiler->current_program));
 
     // Save to database for persistence
     compiler_save_word(compiler, compiler->current_word, &compiler->current_program);
 
-    printf("Compiled word: %s\n", compiler->current_word);
+    fprintf(compiler->vm->out, "Compiled word: %s\n", compiler->current_word);
 
     // Reset compiler state
     compiler->state = COMPILER_INTERPRETING;
@@ -79,7 +84,7 @@ int compiler_compile_token(forth_compiler_t *compiler, const char *token) {
     // Check if it's an immediate word (handled during compilation)
     int word_idx = find_word(compiler->vm, token);
     if (word_idx >= 0) {
-        forth_word_t *word = &compiler->vm->dictionary[word_idx];
+        forth_word_t *word = forth_word(compiler->vm, word_idx);
         if (word->type == WORD_IMMEDIATE) {
             word->data.prim_func();
             return 0;
@@ -90,6 +95,57 @@ int compiler_compile_token(forth_compiler_t *compiler, const char *token) {
     return compiler_compile_word_call(compiler, token);
 }
 
+// Process one line of source: continue a definition, start a colon or
+// sql: definition, or execute it
+static int interpret_line(forth_compiler_t *compiler, char *line) {
+    if (compiler->state == COMPILER_COMPILING) {
+        if (compiler_compile_token(compiler, line) != 0) {
+            fprintf(stderr, "Compilation error\n");
+            return -1;
+        }
+        return 0;
+    }
+
+    // Definitions are prepared on, and saved through, the VM's connection
+    if (compiler->vm->snapshot && (strncmp(line, "sql: ", 5) == 0 || strncmp(line, ": ", 2) == 0)) {
+        compiler_error(compiler, "Cannot define words inside a snapshot");
+        return -1;
+    }
+
+    if (strncmp(line, "sql: ", 5) == 0) {
+        if (compiler_define_sql_word(compiler, line + 5) != 0) {
+            fprintf(stderr, "SQL word definition error\n");
+            return -1;
+        }
+    } else if (strncmp(line, ": ", 2) == 0) {
+        char *word_start = line + 2;
+        char *word_end = strtok(word_start, " ");
+        if (word_end) {
+            compiler_start_word(compiler, word_end);
+        }
+    } else if (forth_execute(compiler->vm, line) != 0) {
+        fprintf(stderr, "Execution error\n");
+        return -1;
+    }
+    return 0;
+}
+
+int compiler_interpret_line(forth_compiler_t *compiler, char *line) {
+    if (!compiler || !line) return -1;
+
+    // Lines that only define words, up to the one that executes the first
+    // token, are still startup
+    if (startup_active) {
+        uint64_t start = startup_now();
+        int result = interpret_line(compiler, line);
+        if (startup_active) {
+            startup_add(STARTUP_DEFINITIONS, startup_now() - start);
+        }
+        return result;
+    }
+    return interpret_line(compiler, line);
+}
+
 // Compile a literal
 int compiler_compile_literal(forth_compiler_t *compiler, int value) {
     return vdbe_emit_literal(&compiler->current_program, value);
@@ -116,7 +172,7 @@ int compiler_compile_word_call(forth_compiler_t *compiler, const char *word_name
     // Check if it's a primitive
     int word_idx = find_word(compiler->vm, word_name);
     if (word_idx >= 0) {
-        forth_word_t *word = &compiler->vm->dictionary[word_idx];
+        forth_word_t *word = forth_word(compiler->vm, word_idx);
         if (word->type == WORD_PRIMITIVE) {
             return compiler_compile_primitive(compiler, word_name);
         }
@@ -130,6 +186,56 @@ int compiler_compile_word_call(forth_compiler_t *compiler, const char *word_name
     return 0;
 }
 
+// Define an SQL-backed word from "name <statement>"
+int compiler_define_sql_word(forth_compiler_t *compiler, const char *definition) {
+    if (!compiler || !definition) return -1;
+
+    while (*definition == ' ' || *definition == '\t') definition++;
+    size_t name_len = strcspn(definition, " \t");
+    if (name_len == 0 || name_len >= MAX_WORD_LEN) {
+        compiler_error(compiler, "Invalid SQL word name");
+        return -1;
+    }
+
+    char name[MAX_WORD_LEN];
+    memcpy(name, definition, name_len);
+    name[name_len] = '\0';
+
+    const char *sql = definition + name_len;
+    while (*sql == ' ' || *sql == '\t') sql++;
+
+    sqlite3_stmt *stmt;
+    const char *tail = NULL;
+    if (trace_active) trace_begin(TRACE_SQL, "prepare");
+    int rc = sqlite3_prepare_v2(compiler->vm->db, sql, -1, &stmt, &tail);
+    if (trace_active) trace_end(TRACE_SQL, "prepare");
+    if (rc != SQLITE_OK) {
+        fprintf(stderr, "SQL compilation error: %s\n", sqlite3_errmsg(compiler->vm->db));
+        return -1;
+    }
+    if (!stmt) {
+        compiler_error(compiler, "SQL word has no statement");
+        return -1;
+    }
+
+    // A word runs one statement; anything but comments after it is refused
+    // rather than dropped
+    sqlite3_stmt *rest = NULL;
+    if (tail && *tail &&
+        (sqlite3_prepare_v2(compiler->vm->db, tail, -1, &rest, NULL) != SQLITE_OK || rest)) {
+        sqlite3_finalize(rest);
+        sqlite3_finalize(stmt);
+        compiler_error(compiler, "SQL word must be a single statement");
+        return -1;
+    }
+
+    add_word(compiler->vm, name, WORD_SQL, stmt);
+    compiler_save_sql_word(compiler, name, sql);
+
+    fprintf(compiler->vm->out, "Defined SQL word: %s\n", name);
+    return 0;
+}
+
 // Save compiled word to database
 int compiler_save_word(forth_compiler_t *compiler, const char *name, vdbe_program_t *program) {
     if (!compiler || !name || !program) return -1;
@@ -156,6 +262,9 @@ int compiler_save_word(forth_compiler_t *compiler, const char *name, vdbe_progra
     sqlite3_finalize(stmt);
     free(program_blob);
 
+    if (result == SQLITE_DONE && shard_active) {
+        shard_replicate("forth_words", name);
+    }
     return (result == SQLITE_DONE) ? 0 : -1;
 }
 
@@ -163,15 +272,27 @@ int compiler_save_word(forth_compiler_t *compiler, const char *name, vdbe_progra
 int compiler_load_word(forth_compiler_t *compiler, const char *name) {
     if (!compiler || !name) return -1;
 
+    uint64_t select_start = 0;
+    if (startup_active) {
+        startup_word_begin(name);
+        select_start = startup_now();
+    }
+
     sqlite3_stmt *stmt;
     const char *sql = "SELECT bytecode FROM forth_words WHERE name = ?";
     if (sqlite3_prepare_v2(compiler->vm->db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+        if (startup_active) startup_word_end();
         return -1;
     }
 
     sqlite3_bind_text(stmt, 1, name, -1, SQLITE_STATIC);
 
-    if (sqlite3_step(stmt) == SQLITE_ROW) {
+    int rc = sqlite3_step(stmt);
+    if (startup_active) {
+        startup_add(STARTUP_WORD_SELECT, startup_now() - select_start);
+    }
+
+    if (rc == SQLITE_ROW) {
         const void *blob = sqlite3_column_blob(stmt, 0);
         int blob_size = sqlite3_column_bytes(stmt, 0);
 
@@ -191,7 +312,8 @@ int compiler_load_word(forth_compiler_t *compiler, const char *name) {
             // Compile to SQLite statement
             sqlite3_stmt *compiled_stmt;
             if (vdbe_compile_to_sqlite(&program, compiler->vm->db, &compiled_stmt) == 0) {
-                add_word(compiler->vm, name, WORD_COMPILED, compiled_stmt);
+                define_word(compiler->vm, name, WORD_COMPILED, compiled_stmt,
+                            vdbe_copy_program(&program));
                 printf("Loaded word: %s\n", name);
             }
 
@@ -200,6 +322,7 @@ int compiler_load_word(forth_compiler_t *compiler, const char *name) {
     }
 
     sqlite3_finalize(stmt);
+    if (startup_active) startup_word_end();
     return 0;
 }
 
@@ -221,7 +344,117 @@ int compiler_load_all_words(forth_compiler_t *compiler) {
     }
 
     sqlite3_finalize(stmt);
+
+    uint64_t sql_words_start = startup_active ? startup_now() : 0;
+    int result = compiler_load_sql_words(compiler);
+    if (startup_active) {
+        startup_add(STARTUP_SQL_WORDS, startup_now() - sql_words_start);
+    }
+    return result;
+}
+
+// Save an SQL word's source to the database
+int compiler_save_sql_word(forth_compiler_t *compiler, const char *name, const char *sql) {
+    if (!compiler || !name || !sql) return -1;
+
+    sqlite3_stmt *stmt;
+    const char *insert_sql = "INSERT OR REPLACE INTO forth_sql_words (name, sql) VALUES (?, ?)";
+    if (sqlite3_prepare_v2(compiler->vm->db, insert_sql, -1, &stmt, NULL) != SQLITE_OK) {
+        return -1;
+    }
+
+    sqlite3_bind_text(stmt, 1, name, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 2, sql, -1, SQLITE_STATIC);
+
+    int result = sqlite3_step(stmt);
+    sqlite3_finalize(stmt);
+
+    if (result == SQLITE_DONE && shard_active) {
+        shard_replicate("forth_sql_words", name);
+    }
+    return (result == SQLITE_DONE) ? 0 : -1;
+}
+
+// Load and prepare all saved SQL words
+int compiler_load_sql_words(forth_compiler_t *compiler) {
+    if (!compiler) return -1;
+
+    sqlite3_stmt *stmt;
+    const char *sql = "SELECT name, sql FROM forth_sql_words";
+    if (sqlite3_prepare_v2(compiler->vm->db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+        return -1;
+    }
+
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        const char *name = (const char*)sqlite3_column_text(stmt, 0);
+        const char *word_sql = (const char*)sqlite3_column_text(stmt, 1);
+        if (!name || !word_sql) continue;
+
+        sqlite3_stmt *word_stmt;
+        if (trace_active) trace_begin(TRACE_SQL, "prepare");
+        int rc = sqlite3_prepare_v2(compiler->vm->db, word_sql, -1, &word_stmt, NULL);
+        if (trace_active) trace_end(TRACE_SQL, "prepare");
+        if (rc == SQLITE_OK && word_stmt) {
+            add_word(compiler->vm, name, WORD_SQL, word_stmt);
+            printf("Loaded SQL word: %s\n", name);
+        } else {
+            fprintf(stderr, "Failed to load SQL word %s: %s\n", name,
+                    word_stmt ? sqlite3_errmsg(compiler->vm->db) : "no statement");
+        }
+    }
+
+    sqlite3_finalize(stmt);
+    return 0;
+}
+
+// Print a compiled word's program, with execution counts when built in
+int compiler_see_word(forth_compiler_t *compiler, const char *name, FILE *out) {
+    if (!compiler || !name) return -1;
+
+    int word_idx = find_word(compiler->vm, name);
+    if (word_idx < 0) {
+        fprintf(out, "Unknown word: %s\n", name);
+        return -1;
+    }
+
+    forth_word_t *word = forth_word(compiler->vm, word_idx);
+    if (word->type == WORD_SQL) {
+        fprintf(out, "sql: %s %s\n", word->name, sqlite3_sql(word->data.compiled));
+        return 0;
+    }
+    if (!word->program) {
+        fprintf(out, "%s is a primitive\n", word->name);
+        return 0;
+    }
+
+#ifdef FORTH_INSN_COUNTERS
+    fprintf(out, ": %s  ( %d instructions, run %llu times )\n", word->name,
+            word->program->instruction_count,
+            (unsigned long long)__atomic_load_n(&word->program->exec_count, __ATOMIC_RELAXED));
+#else
+    fprintf(out, ": %s  ( %d instructions )\n", word->name, word->program->instruction_count);
+#endif
+    vdbe_dump_program(word->program, out);
+    return 0;
+}
+
+// Merge per-word execution counts into forth_exec_counts
+int compiler_save_insn_counts(forth_compiler_t *compiler) {
+#ifdef FORTH_INSN_COUNTERS
+    if (!compiler) return -1;
+
+    forth_vm_t *vm = compiler->vm;
+    sqlite3_exec(vm->db, "BEGIN", NULL, NULL, NULL);
+    for (int i = 0; i < dict_size(vm); i++) {
+        if (forth_word(vm, i)->program) {
+            vdbe_save_counts(forth_word(vm, i)->program, vm->db, forth_word(vm, i)->name);
+        }
+    }
+    return sqlite3_exec(vm->db, "COMMIT", NULL, NULL, NULL) == SQLITE_OK ? 0 : -1;
+#else
+    (void)compiler;
     return 0;
+#endif
 }
 
 // Error handling
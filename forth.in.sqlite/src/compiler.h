@@ -26,6 +26,7 @@ void compiler_cleanup(forth_compiler_t *compiler);
 int compiler_start_word(forth_compiler_t *compiler, const char *word_name);
 int compiler_end_word(forth_compiler_t *compiler);
 int compiler_compile_token(forth_compiler_t *compiler, const char *token);
+int compiler_interpret_line(forth_compiler_t *compiler, char *line);
 
 // Word compilation
 int compiler_compile_literal(forth_compiler_t *compiler, int value);
@@ -37,10 +38,19 @@ int compiler_handle_colon(forth_compiler_t *compiler, const char *word_name);
 int compiler_handle_semicolon(forth_compiler_t *compiler);
 int compiler_handle_immediate(forth_compiler_t *compiler, const char *word_name);
 
+// SQL-backed words: "sql: name <statement>"
+int compiler_define_sql_word(forth_compiler_t *compiler, const char *definition);
+
 // Database persistence
 int compiler_save_word(forth_compiler_t *compiler, const char *name, vdbe_program_t *program);
 int compiler_load_word(forth_compiler_t *compiler, const char *name);
 int compiler_load_all_words(forth_compiler_t *compiler);
+int compiler_save_sql_word(forth_compiler_t *compiler, const char *name, const char *sql);
+int compiler_load_sql_words(forth_compiler_t *compiler);
+
+// Program inspection and hot-spot counters
+int compiler_see_word(forth_compiler_t *compiler, const char *name, FILE *out);
+int compiler_save_insn_counts(forth_compiler_t *compiler);
 
 // Error handling
 void compiler_error(forth_compiler_t *compiler, const char *msg);
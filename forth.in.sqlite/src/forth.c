@@ -1,30 +1,89 @@
 #include "forth.h"
-
-// Global VM pointer for primitive functions
-static forth_vm_t *g_vm = NULL;
+#include "vdbe.h"
+#include "profile.h"
+#include "stats.h"
+#include "perfctr.h"
+#include "trace.h"
+#include "startup.h"
+#include "task.h"
+#include "chan.h"
+#include "rcu.h"
+#include "budget.h"
+#include "async.h"
+#include "combine.h"
+#include "group.h"
+#include "memdb.h"
+#include "vfs.h"
+#include "snapshot.h"
+#include "shard.h"
+#include "queue.h"
+
+// VM that primitive functions act on, per thread
+static __thread forth_vm_t *g_vm = NULL;
+
+// Set on the thread that initialized the VM. The profiler, the hardware
+// counters and the statement statistics keep unsynchronized state (and
+// the counters a group opened on this thread), so their hooks only run
+// here and not on pool workers.
+static __thread int hook_thread = 0;
+
+static uint64_t next_generation = 0;
 
 // VM initialization
 int forth_init(forth_vm_t *vm, const char *db_path) {
     memset(vm, 0, sizeof(forth_vm_t));
     g_vm = vm;
+    hook_thread = 1;
+
+    vm->dict = calloc(1, sizeof(forth_dict_t));
+    if (!vm->dict) {
+        forth_error("Failed to allocate dictionary");
+        return -1;
+    }
+    pthread_mutex_init(&vm->dict->lock, NULL);
+    rcu_register_thread();
+    vm->owner = 1;
+    vm->out = stdout;
+
+    // Every connection opened from here on, pool and I/O threads' included,
+    // goes through the shim
+    if (vfs_mode != VFS_DEFAULT && vfs_register() != 0) {
+        fprintf(stderr, "Using the default VFS\n");
+        vfs_mode = VFS_DEFAULT;
+    }
 
-    // Open SQLite database
-    if (sqlite3_open(db_path, &vm->db) != SQLITE_OK) {
+    // Open SQLite database, or load it into memory
+    uint64_t phase_start = startup_active ? startup_now() : 0;
+    int rc = memdb_active ? (memdb_open(db_path, &vm->db) == 0 ? SQLITE_OK : SQLITE_ERROR)
+                          : sqlite3_open(db_path, &vm->db);
+    if (rc != SQLITE_OK) {
         forth_error("Failed to open database");
         return -1;
     }
+    if (startup_active) {
+        uint64_t now = startup_now();
+        startup_add(STARTUP_DB_OPEN, now - phase_start);
+        phase_start = now;
+    }
 
     // Create tables for storing compiled words
-    const char *create_words_table =
-        "CREATE TABLE IF NOT EXISTS forth_words ("
-        "name TEXT PRIMARY KEY,"
-        "bytecode BLOB);";
-
-    if (sqlite3_exec(vm->db, create_words_table, NULL, NULL, NULL) != SQLITE_OK) {
+    if (sqlite3_exec(vm->db, FORTH_WORDS_TABLE_SQL, NULL, NULL, NULL) != SQLITE_OK) {
         forth_error("Failed to create words table");
         return -1;
     }
 
+    // SQL-backed words are stored as their source text
+    if (sqlite3_exec(vm->db, FORTH_SQL_WORDS_TABLE_SQL, NULL, NULL, NULL) != SQLITE_OK) {
+        forth_error("Failed to create SQL words table");
+        return -1;
+    }
+
+    if (startup_active) {
+        uint64_t now = startup_now();
+        startup_add(STARTUP_TABLES, now - phase_start);
+        phase_start = now;
+    }
+
     // Initialize stack
     vm->stack_ptr = 0;
 
@@ -40,13 +99,78 @@ int forth_init(forth_vm_t *vm, const char *db_path) {
     add_word(vm, ".", WORD_PRIMITIVE, prim_dot);
     add_word(vm, "emit", WORD_PRIMITIVE, prim_emit);
     add_word(vm, ".s", WORD_PRIMITIVE, prim_stack_show);
+    add_word(vm, "stats", WORD_PRIMITIVE, prim_stats);
+    add_word(vm, "spawn{", WORD_PRIMITIVE, prim_spawn);
+    add_word(vm, "respawn", WORD_PRIMITIVE, prim_respawn);
+    add_word(vm, "pause", WORD_PRIMITIVE, prim_pause);
+    add_word(vm, "ms", WORD_PRIMITIVE, prim_ms);
+    add_word(vm, "run-tasks", WORD_PRIMITIVE, prim_run_tasks);
+    add_word(vm, "join", WORD_PRIMITIVE, prim_join);
+    add_word(vm, "chan-new", WORD_PRIMITIVE, prim_chan_new);
+    add_word(vm, "chan-new-spsc", WORD_PRIMITIVE, prim_chan_new_spsc);
+    add_word(vm, "chan-send", WORD_PRIMITIVE, prim_chan_send);
+    add_word(vm, "chan-recv", WORD_PRIMITIVE, prim_chan_recv);
+    add_word(vm, "chan-try-recv", WORD_PRIMITIVE, prim_chan_try_recv);
+    add_word(vm, "'", WORD_PRIMITIVE, prim_tick);
+    add_word(vm, "async-exec", WORD_PRIMITIVE, prim_async_exec);
+    add_word(vm, "await", WORD_PRIMITIVE, prim_await);
+    add_word(vm, "snapshot-begin", WORD_PRIMITIVE, prim_snapshot_begin);
+    add_word(vm, "snapshot-end", WORD_PRIMITIVE, prim_snapshot_end);
+    add_word(vm, "shard-for", WORD_PRIMITIVE, prim_shard_for);
+    add_word(vm, "shard-count", WORD_PRIMITIVE, prim_shard_count);
+    add_word(vm, "shard-exec", WORD_PRIMITIVE, prim_shard_exec);
+    add_word(vm, "shard-all", WORD_PRIMITIVE, prim_shard_all);
+    add_word(vm, "shard-sum", WORD_PRIMITIVE, prim_shard_sum);
+    add_word(vm, "queue-init", WORD_PRIMITIVE, prim_queue_init);
+    add_word(vm, "dequeue-batch", WORD_PRIMITIVE, prim_dequeue_batch);
+    add_word(vm, "ack-batch", WORD_PRIMITIVE, prim_ack_batch);
+
+    if (startup_active) {
+        startup_add(STARTUP_PRIMITIVES, startup_now() - phase_start);
+    }
+
+    return 0;
+}
+
+static void free_word(void *obj) {
+    forth_word_t *word = obj;
+    if (word->type == WORD_COMPILED || word->type == WORD_SQL) {
+        sqlite3_finalize(word->data.compiled);
+    }
+    vdbe_free_program(word->program);
+    free(word);
+}
 
+// Set up a VM with its own stacks and output on top of the dictionary and
+// database of an initialized VM
+int forth_attach(forth_vm_t *vm, forth_vm_t *parent, FILE *out) {
+    memset(vm, 0, sizeof(forth_vm_t));
+    vm->dict = parent->dict;
+    vm->db = parent->db;
+    vm->owner = 0;
+    vm->out = out;
     return 0;
 }
 
 void forth_cleanup(forth_vm_t *vm) {
-    if (vm->db) {
-        sqlite3_close(vm->db);
+    snapshot_end(vm);
+    free(vm->fanout);  // Its futures are freed by async_stop
+    vm->fanout = NULL;
+    if (vm->owner) {
+        if (vm->dict) {
+            rcu_reclaim_all();
+            for (int i = 0; i < vm->dict->size; i++) {
+                free_word(vm->dict->words[i]);
+            }
+            pthread_mutex_destroy(&vm->dict->lock);
+            free(vm->dict);
+        }
+        if (vm->db) {
+            sqlite3_close(vm->db);
+        }
+    }
+    if (g_vm == vm) {
+        g_vm = NULL;
     }
     memset(vm, 0, sizeof(forth_vm_t));
 }
@@ -73,32 +197,87 @@ int stack_depth(forth_vm_t *vm) {
 }
 
 // Dictionary operations
+
+// FNV-1a, reduced to an index bucket
+static unsigned name_bucket(const char *name) {
+    uint32_t hash = 2166136261u;
+    for (; *name; name++) {
+        hash = (hash ^ (unsigned char)*name) * 16777619u;
+    }
+    return hash & (DICT_INDEX_SIZE - 1);
+}
+
 int find_word(forth_vm_t *vm, const char *name) {
-    for (int i = vm->dict_size - 1; i >= 0; i--) {
-        if (strcmp(vm->dictionary[i].name, name) == 0) {
-            return i;
+    forth_dict_t *dict = vm->dict;
+    for (unsigned b = name_bucket(name);; b = (b + 1) & (DICT_INDEX_SIZE - 1)) {
+        int slot = __atomic_load_n(&dict->index[b], __ATOMIC_ACQUIRE);
+        if (slot == 0) {
+            return -1;
+        }
+        if (strcmp(forth_word(vm, slot - 1)->name, name) == 0) {
+            return slot - 1;
         }
     }
-    return -1;
+}
+
+int dict_size(forth_vm_t *vm) {
+    return __atomic_load_n(&vm->dict->size, __ATOMIC_ACQUIRE);
 }
 
 int add_word(forth_vm_t *vm, const char *name, word_type_t type, void *data) {
-    if (vm->dict_size >= MAX_DICT_SIZE) {
-        forth_error("Dictionary full");
+    return define_word(vm, name, type, data, NULL);
+}
+
+// Publish a definition, taking ownership of its statement and program.
+// A definition replaced in its slot is freed once no thread can be
+// executing it any more.
+int define_word(forth_vm_t *vm, const char *name, word_type_t type, void *data,
+                struct vdbe_program *program) {
+    forth_word_t *word = calloc(1, sizeof(forth_word_t));
+    if (!word) {
+        forth_error("Failed to allocate word");
         return -1;
     }
-
-    strncpy(vm->dictionary[vm->dict_size].name, name, MAX_WORD_LEN - 1);
-    vm->dictionary[vm->dict_size].name[MAX_WORD_LEN - 1] = '\0';
-    vm->dictionary[vm->dict_size].type = type;
-
-    if (type == WORD_PRIMITIVE) {
-        vm->dictionary[vm->dict_size].data.prim_func = data;
+    strncpy(word->name, name, MAX_WORD_LEN - 1);
+    word->type = type;
+    word->program = program;
+    word->generation = __atomic_add_fetch(&next_generation, 1, __ATOMIC_RELAXED);
+    if (type == WORD_PRIMITIVE || type == WORD_IMMEDIATE) {
+        word->data.prim_func = data;
     } else {
-        vm->dictionary[vm->dict_size].data.compiled = (sqlite3_stmt*)data;
+        word->data.compiled = (sqlite3_stmt*)data;
     }
 
-    return vm->dict_size++;
+    forth_dict_t *dict = vm->dict;
+    pthread_mutex_lock(&dict->lock);
+    forth_word_t *old = NULL;
+    int word_idx = find_word(vm, word->name);
+    if (word_idx >= 0) {
+        old = dict->words[word_idx];
+        __atomic_store_n(&dict->words[word_idx], word, __ATOMIC_RELEASE);
+    } else if (dict->size < MAX_DICT_SIZE) {
+        word_idx = dict->size;
+        __atomic_store_n(&dict->words[word_idx], word, __ATOMIC_RELEASE);
+        __atomic_store_n(&dict->size, word_idx + 1, __ATOMIC_RELEASE);
+
+        unsigned b = name_bucket(word->name);
+        while (dict->index[b] != 0) {
+            b = (b + 1) & (DICT_INDEX_SIZE - 1);
+        }
+        __atomic_store_n(&dict->index[b], word_idx + 1, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&dict->lock);
+
+    if (word_idx < 0) {
+        forth_error("Dictionary full");
+        free_word(word);
+        return -1;
+    }
+    if (old) {
+        rcu_retire(old, free_word);
+        rcu_reclaim();
+    }
+    return word_idx;
 }
 
 // Primitive word implementations
@@ -193,7 +372,7 @@ void prim_dot(void) {
         return;
     }
     int value = pop(g_vm);
-    printf("%d ", value);
+    fprintf(g_vm->out, "%d ", value);
 }
 
 void prim_emit(void) {
@@ -202,16 +381,36 @@ void prim_emit(void) {
         return;
     }
     int value = pop(g_vm);
-    putchar(value);
+    fputc(value, g_vm->out);
 }
 
 void prim_stack_show(void) {
-    printf("<%d> ", stack_depth(g_vm));
+    fprintf(g_vm->out, "<%d> ", stack_depth(g_vm));
     for (int i = g_vm->stack_ptr - 1; i >= 0; i--) {
-        printf("%d ", g_vm->data_stack[i]);
+        fprintf(g_vm->out, "%d ", g_vm->data_stack[i]);
     }
 }
 
+void prim_stats(void) {
+    stats_report(g_vm, g_vm->out);
+}
+
+// ' name ( -- word ): push the dictionary index of the next word
+void prim_tick(void) {
+    forth_vm_t *vm = forth_current();
+    char *name = forth_next_token(vm);
+    if (!name) {
+        forth_error("' needs a word name");
+        return;
+    }
+    int word_idx = find_word(vm, name);
+    if (word_idx < 0) {
+        fprintf(stderr, "Unknown word: %s\n", name);
+        return;
+    }
+    push(vm, word_idx);
+}
+
 // SQLite VDBE operations
 int vdbe_emit_integer(forth_vm_t *vm, int value) {
     if (!vm->current_stmt) {
@@ -258,6 +457,170 @@ int vdbe_finalize_statement(forth_vm_t *vm, sqlite3_stmt **stmt) {
 }
 
 // Parser and execution
+
+// Run an SQL word: parameters are popped so that ?1 is the deepest
+// argument, numeric result columns are pushed and text columns printed
+static void execute_sql_word(forth_vm_t *vm, sqlite3_stmt *stmt) {
+    int param_count = sqlite3_bind_parameter_count(stmt);
+    if (stack_depth(vm) < param_count) {
+        forth_error("Stack underflow in SQL word");
+        return;
+    }
+    for (int i = param_count; i >= 1; i--) {
+        sqlite3_bind_int(stmt, i, pop(vm));
+    }
+
+    if (trace_active) trace_begin(TRACE_SQL, "step");
+    int rc;
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        int column_count = sqlite3_column_count(stmt);
+        for (int i = 0; i < column_count; i++) {
+            switch (sqlite3_column_type(stmt, i)) {
+                case SQLITE_INTEGER:
+                case SQLITE_FLOAT:
+                    push(vm, sqlite3_column_int(stmt, i));
+                    break;
+                case SQLITE_TEXT:
+                    fprintf(vm->out, "%s ", (const char*)sqlite3_column_text(stmt, i));
+                    break;
+                default:
+                    break;
+            }
+        }
+    }
+    if (trace_active) trace_end(TRACE_SQL, "step");
+    if (rc != SQLITE_DONE && !vm->budget_exhausted) {
+        fprintf(stderr, "SQL word error: %s\n", sqlite3_errmsg(vm->db));
+    }
+
+    if (trace_active) trace_begin(TRACE_SQL, "reset");
+    sqlite3_reset(stmt);
+    sqlite3_clear_bindings(stmt);
+    if (trace_active) trace_end(TRACE_SQL, "reset");
+}
+
+// Statement of a compiled or SQL word on vm's connection. VMs on their own
+// connection prepare the dictionary statement's SQL there on first use,
+// and again once the word has been redefined.
+static sqlite3_stmt *word_statement(forth_vm_t *vm, int word_idx, forth_word_t *word) {
+    if (!vm->stmts) {
+        return word->data.compiled;
+    }
+
+    forth_stmt_cache_t *entry = &vm->stmts[word_idx];
+    if (entry->stmt && entry->generation == word->generation) {
+        return entry->stmt;
+    }
+
+    sqlite3_finalize(entry->stmt);
+    entry->stmt = NULL;
+    if (trace_active) trace_begin(TRACE_SQL, "prepare");
+    int rc = sqlite3_prepare_v2(vm->db, sqlite3_sql(word->data.compiled), -1, &entry->stmt, NULL);
+    if (trace_active) trace_end(TRACE_SQL, "prepare");
+    if (rc != SQLITE_OK) {
+        fprintf(stderr, "Failed to prepare %s: %s\n", word->name, sqlite3_errmsg(vm->db));
+        sqlite3_finalize(entry->stmt);
+        entry->stmt = NULL;
+        return NULL;
+    }
+    entry->generation = word->generation;
+    return entry->stmt;
+}
+
+void forth_execute_word(forth_vm_t *vm, int word_idx) {
+    if (budget_active && budget_charge(vm)) {
+        return;
+    }
+
+    forth_word_t *word = forth_word(vm, word_idx);
+    sqlite3_stmt *stmt = NULL;
+
+    int depth = vm->rstack_depth;
+    if (depth < RETURN_STACK_SIZE) {
+        vm->return_stack[depth] = word_idx;
+    }
+    vm->rstack_depth = depth + 1;
+
+    int hooked = hook_thread;
+    if (profile_active && hooked) {
+        profile_enter(word_idx, depth == 0);
+    }
+    if (perfctr_active && hooked) {
+        perfctr_enter(word_idx);
+    }
+    if (trace_active) {
+        trace_begin(TRACE_WORD, word->name);
+    }
+
+    if (word->type == WORD_PRIMITIVE) {
+        word->data.prim_func();
+    } else if (word->type == WORD_COMPILED && (stmt = word_statement(vm, word_idx, word))) {
+        // Execute compiled SQLite statement
+        if (combine_active && !vm->stmts) {
+            combine_word(vm, word_idx, word, stmt);
+        }
+#ifdef FORTH_INSN_COUNTERS
+        if (word->program) {
+            vdbe_count_execution(word->program);
+        }
+#endif
+        if (trace_active) trace_begin(TRACE_SQL, "step");
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            const char *result = (const char*)sqlite3_column_text(stmt, 0);
+            if (result) {
+                fprintf(vm->out, "%s ", result);
+            }
+        }
+        if (trace_active) trace_end(TRACE_SQL, "step");
+        if (trace_active) trace_begin(TRACE_SQL, "reset");
+        sqlite3_reset(stmt);
+        if (trace_active) trace_end(TRACE_SQL, "reset");
+    } else if (word->type == WORD_SQL && (stmt = word_statement(vm, word_idx, word))) {
+        // Inserts on the interpreter's connection may be buffered, and
+        // writes by tasks committed in groups, instead
+        if ((!combine_active || vm->stmts || !combine_word(vm, word_idx, word, stmt)) &&
+            (!group_active || !vm->task || !group_word(vm, word_idx, word, stmt))) {
+            execute_sql_word(vm, stmt);
+        }
+    }
+
+    if (stats_active && stmt && hooked) {
+        stats_record(vm, word_idx, stmt);
+    }
+
+    if (trace_active) {
+        trace_end(TRACE_WORD, word->name);
+    }
+    if (perfctr_active && hooked) {
+        perfctr_exit(word_idx);
+    }
+    if (profile_active && hooked) {
+        profile_exit(word_idx);
+    }
+
+    vm->rstack_depth = depth;
+}
+
+forth_vm_t *forth_current(void) {
+    return g_vm;
+}
+
+void forth_set_current(forth_vm_t *vm) {
+    g_vm = vm;
+}
+
+// Execute a word by dictionary index on behalf of vm; -1 if there is none
+int forth_call(forth_vm_t *vm, int word_idx) {
+    if (word_idx < 0 || word_idx >= dict_size(vm)) {
+        return -1;
+    }
+    g_vm = vm;
+    if (budget_active) budget_begin(vm);
+    forth_execute_word(vm, word_idx);
+    if (budget_active) budget_end(vm);
+    return vm->budget_exhausted ? -1 : 0;
+}
+
 int parse_token(forth_vm_t *vm, const char *token) {
     // Check if it's a number
     char *endptr;
@@ -271,21 +634,7 @@ int parse_token(forth_vm_t *vm, const char *token) {
     // Check if it's a word in the dictionary
     int word_idx = find_word(vm, token);
     if (word_idx >= 0) {
-        forth_word_t *word = &vm->dictionary[word_idx];
-
-        if (word->type == WORD_PRIMITIVE) {
-            word->data.prim_func();
-        } else if (word->type == WORD_COMPILED) {
-            // Execute compiled SQLite statement
-            sqlite3_stmt *stmt = word->data.compiled;
-            while (sqlite3_step(stmt) == SQLITE_ROW) {
-                const char *result = (const char*)sqlite3_column_text(stmt, 0);
-                if (result) {
-                    printf("%s ", result);
-                }
-            }
-            sqlite3_reset(stmt);
-        }
+        forth_execute_word(vm, word_idx);
         return 0;
     }
 
@@ -293,20 +642,56 @@ int parse_token(forth_vm_t *vm, const char *token) {
     return -1;
 }
 
+// Next whitespace-delimited token of the line being interpreted, or NULL
+char *forth_next_token(forth_vm_t *vm) {
+    char *p = vm->parse_next;
+    if (!p) return NULL;
+
+    while (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r') p++;
+    if (*p == '\0') {
+        vm->parse_next = NULL;
+        return NULL;
+    }
+
+    char *token = p;
+    while (*p && *p != ' ' && *p != '\t' && *p != '\n' && *p != '\r') p++;
+    if (*p) *p++ = '\0';
+    vm->parse_next = p;
+    return token;
+}
+
 int forth_execute(forth_vm_t *vm, const char *input) {
     char input_copy[MAX_INPUT_LEN];
     strncpy(input_copy, input, MAX_INPUT_LEN - 1);
     input_copy[MAX_INPUT_LEN - 1] = '\0';
 
-    char *token = strtok(input_copy, " \t\n\r");
+    // Primitives act on the VM running the current line
+    g_vm = vm;
+    vm->parse_next = input_copy;
+    if (budget_active) budget_begin(vm);
+
+    int result = 0;
+    char *token = forth_next_token(vm);
+    if (token && startup_active) {
+        uint64_t start = startup_now();
+        result = parse_token(vm, token);
+        startup_first_token(startup_now() - start);
+        token = result == 0 ? forth_next_token(vm) : NULL;
+    }
     while (token) {
-        if (parse_token(vm, token) != 0) {
-            return -1;
+        if (parse_token(vm, token) != 0 || vm->budget_exhausted) {
+            result = -1;
+            break;
         }
-        token = strtok(NULL, " \t\n\r");
+        token = forth_next_token(vm);
     }
 
-    return 0;
+    if (budget_active) {
+        budget_end(vm);
+        if (vm->budget_exhausted) result = -1;
+    }
+    vm->parse_next = NULL;
+    return result;
 }
 
 int forth_compile_word(forth_vm_t *vm, const char *name) {
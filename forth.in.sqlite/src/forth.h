@@ -6,42 +6,131 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
+#include <pthread.h>
 
 // Maximum sizes
 #define MAX_WORD_LEN 64
 #define MAX_INPUT_LEN 1024
-#define MAX_DICT_SIZE 1024
+#define MAX_DICT_SIZE 131072
 #define STACK_SIZE 256
+#define RETURN_STACK_SIZE 64
 
 // Word types
 typedef enum {
     WORD_PRIMITIVE,
     WORD_COMPILED,
-    WORD_IMMEDIATE
+    WORD_IMMEDIATE,
+    WORD_SQL
 } word_type_t;
 
-// Forth word definition
+struct vdbe_program;
+struct forth_task;
+struct async_future;
+struct snapshot_conn;
+struct shard_fanout;
+
+// Forth word definition; never changed once in the dictionary
 typedef struct {
     char name[MAX_WORD_LEN];
     word_type_t type;
     union {
         void (*prim_func)(void);  // For primitive words
-        sqlite3_stmt *compiled;   // For compiled words
+        sqlite3_stmt *compiled;   // For compiled and SQL words
     } data;
+    struct vdbe_program *program;  // Source program of compiled words, or NULL
+    uint64_t generation;           // Unique per definition
 } forth_word_t;
 
+// Buckets of the dictionary's name index; at most half are ever used
+#define DICT_INDEX_SIZE (MAX_DICT_SIZE * 2)
+
+// Dictionary, shared by every VM attached to the same database. Readers
+// take no locks: a slot's definition, its index bucket and the size are
+// published with release stores, and redefining a word swaps in a new
+// definition for the same slot and retires the old one to rcu.h. A name
+// keeps its slot, so index buckets, which hold slot + 1 and are probed
+// linearly, are never moved or cleared. Writers serialize on lock.
+typedef struct {
+    forth_word_t *words[MAX_DICT_SIZE];
+    int index[DICT_INDEX_SIZE];
+    int size;
+    pthread_mutex_t lock;
+} forth_dict_t;
+
+// Tables the dictionary is saved in: compiled words as their programs,
+// SQL words as their source text
+#define FORTH_WORDS_TABLE_SQL \
+    "CREATE TABLE IF NOT EXISTS forth_words (name TEXT PRIMARY KEY, bytecode BLOB);"
+#define FORTH_SQL_WORDS_TABLE_SQL \
+    "CREATE TABLE IF NOT EXISTS forth_sql_words (name TEXT PRIMARY KEY, sql TEXT);"
+
+// Per-VM statement for a word, tagged with the definition it was
+// prepared from
+typedef struct {
+    sqlite3_stmt *stmt;
+    uint64_t generation;
+} forth_stmt_cache_t;
+
 // Forth VM state
 typedef struct {
     // Data stack
     int data_stack[STACK_SIZE];
     int stack_ptr;
 
-    // Dictionary
-    forth_word_t dictionary[MAX_DICT_SIZE];
-    int dict_size;
+    // Return stack: dictionary indices of the words being executed.
+    // rstack_depth keeps counting past RETURN_STACK_SIZE so exits stay
+    // balanced; only the first RETURN_STACK_SIZE frames are recorded.
+    // Volatile so a signal handler sampling it sees stores in order.
+    volatile int return_stack[RETURN_STACK_SIZE];
+    volatile int rstack_depth;
 
-    // SQLite database
+    // Dictionary and database; owned by the VM that created them and
+    // borrowed by VMs attached to it
+    forth_dict_t *dict;
     sqlite3 *db;
+    int owner;
+
+    // Statements prepared on db for compiled and SQL words, indexed like
+    // the dictionary, when db is not the dictionary's own connection
+    forth_stmt_cache_t *stmts;
+
+    // Read snapshot the VM is in (snapshot.h), whose connection and cache
+    // db and stmts are meanwhile
+    struct snapshot_conn *snapshot;
+
+    // Destination of . emit and word output
+    FILE *out;
+
+    // Rest of the line being interpreted, for words that parse ahead
+    char *parse_next;
+
+    // Task running on this VM, or NULL; yield is set by words that give
+    // up the CPU, wake_ns by those that also sleep, wait_chan by those
+    // that block on a channel (to send when wait_send is set) and
+    // wait_future by those that wait for an asynchronous statement;
+    // commit_future is a write handed to the group commit coordinator
+    // and fanout the futures of a shard-all being collected
+    struct forth_task *task;
+    int yield;
+    uint64_t wake_ns;
+    struct chan *wait_chan;
+    int wait_send;
+    struct async_future *wait_future;
+    struct async_future *commit_future;
+    struct shard_fanout *fanout;
+
+    // Set on server clients' VMs, which run on the event loop: outside a
+    // task, words that would wait fail instead (task_refuse_wait)
+    int event_loop;
+
+    // Execution budget of the current run (budget.h); the deadlines are 0
+    // when there is no such limit
+    uint64_t budget_insns;
+    uint64_t budget_insn_limit;
+    uint64_t budget_deadline_ns;
+    uint64_t budget_slice_end_ns;
+    int budget_running;
+    int budget_exhausted;
 
     // Compilation state
     int compiling;
@@ -50,8 +139,16 @@ typedef struct {
 
 // VM operations
 int forth_init(forth_vm_t *vm, const char *db_path);
+int forth_attach(forth_vm_t *vm, forth_vm_t *parent, FILE *out);
 void forth_cleanup(forth_vm_t *vm);
 int forth_execute(forth_vm_t *vm, const char *input);
+void forth_execute_word(forth_vm_t *vm, int word_idx);
+int forth_call(forth_vm_t *vm, int word_idx);
+char *forth_next_token(forth_vm_t *vm);
+
+// VM that primitives act on
+forth_vm_t *forth_current(void);
+void forth_set_current(forth_vm_t *vm);
 int forth_compile_word(forth_vm_t *vm, const char *name);
 
 // Stack operations
@@ -71,6 +168,8 @@ void prim_over(void);
 void prim_dot(void);
 void prim_emit(void);
 void prim_stack_show(void);
+void prim_stats(void);
+void prim_tick(void);
 
 // SQLite VDBE operations
 int vdbe_emit_integer(forth_vm_t *vm, int value);
@@ -78,9 +177,18 @@ int vdbe_emit_add(forth_vm_t *vm);
 int vdbe_emit_print(forth_vm_t *vm);
 int vdbe_finalize_statement(forth_vm_t *vm, sqlite3_stmt **stmt);
 
-// Dictionary operations
+// Dictionary operations. Defining an existing name replaces the word in
+// its slot, so references resolved to the slot see the new definition.
 int find_word(forth_vm_t *vm, const char *name);
 int add_word(forth_vm_t *vm, const char *name, word_type_t type, void *data);
+int define_word(forth_vm_t *vm, const char *name, word_type_t type, void *data,
+                struct vdbe_program *program);
+int dict_size(forth_vm_t *vm);
+
+// Current definition in a slot
+static inline forth_word_t *forth_word(forth_vm_t *vm, int word_idx) {
+    return __atomic_load_n(&vm->dict->words[word_idx], __ATOMIC_ACQUIRE);
+}
 
 // Error handling
 void forth_error(const char *msg);
@@ -0,0 +1,227 @@
+#define _GNU_SOURCE
+#include "group.h"
+#include "async.h"
+#include "task.h"
+
+// Group commit.
+//
+// Writes travel as futures (async.h): the task that submits one parks on
+// it like await does, with the SQL word itself left to run again, and
+// vm->commit_future tells that second run to collect the results instead
+// of submitting again. The coordinator owns one connection and takes
+// everything queued once the window that opened with the oldest write has
+// passed, or as soon as every live task has a write queued. A statement
+// error is reported to its own task only; if it rolled back the whole
+// transaction, the writes before it in the batch fail as well and the
+// rest go on in a new one.
+
+int group_active = 0;
+
+static pthread_mutex_t group_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t write_queued = PTHREAD_COND_INITIALIZER;
+static async_future_t *queue_head = NULL;
+static async_future_t *queue_tail = NULL;
+static int queued = 0;
+static uint64_t window_opened_ns = 0;
+
+static uint64_t window_ns = 0;
+static int started = 0;  // 1 once the coordinator runs, -1 if it could not
+static int stopping = 0;
+static pthread_t coordinator;
+static sqlite3 *db = NULL;
+static forth_stmt_cache_t *stmts = NULL;
+
+static uint64_t writes = 0;
+static uint64_t commits = 0;
+
+// Mark writes that ran but were rolled back with their transaction
+static void fail_batch(async_future_t **batch, int from, int to, const char *reason) {
+    for (int i = from; i < to; i++) {
+        if (!batch[i]->error) {
+            batch[i]->error = strdup(reason);
+        }
+    }
+}
+
+static void commit_batch(async_future_t **batch, int count) {
+    int first = 0;  // Oldest write in the open transaction
+    if (sqlite3_exec(db, "BEGIN IMMEDIATE", NULL, NULL, NULL) != SQLITE_OK) {
+        fail_batch(batch, 0, count, sqlite3_errmsg(db));
+        return;
+    }
+
+    for (int i = 0; i < count; i++) {
+        async_run(db, stmts, batch[i]);
+        if (sqlite3_get_autocommit(db)) {
+            fail_batch(batch, first, i, "group transaction rolled back");
+            first = i + 1;
+            if (sqlite3_exec(db, "BEGIN IMMEDIATE", NULL, NULL, NULL) != SQLITE_OK) {
+                fail_batch(batch, first, count, sqlite3_errmsg(db));
+                return;
+            }
+        }
+    }
+
+    if (sqlite3_exec(db, "COMMIT", NULL, NULL, NULL) != SQLITE_OK) {
+        fail_batch(batch, first, count, sqlite3_errmsg(db));
+        sqlite3_exec(db, "ROLLBACK", NULL, NULL, NULL);
+        return;
+    }
+    for (int i = 0; i < count; i++) {
+        if (!batch[i]->error) writes++;
+    }
+    commits++;
+}
+
+static void *coordinator_main(void *arg) {
+    (void)arg;
+    async_future_t *batch[GROUP_MAX_BATCH];
+
+    pthread_mutex_lock(&group_lock);
+    for (;;) {
+        while (!queue_head && !stopping) {
+            pthread_cond_wait(&write_queued, &group_lock);
+        }
+        if (!queue_head) break;  // Stopping with nothing left to commit
+
+        // Let writes from other tasks join the batch, unless every live
+        // task is already waiting in it
+        uint64_t deadline = window_opened_ns + window_ns;
+        while (queued < GROUP_MAX_BATCH && !stopping && queued < task_count()) {
+            uint64_t now = task_now_ns();
+            if (now >= deadline) break;
+
+            struct timespec ts;
+            clock_gettime(CLOCK_REALTIME, &ts);
+            uint64_t wait = deadline - now;
+            ts.tv_sec += wait / 1000000000ull;
+            ts.tv_nsec += wait % 1000000000ull;
+            if (ts.tv_nsec >= 1000000000) {
+                ts.tv_sec++;
+                ts.tv_nsec -= 1000000000;
+            }
+            pthread_cond_timedwait(&write_queued, &group_lock, &ts);
+        }
+
+        int count = 0;
+        while (queue_head && count < GROUP_MAX_BATCH) {
+            batch[count++] = queue_head;
+            queue_head = queue_head->next;
+        }
+        if (!queue_head) queue_tail = NULL;
+        queued -= count;
+        window_opened_ns = task_now_ns();  // Writes left over start the next window
+        pthread_mutex_unlock(&group_lock);
+
+        commit_batch(batch, count);
+        for (int i = 0; i < count; i++) {
+            async_complete(batch[i]);
+        }
+        pthread_mutex_lock(&group_lock);
+    }
+    pthread_mutex_unlock(&group_lock);
+    return NULL;
+}
+
+// Callers hold group_lock
+static int start_coordinator(forth_vm_t *vm) {
+    if (async_open(vm, &db, &stmts) != 0) {
+        return -1;
+    }
+    if (pthread_create(&coordinator, NULL, coordinator_main, NULL) != 0) {
+        async_close(db, stmts);
+        db = NULL;
+        stmts = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+int group_enable(int window_us) {
+    if (window_us < 0 || window_us > GROUP_MAX_WINDOW_US) {
+        fprintf(stderr, "Group commit window must be between 0 and %d us\n", GROUP_MAX_WINDOW_US);
+        return -1;
+    }
+    window_ns = (uint64_t)window_us * 1000ull;
+    group_active = 1;
+    return 0;
+}
+
+void group_stop(void) {
+    pthread_mutex_lock(&group_lock);
+    int running = started == 1;
+    stopping = 1;
+    pthread_cond_broadcast(&write_queued);
+    pthread_mutex_unlock(&group_lock);
+
+    if (running) {
+        pthread_join(coordinator, NULL);
+        async_close(db, stmts);
+        db = NULL;
+        stmts = NULL;
+    }
+    started = 0;
+    stopping = 0;
+}
+
+int group_word(forth_vm_t *vm, int word_idx, forth_word_t *word, sqlite3_stmt *stmt) {
+    if (vm->commit_future) {
+        // Run again once the write committed: take its results
+        push(vm, vm->commit_future->id);
+        prim_await();
+        if (vm->wait_future) {
+            vm->stack_ptr--;  // Still pending; await parked this word again
+        } else {
+            vm->commit_future = NULL;
+        }
+        return 1;
+    }
+
+    // Reads, writes inside the task's own transaction, and calls that
+    // would fail anyway run directly
+    int param_count = sqlite3_bind_parameter_count(stmt);
+    if (sqlite3_stmt_readonly(stmt) || !sqlite3_get_autocommit(vm->db) ||
+        param_count > ASYNC_MAX_PARAMS || stack_depth(vm) < param_count) {
+        return 0;
+    }
+
+    pthread_mutex_lock(&group_lock);
+    if (started == 0) {
+        started = start_coordinator(vm) == 0 ? 1 : -1;
+    }
+    int running = started == 1;
+    pthread_mutex_unlock(&group_lock);
+    if (!running) {
+        return 0;
+    }
+
+    async_future_t *future = async_future_new(vm, word_idx, word);
+    if (!future) {
+        return 1;
+    }
+
+    pthread_mutex_lock(&group_lock);
+    if (!queue_head) window_opened_ns = task_now_ns();
+    if (queue_tail) queue_tail->next = future;
+    else queue_head = future;
+    queue_tail = future;
+    queued++;
+    pthread_cond_signal(&write_queued);
+    pthread_mutex_unlock(&group_lock);
+
+    // Park until the commit, then run this word again
+    vm->commit_future = future;
+    vm->task->ip--;
+    vm->yield = 1;
+    vm->wake_ns = 0;
+    vm->wait_future = future;
+    return 1;
+}
+
+uint64_t group_writes_count(void) {
+    return writes;
+}
+
+uint64_t group_commits_count(void) {
+    return commits;
+}
@@ -0,0 +1,42 @@
+#ifndef GROUP_H
+#define GROUP_H
+
+#include "forth.h"
+
+// Group commit for writes made by tasks.
+//
+// A task that runs an SQL word which writes, outside a transaction of its
+// own, hands it to a commit coordinator thread and parks. The coordinator
+// waits up to a short window for writes from other tasks, on this thread
+// or on pool workers, runs the batch in one transaction on its own
+// connection and wakes every task in it once the commit is done. Each
+// write is durable when its task carries on, as if it had committed alone,
+// but a batch pays for one sync instead of one per write. Lines run by the
+// interpreter and server requests write directly.
+
+#define GROUP_DEFAULT_WINDOW_US 500
+#define GROUP_MAX_WINDOW_US 1000000
+
+// Writes committed together at most
+#define GROUP_MAX_BATCH 256
+
+// Checked on every SQL word run by a task; zero unless enabled
+extern int group_active;
+
+// Start committing task writes in groups, collecting each batch for up to
+// window_us microseconds; the coordinator starts on the first write
+int group_enable(int window_us);
+
+// Commit what is queued and stop the coordinator
+void group_stop(void);
+
+// Run an SQL word that writes on behalf of the task on vm: hands it to the
+// coordinator and parks the task, and when the task runs the word again
+// takes the results. Returns 0 if the word must run directly instead.
+int group_word(forth_vm_t *vm, int word_idx, forth_word_t *word, sqlite3_stmt *stmt);
+
+// Writes committed and the transactions that committed them so far
+uint64_t group_writes_count(void);
+uint64_t group_commits_count(void);
+
+#endif
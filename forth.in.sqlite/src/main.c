@@ -1,5 +1,22 @@
 #include "forth.h"
 #include "compiler.h"
+#include "profile.h"
+#include "sample.h"
+#include "stats.h"
+#include "perfctr.h"
+#include "trace.h"
+#include "startup.h"
+#include "server.h"
+#include "pool.h"
+#include "rcu.h"
+#include "budget.h"
+#include "async.h"
+#include "combine.h"
+#include "group.h"
+#include "memdb.h"
+#include "vfs.h"
+#include "snapshot.h"
+#include "shard.h"
 
 // Interactive REPL
 void repl(forth_vm_t *vm, forth_compiler_t *compiler) {
@@ -7,7 +24,19 @@ void repl(forth_vm_t *vm, forth_compiler_t *compiler) {
     printf("Type 'help' for commands, 'quit' to exit\n\n");
 
     char line[MAX_INPUT_LEN];
-    while (printf("forth> "), fflush(stdout), fgets(line, sizeof(line), stdin)) {
+    for (;;) {
+        printf("forth> ");
+        fflush(stdout);
+
+        // Nothing stays buffered while the user thinks
+        if (combine_active) combine_flush_all(vm);
+
+        // Waiting for input holds no word definitions
+        rcu_thread_offline();
+        char *input = fgets(line, sizeof(line), stdin);
+        rcu_thread_online();
+        if (!input) break;
+
         // Remove trailing newline
         line[strcspn(line, "\n")] = '\0';
 
@@ -20,11 +49,21 @@ void repl(forth_vm_t *vm, forth_compiler_t *compiler) {
         } else if (strcmp(line, "help") == 0) {
             printf("Commands:\n");
             printf("  : name ... ;  - Define a new word\n");
+            printf("  sql: name ... - Define a word backed by an SQL statement\n");
             printf("  .s            - Show stack contents\n");
             printf("  words         - List all defined words\n");
+            printf("  profile       - Show per-word profile (needs --profile)\n");
+            printf("  perf          - Show per-word hardware counters (needs --perf)\n");
+            printf("  see name      - Show a word's program and instruction counts\n");
             printf("  help          - Show this help\n");
             printf("  quit          - Exit the REPL\n");
-            printf("\nPrimitives: + - * / dup drop swap over . emit\n");
+            printf("\nPrimitives: + - * / dup drop swap over . emit stats\n");
+            printf("Tasks: spawn{ ... } respawn if{ ... }else{ ... } pause ms run-tasks join\n");
+            printf("Channels: chan-new chan-new-spsc chan-send chan-recv chan-try-recv\n");
+            printf("Asynchronous SQL: ' async-exec await\n");
+            printf("Read snapshots: snapshot-begin snapshot-end\n");
+            printf("Shards: shard-for shard-count shard-exec shard-all shard-sum\n");
+            printf("Jobs: queue-init enqueue dequeue-batch ack ack-batch job-count\n");
         } else if (strcmp(line, ".s") == 0) {
             printf("<%d> ", stack_depth(vm));
             for (int i = vm->stack_ptr - 1; i >= 0; i--) {
@@ -33,44 +72,34 @@ void repl(forth_vm_t *vm, forth_compiler_t *compiler) {
             printf("\n");
         } else if (strcmp(line, "words") == 0) {
             printf("Dictionary:\n");
-            for (int i = 0; i < vm->dict_size; i++) {
-                forth_word_t *word = &vm->dictionary[i];
+            for (int i = 0; i < dict_size(vm); i++) {
+                forth_word_t *word = forth_word(vm, i);
                 const char *type = (word->type == WORD_PRIMITIVE) ? "prim" :
-                                 (word->type == WORD_COMPILED) ? "comp" : "imm";
+                                 (word->type == WORD_COMPILED) ? "comp" :
+                                 (word->type == WORD_SQL) ? "sql" : "imm";
                 printf("  %s (%s)\n", word->name, type);
             }
+        } else if (strcmp(line, "profile") == 0) {
+            profile_report(vm, stdout);
+        } else if (strcmp(line, "perf") == 0) {
+            perfctr_report(vm, stdout);
+        } else if (strncmp(line, "see ", 4) == 0) {
+            compiler_see_word(compiler, line + 4, stdout);
         } else if (strcmp(line, "compile") == 0) {
             printf("Entering compilation mode\n");
             // In a full implementation, this would switch to compilation mode
         } else {
-            // Process the line
-            if (compiler->state == COMPILER_COMPILING) {
-                // We're compiling a word definition
-                if (compiler_compile_token(compiler, line) != 0) {
-                    fprintf(stderr, "Compilation error\n");
-                }
-            } else {
-                // Check if it's a word definition
-                if (strncmp(line, ": ", 2) == 0) {
-                    // Start word definition
-                    char *word_start = line + 2;
-                    char *word_end = strtok(word_start, " ");
-                    if (word_end) {
-                        compiler_start_word(compiler, word_end);
-                    }
-                } else {
-                    // Execute immediately
-                    if (forth_execute(vm, line) != 0) {
-                        fprintf(stderr, "Execution error\n");
-                    }
-                }
-            }
+            // Errors are reported by the interpreter; the REPL carries on
+            compiler_interpret_line(compiler, line);
         }
+
+        rcu_quiescent();
+        rcu_reclaim();
     }
 }
 
 // File execution
-int execute_file(forth_vm_t *vm, forth_compiler_t *compiler, const char *filename) {
+int execute_file(forth_compiler_t *compiler, const char *filename) {
     FILE *file = fopen(filename, "r");
     if (!file) {
         perror("Failed to open file");
@@ -78,6 +107,7 @@ int execute_file(forth_vm_t *vm, forth_compiler_t *compiler, const char *filenam
     }
 
     printf("Executing file: %s\n", filename);
+    if (trace_active) trace_begin(TRACE_FILE, filename);
 
     char line[MAX_INPUT_LEN];
     int line_number = 0;
@@ -95,38 +125,139 @@ int execute_file(forth_vm_t *vm, forth_compiler_t *compiler, const char *filenam
 
         printf("%d: %s\n", line_number, line);
 
-        // Process the line
-        if (compiler->state == COMPILER_COMPILING) {
-            if (compiler_compile_token(compiler, line) != 0) {
-                fprintf(stderr, "Compilation error on line %d\n", line_number);
-                fclose(file);
-                return -1;
-            }
-        } else {
-            if (strncmp(line, ": ", 2) == 0) {
-                char *word_start = line + 2;
-                char *word_end = strtok(word_start, " ");
-                if (word_end) {
-                    compiler_start_word(compiler, word_end);
-                }
-            } else {
-                if (forth_execute(vm, line) != 0) {
-                    fprintf(stderr, "Execution error on line %d\n", line_number);
-                    fclose(file);
-                    return -1;
-                }
-            }
+        if (compiler_interpret_line(compiler, line) != 0) {
+            fprintf(stderr, "Error on line %d\n", line_number);
+            fclose(file);
+            if (trace_active) trace_end(TRACE_FILE, filename);
+            return -1;
         }
+
+        // Free replaced words that no worker can still be running
+        rcu_quiescent();
+        rcu_reclaim();
     }
 
     fclose(file);
+    if (trace_active) trace_end(TRACE_FILE, filename);
     return 0;
 }
 
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [--profile[=period]] [--sample=out.folded] [--sample-hz=N]\n"
+                    "          [--stats] [--slow-ms=N] [--slow-steps=N] [--slow-fullscan=N]\n"
+                    "          [--perf] [--trace=out.json] [--startup-report[=top_n]]\n"
+                    "          [--serve=socket_path] [--workers=N]\n"
+                    "          [--budget-insns=N] [--budget-ms=N] [--slice-us=N]\n"
+                    "          [--io-threads=N] [--combine-writes[=rows]]\n"
+                    "          [--group-commit[=window_us]]\n"
+                    "          [--memory[=interval_ms]] [--snapshot-commits=N]\n"
+                    "          [--vfs=coalesce|uring] [--shards=N]\n"
+                    "          [filename.fth]\n", prog);
+}
+
 int main(int argc, char *argv[]) {
     forth_vm_t vm;
     forth_compiler_t compiler;
 
+    // Parse command line
+    const char *filename = NULL;
+    int profile = 0;  // Timing sample period, 0 when disabled
+    const char *sample_path = NULL;
+    int sample_hz = SAMPLE_DEFAULT_HZ;
+    int stats = 0;
+    int perf = 0;
+    const char *trace_path = NULL;
+    int startup_top = -1;  // Slowest words to list, -1 when not reporting
+    const char *serve_path = NULL;
+    int workers = 0;
+    int combine_rows = 0;
+    int group_window = -1;  // Group commit window in microseconds, -1 when off
+    int memory = 0;
+    int shards = 0;
+    memdb_policy_t snapshot = {MEMDB_DEFAULT_INTERVAL_MS, 0};
+    stats_thresholds_t thresholds = {0, 0, 0};
+    budget_limits_t budget = {0, 0, 0};
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--profile") == 0) {
+            profile = PROFILE_DEFAULT_PERIOD;
+        } else if (strncmp(argv[i], "--profile=", 10) == 0) {
+            profile = atoi(argv[i] + 10);
+        } else if (strncmp(argv[i], "--sample=", 9) == 0) {
+            sample_path = argv[i] + 9;
+        } else if (strncmp(argv[i], "--sample-hz=", 12) == 0) {
+            sample_hz = atoi(argv[i] + 12);
+        } else if (strcmp(argv[i], "--startup-report") == 0) {
+            startup_top = STARTUP_DEFAULT_TOP;
+        } else if (strncmp(argv[i], "--startup-report=", 17) == 0) {
+            startup_top = atoi(argv[i] + 17);
+        } else if (strncmp(argv[i], "--serve=", 8) == 0) {
+            serve_path = argv[i] + 8;
+        } else if (strcmp(argv[i], "--serve") == 0 && i + 1 < argc) {
+            serve_path = argv[++i];
+        } else if (strncmp(argv[i], "--workers=", 10) == 0) {
+            workers = atoi(argv[i] + 10);
+        } else if (strncmp(argv[i], "--io-threads=", 13) == 0) {
+            async_threads = atoi(argv[i] + 13);
+        } else if (strcmp(argv[i], "--combine-writes") == 0) {
+            combine_rows = COMBINE_DEFAULT_ROWS;
+        } else if (strncmp(argv[i], "--combine-writes=", 17) == 0) {
+            combine_rows = atoi(argv[i] + 17);
+        } else if (strcmp(argv[i], "--group-commit") == 0) {
+            group_window = GROUP_DEFAULT_WINDOW_US;
+        } else if (strncmp(argv[i], "--group-commit=", 15) == 0) {
+            group_window = atoi(argv[i] + 15);
+        } else if (strcmp(argv[i], "--memory") == 0) {
+            memory = 1;
+        } else if (strncmp(argv[i], "--memory=", 9) == 0) {
+            memory = 1;
+            snapshot.interval_ms = atoi(argv[i] + 9);
+        } else if (strncmp(argv[i], "--snapshot-commits=", 19) == 0) {
+            snapshot.commits = atoi(argv[i] + 19);
+        } else if (strncmp(argv[i], "--shards=", 9) == 0) {
+            shards = atoi(argv[i] + 9);
+        } else if (strcmp(argv[i], "--vfs=coalesce") == 0) {
+            vfs_mode = VFS_COALESCE;
+        } else if (strcmp(argv[i], "--vfs=uring") == 0) {
+            vfs_mode = VFS_URING;
+        } else if (strcmp(argv[i], "--vfs=default") == 0) {
+            vfs_mode = VFS_DEFAULT;
+        } else if (strncmp(argv[i], "--budget-insns=", 15) == 0) {
+            budget.insns = strtoull(argv[i] + 15, NULL, 10);
+        } else if (strncmp(argv[i], "--budget-ms=", 12) == 0) {
+            budget.time_ns = strtoull(argv[i] + 12, NULL, 10) * 1000000ull;
+        } else if (strncmp(argv[i], "--slice-us=", 11) == 0) {
+            budget.slice_ns = strtoull(argv[i] + 11, NULL, 10) * 1000ull;
+        } else if (strncmp(argv[i], "--trace=", 8) == 0) {
+            trace_path = argv[i] + 8;
+        } else if (strcmp(argv[i], "--perf") == 0) {
+            perf = 1;
+        } else if (strcmp(argv[i], "--stats") == 0) {
+            stats = 1;
+        } else if (strncmp(argv[i], "--slow-ms=", 10) == 0) {
+            stats = 1;
+            thresholds.time_ns = strtoull(argv[i] + 10, NULL, 10) * 1000000ull;
+        } else if (strncmp(argv[i], "--slow-steps=", 13) == 0) {
+            stats = 1;
+            thresholds.vm_steps = strtoull(argv[i] + 13, NULL, 10);
+        } else if (strncmp(argv[i], "--slow-fullscan=", 16) == 0) {
+            stats = 1;
+            thresholds.fullscan_steps = strtoull(argv[i] + 16, NULL, 10);
+        } else if (argv[i][0] != '-' && !filename) {
+            filename = argv[i];
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (startup_top >= 0) {
+        startup_begin();
+    }
+
+    if (memory && memdb_configure(&snapshot) != 0) {
+        return 1;
+    }
+
     // Initialize VM
     const char *db_path = "forth.db";
     if (forth_init(&vm, db_path) != 0) {
@@ -141,29 +272,172 @@ int main(int argc, char *argv[]) {
         return 1;
     }
 
+    // Trace from here so that loading the dictionary shows up on the timeline
+    if (trace_path && trace_start(&vm, trace_path) != 0) {
+        trace_path = NULL;
+    }
+
     // Load previously compiled words
     compiler_load_all_words(&compiler);
 
     printf("Forth-in-SQLite initialized with database: %s\n", db_path);
-    printf("Loaded %d words from dictionary\n", vm.dict_size);
+    printf("Loaded %d words from dictionary\n", dict_size(&vm));
+    if (memory) {
+        printf("Loaded %zu bytes into memory in %.3f ms\n", memdb_loaded_bytes(),
+               memdb_load_ns() / 1e6);
+        if (memdb_start(&vm) != 0) {
+            fprintf(stderr, "Only saving the database at exit\n");
+        }
+    }
+
+    if (profile && profile_enable(profile) != 0) {
+        profile = 0;
+    }
+    if (sample_path && sampler_start(&vm, sample_hz) != 0) {
+        sample_path = NULL;
+    }
+    if (stats && stats_enable(&vm, &thresholds) != 0) {
+        stats = 0;
+    }
+    if (perf && perfctr_enable() != 0) {
+        perf = 0;
+    }
+    // Before the pool opens its connections, which are charged too
+    if (budget.insns || budget.time_ns || budget.slice_ns) {
+        budget_enable(&vm, &budget);
+    }
+    // Client output buffers belong to the server loop's thread
+    if (workers && serve_path) {
+        fprintf(stderr, "--workers is ignored in server mode\n");
+        workers = 0;
+    }
+    if (workers && pool_start(&vm, workers) != 0) {
+        workers = 0;
+    }
+    // Buffers belong to the interpreter's connection; pool workers write
+    // through their own
+    if (combine_rows && workers) {
+        fprintf(stderr, "--combine-writes is ignored with --workers\n");
+        combine_rows = 0;
+    }
+    if (combine_rows && combine_enable(&vm, combine_rows) != 0) {
+        combine_rows = 0;
+    }
+    if (group_window >= 0 && group_enable(group_window) != 0) {
+        group_window = -1;
+    }
+    if (shards && shard_start(&vm, shards) != 0) {
+        shards = 0;
+    }
 
-    if (argc == 1) {
+    if (serve_path) {
+        // Server mode; a file given as well is run first to set things up
+        if (!filename || execute_file(&compiler, filename) == 0) {
+            server_run(&vm, serve_path);
+        } else {
+            fprintf(stderr, "File execution failed\n");
+        }
+    } else if (!filename) {
         // Interactive mode
         repl(&vm, &compiler);
-    } else if (argc == 2) {
+    } else {
         // File execution mode
-        if (execute_file(&vm, &compiler, argv[1]) == 0) {
+        if (execute_file(&compiler, filename) == 0) {
             printf("File executed successfully\n");
         } else {
             fprintf(stderr, "File execution failed\n");
         }
-    } else {
-        fprintf(stderr, "Usage: %s [filename.fth]\n", argv[0]);
+    }
+
+    // Let spawned tasks finish before anything is flushed
+    if (workers) {
+        pool_stop();
+    }
+    // Before async_stop frees the futures writes travel in
+    if (group_window >= 0) {
+        group_stop();
+        printf("Group commit: %llu writes in %llu transactions\n",
+               (unsigned long long)group_writes_count(),
+               (unsigned long long)group_commits_count());
+    }
+    // Before async_stop frees the futures statements travel in
+    if (shards) {
+        shard_stop();
+        printf("Shards: statements per shard");
+        for (int i = 0; i < shard_count(); i++) {
+            printf(" %llu", (unsigned long long)shard_statements_count(i));
+        }
+        printf("\n");
+    }
+    async_stop();
+
+    // The interpreter's own connection is needed for the flushes below
+    snapshot_stop(&vm);
+    if (snapshot_pinned_count()) {
+        printf("Read snapshots: %llu pinned on %llu connections\n",
+               (unsigned long long)snapshot_pinned_count(),
+               (unsigned long long)snapshot_opened_count());
+    }
+
+    if (combine_rows) {
+        combine_disable(&vm);
+        printf("Write combining: %llu rows in %llu statements\n",
+               (unsigned long long)combine_rows_count(),
+               (unsigned long long)combine_statements_count());
+    }
+
+    if (startup_top >= 0) {
+        startup_report(stdout, startup_top);
+    }
+
+    if (sample_path) {
+        sampler_stop();
+        sampler_write_folded(&vm, sample_path);
+    }
+
+    // Hot-spot counts feed later compilation heuristics
+    compiler_save_insn_counts(&compiler);
+
+    if (perf) {
+        perfctr_disable();
+        perfctr_flush(&vm);
+    }
+
+    if (stats) {
+        stats_disable(&vm);
+        stats_flush(&vm);
+    }
+
+    // Persist the profile for SQL queries
+    if (profile) {
+        profile_disable();
+        profile_flush(&vm);
+    }
+
+    // Drain the trace last so the flushes above appear on the timeline
+    if (trace_path) {
+        trace_stop(&vm);
+    }
+
+    // Everything above may still have written to the database
+    if (memory) {
+        memdb_stop();
+        printf("Snapshots: %llu written\n", (unsigned long long)memdb_snapshot_count());
     }
 
     // Cleanup
     compiler_cleanup(&compiler);
     forth_cleanup(&vm);
 
+    // After the connections closed, which writes out what they queued
+    if (vfs_mode != VFS_DEFAULT) {
+        printf("VFS (%s): %llu writes in %llu I/Os, %llu syncs, %llu submissions\n",
+               vfs_mode_name(vfs_mode),
+               (unsigned long long)vfs_writes_count(),
+               (unsigned long long)vfs_runs_count(),
+               (unsigned long long)vfs_syncs_count(),
+               (unsigned long long)vfs_submits_count());
+    }
+
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,252 @@
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <libgen.h>
+#include <unistd.h>
+#include "memdb.h"
+#include "task.h"
+
+// In-memory database.
+//
+// Loading goes through sqlite3_serialize on a connection to the file,
+// which reads the pages as a transaction would see them, WAL included; the
+// image is then marked as a rollback-journal database, since memory
+// databases cannot use WAL, and handed to sqlite3_deserialize. Snapshots
+// put the file's own journal mode bytes back.
+//
+// A snapshot holds the connection's mutex only while it checks that no
+// transaction is open and copies the image, so it never sees a half-done
+// write; writing the file happens without it. The pager's data version,
+// which counts commits on the connection, tells the thread when there is
+// anything new to write.
+
+int memdb_active = 0;
+
+static memdb_policy_t policy = {MEMDB_DEFAULT_INTERVAL_MS, 0};
+static char *db_path = NULL;
+static sqlite3 *memory_db = NULL;
+static size_t loaded_bytes = 0;
+static unsigned char file_versions[2] = {1, 1};  // Header bytes 18 and 19
+static uint64_t load_ns = 0;
+
+static pthread_t snapshot_thread;
+static pthread_mutex_t snapshot_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t snapshot_wakeup = PTHREAD_COND_INITIALIZER;
+static int running = 0;
+static int stopping = 0;
+static unsigned int saved_version = 0;
+static uint64_t snapshots = 0;
+
+int memdb_configure(const memdb_policy_t *config) {
+    if (config->interval_ms < MEMDB_TICK_MS || config->commits < 0) {
+        fprintf(stderr, "Snapshot interval must be at least %d ms\n", MEMDB_TICK_MS);
+        return -1;
+    }
+    policy = *config;
+    memdb_active = 1;
+    return 0;
+}
+
+int memdb_open(const char *path, sqlite3 **db) {
+    uint64_t start = task_now_ns();
+    *db = NULL;
+
+    sqlite3 *file = NULL;
+    sqlite3_int64 size = 0;
+    unsigned char *image = NULL;
+    if (sqlite3_open(path, &file) == SQLITE_OK) {
+        image = sqlite3_serialize(file, "main", &size, 0);
+    }
+    sqlite3_close(file);
+
+    if (image && size >= 100) {
+        file_versions[0] = image[18];
+        file_versions[1] = image[19];
+        if (image[18] == 2) {
+            image[18] = image[19] = 1;  // WAL to rollback journal
+        }
+    }
+
+    if (sqlite3_open(":memory:", db) != SQLITE_OK) {
+        sqlite3_free(image);
+        return -1;
+    }
+    if (image && sqlite3_deserialize(*db, "main", image, size, size,
+                                     SQLITE_DESERIALIZE_FREEONCLOSE |
+                                     SQLITE_DESERIALIZE_RESIZEABLE) != SQLITE_OK) {
+        fprintf(stderr, "Failed to load %s into memory: %s\n", path, sqlite3_errmsg(*db));
+        return -1;
+    }
+    if (!sqlite3_db_mutex(*db)) {
+        fprintf(stderr, "In-memory mode needs a serialized (threadsafe=1) SQLite\n");
+        return -1;
+    }
+
+    free(db_path);
+    db_path = strdup(path);
+    memory_db = *db;
+    loaded_bytes = (size_t)size;
+    load_ns = task_now_ns() - start;
+    return db_path ? 0 : -1;
+}
+
+static unsigned int data_version(void) {
+    unsigned int version = 0;
+    sqlite3_file_control(memory_db, "main", SQLITE_FCNTL_DATA_VERSION, &version);
+    return version;
+}
+
+static int write_all(int fd, const unsigned char *data, size_t size) {
+    while (size > 0) {
+        ssize_t n = write(fd, data, size);
+        if (n < 0) return -1;
+        data += n;
+        size -= (size_t)n;
+    }
+    return 0;
+}
+
+// Copy the image and replace the file with it; 1 if a transaction is open
+// and the snapshot has to wait, -1 on failure. Memory databases roll back
+// a transaction by restoring pages in place, so while one is open there
+// is no committed image to copy.
+static int write_snapshot(void) {
+    sqlite3_mutex *mutex = sqlite3_db_mutex(memory_db);
+    sqlite3_mutex_enter(mutex);
+    if (!sqlite3_get_autocommit(memory_db)) {
+        sqlite3_mutex_leave(mutex);
+        return 1;
+    }
+    unsigned int version = data_version();
+    sqlite3_int64 size = 0;
+    unsigned char *image = sqlite3_serialize(memory_db, "main", &size, 0);
+    sqlite3_mutex_leave(mutex);
+    if (!image) return -1;
+    if (size >= 100) {
+        image[18] = file_versions[0];
+        image[19] = file_versions[1];
+    }
+
+    char tmp_path[4096];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.snapshot", db_path);
+    int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    int status = fd < 0 ? -1 : 0;
+    if (status == 0 && (write_all(fd, image, (size_t)size) != 0 || fsync(fd) != 0)) {
+        status = -1;
+    }
+    if (fd >= 0) close(fd);
+    sqlite3_free(image);
+
+    if (status == 0 && rename(tmp_path, db_path) != 0) {
+        status = -1;
+    }
+    if (status != 0) {
+        perror("Failed to write snapshot");
+        unlink(tmp_path);
+        return -1;
+    }
+
+    // Make the rename itself durable
+    char dir_path[4096];
+    snprintf(dir_path, sizeof(dir_path), "%s", db_path);
+    int dir = open(dirname(dir_path), O_RDONLY);
+    if (dir >= 0) {
+        fsync(dir);
+        close(dir);
+    }
+
+    saved_version = version;
+    snapshots++;
+    return 0;
+}
+
+static void *snapshot_main(void *arg) {
+    (void)arg;
+    uint64_t interval_ns = (uint64_t)policy.interval_ms * 1000000ull;
+    uint64_t last_ns = task_now_ns();
+
+    pthread_mutex_lock(&snapshot_lock);
+    while (!stopping) {
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_nsec += MEMDB_TICK_MS * 1000000L;
+        if (ts.tv_nsec >= 1000000000) {
+            ts.tv_sec++;
+            ts.tv_nsec -= 1000000000;
+        }
+        pthread_cond_timedwait(&snapshot_wakeup, &snapshot_lock, &ts);
+        if (stopping) break;
+        pthread_mutex_unlock(&snapshot_lock);
+
+        unsigned int pending = data_version() - saved_version;
+        uint64_t now = task_now_ns();
+        if (pending && (now - last_ns >= interval_ns ||
+                        (policy.commits && pending >= (unsigned int)policy.commits))) {
+            if (write_snapshot() == 0) {
+                last_ns = now;
+            }
+        } else if (!pending) {
+            last_ns = now;  // Nothing is at risk; the interval starts at the next commit
+        }
+
+        pthread_mutex_lock(&snapshot_lock);
+    }
+    pthread_mutex_unlock(&snapshot_lock);
+    return NULL;
+}
+
+int memdb_start(forth_vm_t *vm) {
+    (void)vm;
+    if (!memory_db) return -1;
+
+    // Journals left next to the file would be replayed into a snapshot
+    char path[4096];
+    snprintf(path, sizeof(path), "%s-journal", db_path);
+    unlink(path);
+    snprintf(path, sizeof(path), "%s-wal", db_path);
+    unlink(path);
+    snprintf(path, sizeof(path), "%s-shm", db_path);
+    unlink(path);
+
+    saved_version = data_version();
+    if (pthread_create(&snapshot_thread, NULL, snapshot_main, NULL) != 0) {
+        forth_error("Failed to start snapshot thread");
+        return -1;
+    }
+    running = 1;
+    return 0;
+}
+
+void memdb_stop(void) {
+    if (running) {
+        pthread_mutex_lock(&snapshot_lock);
+        stopping = 1;
+        pthread_cond_signal(&snapshot_wakeup);
+        pthread_mutex_unlock(&snapshot_lock);
+        pthread_join(snapshot_thread, NULL);
+        running = 0;
+        stopping = 0;
+    }
+
+    if (!memory_db || data_version() == saved_version) return;
+    int status = write_snapshot();
+    if (status == 1) {
+        // A transaction left open would be rolled back on close anyway
+        sqlite3_exec(memory_db, "ROLLBACK", NULL, NULL, NULL);
+        status = write_snapshot();
+    }
+    if (status != 0) {
+        fprintf(stderr, "Last snapshot of %s failed\n", db_path);
+    }
+}
+
+size_t memdb_loaded_bytes(void) {
+    return loaded_bytes;
+}
+
+uint64_t memdb_load_ns(void) {
+    return load_ns;
+}
+
+uint64_t memdb_snapshot_count(void) {
+    return snapshots;
+}
@@ -0,0 +1,53 @@
+#ifndef MEMDB_H
+#define MEMDB_H
+
+#include "forth.h"
+
+// In-memory database with background snapshots.
+//
+// The database file is read once at startup (through a connection to the
+// file, so a WAL is included) and the image deserialized into memory; from
+// then on statements never touch the disk. A background thread writes the
+// image back with a temporary file, fsync and rename, so the file always
+// holds a complete, consistent snapshot. Commits made since the last
+// snapshot are lost on a crash: they are bounded by the snapshot interval,
+// and optionally by a number of commits. The image has no committed copy
+// apart from itself, so no snapshot is taken while a transaction is open;
+// the bounds restart when it ends.
+//
+// The process must own the file: pool workers, I/O threads and group
+// commit, which open connections of their own, are unavailable.
+
+#define MEMDB_DEFAULT_INTERVAL_MS 1000
+
+// How often the snapshot thread looks for new commits
+#define MEMDB_TICK_MS 10
+
+typedef struct {
+    int interval_ms;  // Snapshot commits at most this old
+    int commits;      // Snapshot once this many commits are pending, 0 for no limit
+} memdb_policy_t;
+
+// Set before forth_init: the database it opens is loaded into memory
+extern int memdb_active;
+
+// Turn the mode on with a snapshot policy, before forth_init
+int memdb_configure(const memdb_policy_t *policy);
+
+// Load the database at path into a new in-memory connection (forth_init)
+int memdb_open(const char *path, sqlite3 **db);
+
+// Start the snapshot thread once the VM is initialized
+int memdb_start(forth_vm_t *vm);
+
+// Stop the thread and write a last snapshot; after the last write and
+// before the connection closes
+void memdb_stop(void);
+
+// Size of the image loaded and the time loading took, and snapshots
+// written so far
+size_t memdb_loaded_bytes(void);
+uint64_t memdb_load_ns(void);
+uint64_t memdb_snapshot_count(void);
+
+#endif
@@ -0,0 +1,240 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include "perfctr.h"
+#include "report.h"
+
+// Hardware performance counters per word via perf_event_open.
+//
+// All available events are opened as one group on the calling thread and
+// read together with a single read() at word entry and exit; each word is
+// charged the counts of its own body, excluding the words it calls.
+// Events the kernel or container refuses (common for cache events and in
+// unprivileged containers) are reported as n/a; if no hardware event opens,
+// the software task clock is still reported so the output stays useful.
+
+int perfctr_active = 0;
+
+typedef struct {
+    const char *name;
+    uint32_t type;
+    uint64_t config;
+    int hardware;
+} perfctr_spec_t;
+
+static const perfctr_spec_t specs[PERFCTR_EVENT_COUNT] = {
+    {"cycles",        PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, 1},
+    {"instructions",  PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, 1},
+    {"branch-misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES, 1},
+    {"L1d-misses",    PERF_TYPE_HW_CACHE,
+        PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+        (PERF_COUNT_HW_CACHE_RESULT_MISS << 16), 1},
+    {"LLC-misses",    PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES, 1},
+    {"task-clock-ns", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK, 0},
+};
+
+typedef struct {
+    uint64_t calls;
+    uint64_t counts[PERFCTR_EVENT_COUNT];
+} perfctr_entry_t;
+
+typedef struct {
+    int word_idx;
+    uint64_t start[PERFCTR_EVENT_COUNT];
+    uint64_t child[PERFCTR_EVENT_COUNT];
+    int valid;  // start was read; frames that were not are not charged
+} perfctr_frame_t;
+
+static int group_fd = -1;
+static int fds[PERFCTR_EVENT_COUNT];
+static int slot_event[PERFCTR_EVENT_COUNT];  // Group read position -> event
+static int slot_count = 0;
+static int available[PERFCTR_EVENT_COUNT];  // Opened by the last perfctr_enable
+
+static perfctr_entry_t entries[MAX_DICT_SIZE];
+static perfctr_frame_t frames[PERFCTR_MAX_DEPTH];
+static int frame_depth = 0;
+static int frames_dropped = 0;
+
+static long perf_event_open(struct perf_event_attr *attr, int group) {
+    return syscall(SYS_perf_event_open, attr, 0, -1, group, 0);
+}
+
+// Read the whole group into per-event counts; -1 unless every counter
+// was read
+static int read_counters(uint64_t *counts) {
+    uint64_t buf[1 + PERFCTR_EVENT_COUNT];
+    ssize_t size = (ssize_t)(sizeof(uint64_t) * (1 + slot_count));
+    if (read(group_fd, buf, size) != size || buf[0] != (uint64_t)slot_count) {
+        return -1;
+    }
+    for (int i = 0; i < slot_count; i++) {
+        counts[slot_event[i]] = buf[1 + i];
+    }
+    return 0;
+}
+
+int perfctr_enable(void) {
+    int hardware = 0;
+    int first_errno = 0;
+
+    for (int e = 0; e < PERFCTR_EVENT_COUNT; e++) {
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = specs[e].type;
+        attr.config = specs[e].config;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_GROUP;
+        attr.disabled = (group_fd < 0);  // The leader starts the group
+
+        long fd = perf_event_open(&attr, group_fd);
+        available[e] = (fd >= 0);
+        if (fd < 0) {
+            if (!first_errno) first_errno = errno;
+            fds[e] = -1;
+            continue;
+        }
+
+        fds[e] = (int)fd;
+        if (group_fd < 0) group_fd = (int)fd;
+        slot_event[slot_count++] = e;
+        hardware += specs[e].hardware;
+    }
+
+    if (group_fd < 0) {
+        fprintf(stderr, "perf: counters unavailable (%s); --perf disabled\n",
+                strerror(first_errno));
+        return -1;
+    }
+    if (!hardware) {
+        fprintf(stderr, "perf: hardware counters unavailable (%s); reporting task clock only\n",
+                strerror(first_errno));
+    }
+
+    memset(entries, 0, sizeof(entries));
+    frame_depth = 0;
+    frames_dropped = 0;
+
+    ioctl(group_fd, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(group_fd, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    perfctr_active = 1;
+    return 0;
+}
+
+void perfctr_disable(void) {
+    perfctr_active = 0;
+    if (group_fd < 0) return;
+
+    ioctl(group_fd, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+    for (int e = 0; e < PERFCTR_EVENT_COUNT; e++) {
+        if (fds[e] >= 0 && fds[e] != group_fd) close(fds[e]);
+        fds[e] = -1;
+    }
+    close(group_fd);
+    group_fd = -1;
+    slot_count = 0;
+}
+
+void perfctr_enter(int word_idx) {
+    if (frame_depth >= PERFCTR_MAX_DEPTH) {
+        frames_dropped++;
+        return;
+    }
+
+    perfctr_frame_t *frame = &frames[frame_depth++];
+    frame->word_idx = word_idx;
+    memset(frame->child, 0, sizeof(frame->child));
+    frame->valid = (read_counters(frame->start) == 0);
+}
+
+void perfctr_exit(int word_idx) {
+    uint64_t now[PERFCTR_EVENT_COUNT];
+    int valid = (read_counters(now) == 0);
+
+    if (frames_dropped > 0) {
+        frames_dropped--;
+        return;
+    }
+    if (frame_depth == 0 || frames[frame_depth - 1].word_idx != word_idx) {
+        return;
+    }
+
+    // A failed read leaves the frame's counts, and the call, uncharged
+    perfctr_frame_t *frame = &frames[--frame_depth];
+    if (!valid || !frame->valid) {
+        return;
+    }
+    perfctr_entry_t *entry = &entries[word_idx];
+    entry->calls++;
+
+    for (int i = 0; i < slot_count; i++) {
+        int e = slot_event[i];
+        uint64_t total = now[e] - frame->start[e];
+        entry->counts[e] += total - frame->child[e];
+        if (frame_depth > 0) {
+            frames[frame_depth - 1].child[e] += total;
+        }
+    }
+}
+
+void perfctr_report(forth_vm_t *vm, FILE *out) {
+    fprintf(out, "%-16s %8s", "word", "calls");
+    for (int e = 0; e < PERFCTR_EVENT_COUNT; e++) {
+        fprintf(out, " %14s", specs[e].name);
+    }
+    fprintf(out, "\n");
+
+    for (int i = 0; i < dict_size(vm); i++) {
+        perfctr_entry_t *entry = &entries[i];
+        if (entry->calls == 0) continue;
+
+        fprintf(out, "%-16s %8llu", forth_word(vm, i)->name, (unsigned long long)entry->calls);
+        for (int e = 0; e < PERFCTR_EVENT_COUNT; e++) {
+            if (available[e]) {
+                fprintf(out, " %14llu", (unsigned long long)entry->counts[e]);
+            } else {
+                fprintf(out, " %14s", "n/a");
+            }
+        }
+        fprintf(out, "\n");
+    }
+}
+
+static int bind_perfctr_row(sqlite3_stmt *stmt, int word_idx) {
+    perfctr_entry_t *entry = &entries[word_idx];
+    if (entry->calls == 0) return 0;
+
+    sqlite3_bind_int64(stmt, 3, (sqlite3_int64)entry->calls);
+    for (int e = 0; e < PERFCTR_EVENT_COUNT; e++) {
+        if (available[e]) {
+            sqlite3_bind_int64(stmt, 4 + e, (sqlite3_int64)entry->counts[e]);
+        } else {
+            sqlite3_bind_null(stmt, 4 + e);
+        }
+    }
+    return 1;
+}
+
+// Append per-word counts to forth_perf_counters; unavailable events are NULL
+int perfctr_flush(forth_vm_t *vm) {
+    return report_flush(vm, "perf counter",
+        "CREATE TABLE IF NOT EXISTS forth_perf_counters ("
+        "run INTEGER,"
+        "name TEXT,"
+        "calls INTEGER,"
+        "cycles INTEGER,"
+        "instructions INTEGER,"
+        "branch_misses INTEGER,"
+        "l1d_misses INTEGER,"
+        "llc_misses INTEGER,"
+        "task_clock_ns INTEGER);",
+        "INSERT INTO forth_perf_counters (run, name, calls, cycles, instructions, "
+        "branch_misses, l1d_misses, llc_misses, task_clock_ns) "
+        "VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?)",
+        bind_perfctr_row);
+}
@@ -0,0 +1,34 @@
+#ifndef PERFCTR_H
+#define PERFCTR_H
+
+#include "forth.h"
+
+// Events attributed to each word, in report order
+typedef enum {
+    PERFCTR_CYCLES,
+    PERFCTR_INSTRUCTIONS,
+    PERFCTR_BRANCH_MISSES,
+    PERFCTR_L1D_MISSES,
+    PERFCTR_LLC_MISSES,
+    PERFCTR_TASK_CLOCK,
+    PERFCTR_EVENT_COUNT
+} perfctr_event_t;
+
+#define PERFCTR_MAX_DEPTH 256
+
+// Checked before every word call; zero unless counters were enabled
+extern int perfctr_active;
+
+// Counter control; fails when no event can be opened
+int perfctr_enable(void);
+void perfctr_disable(void);
+
+// Word entry/exit hooks called from forth_execute_word
+void perfctr_enter(int word_idx);
+void perfctr_exit(int word_idx);
+
+// Reporting
+void perfctr_report(forth_vm_t *vm, FILE *out);
+int perfctr_flush(forth_vm_t *vm);
+
+#endif
@@ -0,0 +1,423 @@
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include "pool.h"
+#include "rcu.h"
+#include "budget.h"
+#include "snapshot.h"
+#include "trace.h"
+
+// Work-stealing worker pool for tasks.
+//
+// Each worker owns a Chase-Lev deque: it pushes and pops tasks it spawned
+// at the bottom, without locks, while idle workers steal the oldest task
+// from the top of a random victim's deque. Tasks spawned by any other
+// thread (the interpreter, server clients) go through a mutex-protected
+// injection queue. A worker looks in its own deque, then the injection
+// queue, then steals, and after POOL_SPIN_ATTEMPTS empty rounds sleeps
+// briefly on a condition variable.
+//
+// A task that runs ms parks on a sorted sleeper list ordered by wake time instead of
+// holding its worker; whichever thread next looks for work resubmits the
+// tasks that are due, and idle workers sleep no later than the earliest.
+//
+// The dictionary is shared read-only. Prepared statements belong to one
+// connection and are not safe to step from two threads at once, so each
+// worker opens its own connection to the database file and prepares the
+// words it runs on it, once; before resuming a task the worker points the
+// task's VM at that connection and statement cache. Tasks the interpreter
+// runs itself while joining use the dictionary's own statements.
+//
+// Deque memory orders follow Lê, Pop, Cohen and Zappa Nardelli, "Correct
+// and Efficient Work-Stealing for Weak Memory Models" (PPoPP 2013).
+
+#define POOL_DEQUE_MASK (POOL_DEQUE_SIZE - 1)
+
+typedef struct {
+    int64_t top;      // Next task to steal
+    int64_t bottom;   // Next free slot at the owner's end
+    forth_task_t *tasks[POOL_DEQUE_SIZE];
+} pool_deque_t;
+
+typedef struct {
+    pthread_t thread;
+    int index;
+    pool_deque_t deque;
+    sqlite3 *db;
+    forth_stmt_cache_t *stmts;
+    uint64_t rng;
+} pool_worker_t;
+
+int pool_active = 0;
+
+static pool_worker_t *workers = NULL;
+static int worker_count = 0;
+static int stopping = 0;
+static int idle_workers = 0;
+static forth_vm_t *pool_parent = NULL;
+
+static pthread_mutex_t inject_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t work_available = PTHREAD_COND_INITIALIZER;
+static forth_task_t *inject_head = NULL;
+static forth_task_t *inject_tail = NULL;
+
+static pthread_mutex_t timer_lock = PTHREAD_MUTEX_INITIALIZER;
+static forth_task_t *pool_sleepers = NULL;  // Sorted by vm.wake_ns
+static uint64_t next_wake_ns = UINT64_MAX;  // Earliest wake time, read unlocked
+
+static __thread pool_worker_t *current_worker = NULL;
+
+// Deque operations; push and pop only from the owning worker
+static int deque_push(pool_deque_t *deque, forth_task_t *task) {
+    int64_t bottom = __atomic_load_n(&deque->bottom, __ATOMIC_RELAXED);
+    int64_t top = __atomic_load_n(&deque->top, __ATOMIC_ACQUIRE);
+    if (bottom - top >= POOL_DEQUE_SIZE) {
+        return -1;
+    }
+    __atomic_store_n(&deque->tasks[bottom & POOL_DEQUE_MASK], task, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    __atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELAXED);
+    return 0;
+}
+
+static forth_task_t *deque_pop(pool_deque_t *deque) {
+    int64_t bottom = __atomic_load_n(&deque->bottom, __ATOMIC_RELAXED) - 1;
+    __atomic_store_n(&deque->bottom, bottom, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    int64_t top = __atomic_load_n(&deque->top, __ATOMIC_RELAXED);
+
+    if (top > bottom) {
+        __atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELAXED);
+        return NULL;
+    }
+
+    forth_task_t *task = __atomic_load_n(&deque->tasks[bottom & POOL_DEQUE_MASK], __ATOMIC_RELAXED);
+    if (top == bottom) {
+        // Last task: race the thieves for it
+        if (!__atomic_compare_exchange_n(&deque->top, &top, top + 1, 0,
+                                         __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+            task = NULL;
+        }
+        __atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELAXED);
+    }
+    return task;
+}
+
+static forth_task_t *deque_steal(pool_deque_t *deque) {
+    int64_t top = __atomic_load_n(&deque->top, __ATOMIC_ACQUIRE);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    int64_t bottom = __atomic_load_n(&deque->bottom, __ATOMIC_ACQUIRE);
+    if (top >= bottom) {
+        return NULL;
+    }
+
+    forth_task_t *task = __atomic_load_n(&deque->tasks[top & POOL_DEQUE_MASK], __ATOMIC_RELAXED);
+    if (!__atomic_compare_exchange_n(&deque->top, &top, top + 1, 0,
+                                     __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+        return NULL;  // Lost to the owner or another thief
+    }
+    return task;
+}
+
+static void inject(forth_task_t *task) {
+    pthread_mutex_lock(&inject_lock);
+    task->next = NULL;
+    if (inject_tail) inject_tail->next = task;
+    else __atomic_store_n(&inject_head, task, __ATOMIC_RELAXED);
+    inject_tail = task;
+    if (idle_workers > 0) {
+        pthread_cond_signal(&work_available);
+    }
+    pthread_mutex_unlock(&inject_lock);
+}
+
+static forth_task_t *take_injected(void) {
+    if (!__atomic_load_n(&inject_head, __ATOMIC_RELAXED)) {
+        return NULL;
+    }
+    pthread_mutex_lock(&inject_lock);
+    forth_task_t *task = inject_head;
+    if (task) {
+        __atomic_store_n(&inject_head, task->next, __ATOMIC_RELAXED);
+        if (!inject_head) inject_tail = NULL;
+    }
+    pthread_mutex_unlock(&inject_lock);
+    return task;
+}
+
+// xorshift64 victim selection
+static forth_task_t *steal_any(uint64_t *rng) {
+    *rng ^= *rng << 13;
+    *rng ^= *rng >> 7;
+    *rng ^= *rng << 17;
+    int start = (int)(*rng % (uint64_t)worker_count);
+    for (int i = 0; i < worker_count; i++) {
+        pool_worker_t *victim = &workers[(start + i) % worker_count];
+        if (victim == current_worker) continue;
+        forth_task_t *task = deque_steal(&victim->deque);
+        if (task) return task;
+    }
+    return NULL;
+}
+
+// Park a sleeping task until its wake time, in wake order
+static void park_sleeping(forth_task_t *task) {
+    task->state = TASK_SLEEPING;
+    pthread_mutex_lock(&timer_lock);
+    forth_task_t **link = &pool_sleepers;
+    while (*link && (*link)->vm.wake_ns <= task->vm.wake_ns) {
+        link = &(*link)->next;
+    }
+    task->next = *link;
+    *link = task;
+    __atomic_store_n(&next_wake_ns, pool_sleepers->vm.wake_ns, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&timer_lock);
+
+    // An idle worker may be waiting past the new earliest wake time
+    if (__atomic_load_n(&idle_workers, __ATOMIC_RELAXED) > 0) {
+        pthread_mutex_lock(&inject_lock);
+        pthread_cond_signal(&work_available);
+        pthread_mutex_unlock(&inject_lock);
+    }
+}
+
+static void wake_due_tasks(void) {
+    if (__atomic_load_n(&next_wake_ns, __ATOMIC_RELAXED) > task_now_ns()) {
+        return;
+    }
+
+    pthread_mutex_lock(&timer_lock);
+    uint64_t now = task_now_ns();
+    forth_task_t *due = pool_sleepers;
+    forth_task_t **link = &pool_sleepers;
+    while (*link && (*link)->vm.wake_ns <= now) {
+        link = &(*link)->next;
+    }
+    pool_sleepers = *link;
+    *link = NULL;
+    __atomic_store_n(&next_wake_ns, pool_sleepers ? pool_sleepers->vm.wake_ns : UINT64_MAX,
+                     __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&timer_lock);
+
+    while (due) {
+        forth_task_t *task = due;
+        due = task->next;
+        task->vm.wake_ns = 0;
+        task->state = TASK_READY;
+        pool_submit(task);
+    }
+}
+
+static forth_task_t *find_task(void) {
+    static __thread uint64_t helper_rng = 0x9E3779B97F4A7C15ull;
+    forth_task_t *task = NULL;
+    wake_due_tasks();
+    if (current_worker) {
+        task = deque_pop(&current_worker->deque);
+    }
+    if (!task) task = take_injected();
+    if (!task) task = steal_any(current_worker ? &current_worker->rng : &helper_rng);
+    return task;
+}
+
+// Resume a task on the calling thread until it yields, parks or finishes.
+// pause puts it back in the queue; ms parks it until it is due.
+static void run_task(forth_task_t *task) {
+    forth_vm_t *current = forth_current();
+    sqlite3 *db = current_worker ? current_worker->db : pool_parent->db;
+    forth_stmt_cache_t *stmts = current_worker ? current_worker->stmts : NULL;
+    if (task->vm.snapshot) {
+        snapshot_rehome(&task->vm, db, stmts);  // Stays on its snapshot
+    } else {
+        task->vm.db = db;
+        task->vm.stmts = stmts;
+    }
+
+    task_state_t state = task_resume(task);
+    if (state == TASK_SLEEPING) {
+        park_sleeping(task);
+    } else if (state == TASK_READY) {
+        task->state = TASK_READY;
+        pool_submit(task);
+    }
+
+    forth_set_current(current);
+}
+
+void pool_submit(forth_task_t *task) {
+    // A full deque overflows into the injection queue
+    if (current_worker && deque_push(&current_worker->deque, task) == 0) {
+        if (__atomic_load_n(&idle_workers, __ATOMIC_RELAXED) > 0) {
+            pthread_mutex_lock(&inject_lock);
+            pthread_cond_signal(&work_available);
+            pthread_mutex_unlock(&inject_lock);
+        }
+        return;
+    }
+    inject(task);
+}
+
+int pool_help(int attempt) {
+    forth_task_t *task = find_task();
+    if (task) {
+        run_task(task);
+        return 1;
+    }
+
+    // The task being waited for is running elsewhere
+    if (attempt < POOL_SPIN_ATTEMPTS) {
+        sched_yield();
+    } else {
+        struct timespec ts = {0, 50000};
+        nanosleep(&ts, NULL);
+    }
+    return 0;
+}
+
+void pool_wait_idle(void) {
+    for (int attempt = 0; task_count() > task_parked_count(); attempt++) {
+        if (pool_help(attempt)) attempt = 0;
+    }
+}
+
+static void *worker_main(void *arg) {
+    pool_worker_t *worker = arg;
+    current_worker = worker;
+    rcu_register_thread();
+
+    int empty_rounds = 0;
+    while (!__atomic_load_n(&stopping, __ATOMIC_ACQUIRE)) {
+        // Between tasks a worker holds no word definitions
+        rcu_quiescent();
+
+        forth_task_t *task = find_task();
+        if (task) {
+            run_task(task);
+            empty_rounds = 0;
+            continue;
+        }
+
+        if (++empty_rounds < POOL_SPIN_ATTEMPTS) {
+            sched_yield();
+            continue;
+        }
+
+        // Deque pushes signal only when someone is idle, so wake up now and
+        // then to look for steals without relying on it, and no later than
+        // the next sleeping task is due
+        long wait_ns = 1000000;
+        uint64_t wake = __atomic_load_n(&next_wake_ns, __ATOMIC_RELAXED);
+        uint64_t now = task_now_ns();
+        if (wake <= now) continue;
+        if (wake - now < (uint64_t)wait_ns) wait_ns = (long)(wake - now);
+
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += wait_ns;
+        if (deadline.tv_nsec >= 1000000000) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000;
+        }
+        pthread_mutex_lock(&inject_lock);
+        __atomic_add_fetch(&idle_workers, 1, __ATOMIC_RELAXED);
+        if (!inject_head && !stopping) {
+            rcu_thread_offline();
+            pthread_cond_timedwait(&work_available, &inject_lock, &deadline);
+            rcu_thread_online();
+        }
+        __atomic_sub_fetch(&idle_workers, 1, __ATOMIC_RELAXED);
+        pthread_mutex_unlock(&inject_lock);
+        empty_rounds = 0;
+    }
+
+    rcu_unregister_thread();
+    return NULL;
+}
+
+static void close_worker(pool_worker_t *worker) {
+    if (worker->stmts) {
+        for (int i = 0; i < MAX_DICT_SIZE; i++) {
+            sqlite3_finalize(worker->stmts[i].stmt);
+        }
+        free(worker->stmts);
+    }
+    sqlite3_close(worker->db);
+}
+
+int pool_start(forth_vm_t *vm, int count) {
+    if (count < 1 || count > POOL_MAX_WORKERS) {
+        fprintf(stderr, "Worker count must be between 1 and %d\n", POOL_MAX_WORKERS);
+        return -1;
+    }
+
+    const char *path = sqlite3_db_filename(vm->db, "main");
+    if (!path || !path[0]) {
+        fprintf(stderr, "Worker pool needs an on-disk database\n");
+        return -1;
+    }
+
+    workers = calloc(count, sizeof(pool_worker_t));
+    if (!workers) return -1;
+
+    for (int i = 0; i < count; i++) {
+        pool_worker_t *worker = &workers[i];
+        worker->index = i;
+        worker->rng = 0x9E3779B97F4A7C15ull * (uint64_t)(i + 1);
+        worker->stmts = calloc(MAX_DICT_SIZE, sizeof(forth_stmt_cache_t));
+        if (!worker->stmts ||
+            sqlite3_open(path, &worker->db) != SQLITE_OK) {
+            fprintf(stderr, "Failed to open worker connection: %s\n",
+                    worker->db ? sqlite3_errmsg(worker->db) : "out of memory");
+            for (int j = 0; j <= i; j++) close_worker(&workers[j]);
+            free(workers);
+            workers = NULL;
+            return -1;
+        }
+        sqlite3_busy_timeout(worker->db, POOL_BUSY_TIMEOUT_MS);
+        if (budget_active) budget_attach(worker->db);
+        trace_connection(worker->db);
+    }
+
+    // Writers on different connections now wait for each other
+    sqlite3_busy_timeout(vm->db, POOL_BUSY_TIMEOUT_MS);
+
+    pool_parent = vm;
+    worker_count = count;
+    stopping = 0;
+    pool_active = 1;
+
+    for (int i = 0; i < count; i++) {
+        if (pthread_create(&workers[i].thread, NULL, worker_main, &workers[i]) != 0) {
+            fprintf(stderr, "Failed to start worker %d\n", i);
+            for (int j = i; j < count; j++) close_worker(&workers[j]);
+            worker_count = i;
+            pool_stop();
+            return -1;
+        }
+    }
+    return 0;
+}
+
+void pool_stop(void) {
+    if (!pool_active) return;
+
+    pool_wait_idle();
+
+    pthread_mutex_lock(&inject_lock);
+    __atomic_store_n(&stopping, 1, __ATOMIC_RELEASE);
+    pthread_cond_broadcast(&work_available);
+    pthread_mutex_unlock(&inject_lock);
+
+    for (int i = 0; i < worker_count; i++) {
+        pthread_join(workers[i].thread, NULL);
+    }
+    for (int i = 0; i < worker_count; i++) {
+        close_worker(&workers[i]);
+    }
+
+    free(workers);
+    workers = NULL;
+    worker_count = 0;
+    pool_active = 0;
+}
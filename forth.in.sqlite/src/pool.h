@@ -0,0 +1,40 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include "forth.h"
+#include "task.h"
+
+#define POOL_MAX_WORKERS 64
+
+// Tasks each worker's deque holds; a worker whose deque is full queues new
+// tasks on the shared injection queue instead
+#define POOL_DEQUE_SIZE 4096
+
+// Idle workers spin this many times looking for work before sleeping
+#define POOL_SPIN_ATTEMPTS 64
+
+// How long a connection waits for another's write lock
+#define POOL_BUSY_TIMEOUT_MS 5000
+
+// Nonzero while workers are running; spawn{ hands tasks to the pool then
+extern int pool_active;
+
+// Start `workers` threads, each with its own connection to vm's database
+// file and its own statement cache for the shared dictionary.
+int pool_start(forth_vm_t *vm, int workers);
+
+// Wait for every task to finish or park on a channel, then stop the workers
+void pool_stop(void);
+
+// Queue a started task: onto the calling worker's deque, or the shared
+// injection queue from any other thread
+void pool_submit(forth_task_t *task);
+
+// Run one queued task on the calling thread, if one can be found; used by
+// threads waiting in join. Backs off when nothing was found.
+int pool_help(int attempt);
+
+// Help until no task is left that could run
+void pool_wait_idle(void);
+
+#endif
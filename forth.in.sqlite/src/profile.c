@@ -0,0 +1,209 @@
+#define _POSIX_C_SOURCE 199309L
+#include <time.h>
+#include "profile.h"
+#include "report.h"
+
+// Per-word execution profiler.
+//
+// Every call is counted. Timing is sampled to keep the overhead low: one
+// top-level call in `period` is timed, together with everything it calls,
+// and the timed ticks are scaled by the period when reporting. A period of
+// 1 times every call exactly. Timestamps come from the cheapest clock
+// available (the TSC on x86) and are converted to nanoseconds only when
+// reporting, using the tick rate observed since profile_enable().
+
+int profile_active = 0;
+
+typedef struct {
+    int word_idx;
+    uint64_t start;
+    uint64_t child_ticks;
+} profile_frame_t;
+
+static profile_entry_t entries[MAX_DICT_SIZE];
+static profile_frame_t frames[PROFILE_MAX_DEPTH];
+static int frame_depth = 0;
+static int frames_dropped = 0;
+
+static int sample_period = 1;
+static int sample_countdown = 0;
+static int timing = 0;  // Inside a timed call tree
+
+static uint64_t enabled_ticks;
+static uint64_t enabled_ns;
+
+static uint64_t monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+static inline uint64_t profile_ticks(void) {
+    return __rdtsc();
+}
+#else
+static inline uint64_t profile_ticks(void) {
+    return monotonic_ns();
+}
+#endif
+
+// Nanoseconds per tick since profiling was enabled
+static double ns_per_tick(void) {
+    uint64_t ticks = profile_ticks() - enabled_ticks;
+    uint64_t ns = monotonic_ns() - enabled_ns;
+    return ticks ? (double)ns / ticks : 1.0;
+}
+
+int profile_enable(int period) {
+    if (period < 1) {
+        forth_error("Profile sample period must be at least 1");
+        return -1;
+    }
+
+    profile_reset();
+    sample_period = period;
+    enabled_ns = monotonic_ns();
+    enabled_ticks = profile_ticks();
+    profile_active = 1;
+    return 0;
+}
+
+void profile_disable(void) {
+    profile_active = 0;
+}
+
+void profile_reset(void) {
+    memset(entries, 0, sizeof(entries));
+    frame_depth = 0;
+    frames_dropped = 0;
+    sample_countdown = 0;
+    timing = 0;
+}
+
+void profile_enter(int word_idx, int top_level) {
+    entries[word_idx].calls++;
+
+    if (!timing) {
+        // Only top-level calls are sampled; nested ones follow their caller
+        if (!top_level || --sample_countdown > 0) {
+            return;
+        }
+        sample_countdown = sample_period;
+        timing = 1;
+    }
+
+    if (frame_depth >= PROFILE_MAX_DEPTH) {
+        frames_dropped++;
+        return;
+    }
+
+    profile_frame_t *frame = &frames[frame_depth++];
+    frame->word_idx = word_idx;
+    frame->child_ticks = 0;
+    entries[word_idx].active++;
+    frame->start = profile_ticks();
+}
+
+void profile_exit(int word_idx) {
+    if (!timing) {
+        return;
+    }
+
+    uint64_t now = profile_ticks();
+
+    if (frames_dropped > 0) {
+        frames_dropped--;
+        return;
+    }
+    if (frame_depth == 0 || frames[frame_depth - 1].word_idx != word_idx) {
+        return;
+    }
+
+    profile_frame_t *frame = &frames[--frame_depth];
+    uint64_t total = now - frame->start;
+    profile_entry_t *entry = &entries[word_idx];
+
+    entry->self_ticks += total - frame->child_ticks;
+    if (--entry->active == 0) {
+        entry->total_ticks += total;
+    }
+    if (frame_depth > 0) {
+        frames[frame_depth - 1].child_ticks += total;
+    } else {
+        timing = 0;
+    }
+}
+
+static int compare_self(const void *a, const void *b) {
+    const profile_entry_t *x = &entries[*(const int*)a];
+    const profile_entry_t *y = &entries[*(const int*)b];
+    return (y->self_ticks > x->self_ticks) - (y->self_ticks < x->self_ticks);
+}
+
+void profile_report(forth_vm_t *vm, FILE *out) {
+    int *order = malloc(dict_size(vm) * sizeof(int));
+    int count = 0;
+    if (!order) return;
+    uint64_t all_self = 0;
+
+    for (int i = 0; i < dict_size(vm); i++) {
+        if (entries[i].calls > 0) {
+            order[count++] = i;
+            all_self += entries[i].self_ticks;
+        }
+    }
+
+    if (count == 0) {
+        fprintf(out, "No profile data%s\n", profile_active ? "" : " (start with --profile)");
+        free(order);
+        return;
+    }
+
+    if (sample_period > 1) {
+        fprintf(out, "Times estimated from 1 in %d calls\n", sample_period);
+    }
+
+    qsort(order, count, sizeof(int), compare_self);
+    double scale = ns_per_tick() * sample_period;
+
+    fprintf(out, "%-20s %10s %12s %12s %7s\n", "word", "calls", "self(us)", "total(us)", "self%");
+    for (int i = 0; i < count; i++) {
+        profile_entry_t *entry = &entries[order[i]];
+        fprintf(out, "%-20s %10llu %12.1f %12.1f %6.1f%%\n",
+                forth_word(vm, order[i])->name,
+                (unsigned long long)entry->calls,
+                entry->self_ticks * scale / 1e3,
+                entry->total_ticks * scale / 1e3,
+                all_self ? 100.0 * entry->self_ticks / all_self : 0.0);
+    }
+    free(order);
+}
+
+static double flush_scale;
+
+static int bind_profile_row(sqlite3_stmt *stmt, int word_idx) {
+    profile_entry_t *entry = &entries[word_idx];
+    if (entry->calls == 0) return 0;
+
+    sqlite3_bind_int64(stmt, 3, (sqlite3_int64)entry->calls);
+    sqlite3_bind_int64(stmt, 4, (sqlite3_int64)(entry->self_ticks * flush_scale));
+    sqlite3_bind_int64(stmt, 5, (sqlite3_int64)(entry->total_ticks * flush_scale));
+    return 1;
+}
+
+// Append this run's profile to the forth_profile table
+int profile_flush(forth_vm_t *vm) {
+    flush_scale = ns_per_tick() * sample_period;
+    return report_flush(vm, "profile",
+        "CREATE TABLE IF NOT EXISTS forth_profile ("
+        "run INTEGER,"
+        "name TEXT,"
+        "calls INTEGER,"
+        "self_ns INTEGER,"
+        "total_ns INTEGER);",
+        "INSERT INTO forth_profile (run, name, calls, self_ns, total_ns) "
+        "VALUES (?, ?, ?, ?, ?)",
+        bind_profile_row);
+}
@@ -0,0 +1,37 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include "forth.h"
+
+// Maximum nesting of profiled word calls
+#define PROFILE_MAX_DEPTH 256
+
+// Default sampling period for timing (1 = time every call)
+#define PROFILE_DEFAULT_PERIOD 16
+
+// Per-word profile counters, indexed like the dictionary
+typedef struct {
+    uint64_t calls;
+    uint64_t self_ticks;
+    uint64_t total_ticks;
+    int active;  // Recursion depth, so inclusive time is only counted once
+} profile_entry_t;
+
+// Checked before every word call; zero unless profiling was enabled
+extern int profile_active;
+
+// Profiler control
+int profile_enable(int period);
+void profile_disable(void);
+void profile_reset(void);
+
+// Word entry/exit hooks called from forth_execute_word; top_level is
+// set for calls made straight from a line, request or task, not a word
+void profile_enter(int word_idx, int top_level);
+void profile_exit(int word_idx);
+
+// Reporting
+void profile_report(forth_vm_t *vm, FILE *out);
+int profile_flush(forth_vm_t *vm);
+
+#endif
@@ -0,0 +1,67 @@
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#include <stdint.h>
+#include <string.h>
+
+// Binary framing for server mode.
+//
+// A client switches its connection to frames by sending PROTOCOL_MAGIC as
+// its first four bytes; otherwise the connection speaks text lines. All
+// integers are little-endian.
+//
+// Request:  u32 length | u8 type | payload            (length excludes itself)
+//   FRAME_EVAL    payload: source text, interpreted like one text line
+//   FRAME_CALL    payload: u32 word id | u16 count | count values
+//   FRAME_LOOKUP  payload: word name; answered with the word id
+//
+// Response: u32 length | u8 status | u8 reserved | u16 count | u32 output
+//           length | output bytes | count values
+//
+// A request's arguments are pushed before it runs and everything it leaves
+// above the stack depth it started from is popped and returned, so each
+// request behaves like a function call. Responses come back in request
+// order, and clients may pipeline any number of requests.
+
+#define PROTOCOL_MAGIC "\0FB1"
+#define PROTOCOL_MAGIC_LEN 4
+
+// Largest frame accepted, length field excluded
+#define PROTOCOL_MAX_FRAME 4096
+
+#define FRAME_EVAL   1
+#define FRAME_CALL   2
+#define FRAME_LOOKUP 3
+
+#define FRAME_STATUS_OK    0
+#define FRAME_STATUS_ERROR 1
+
+// Typed stack values: a tag byte followed by the value
+#define VALUE_INT 1  // i32
+#define VALUE_INT_SIZE 5
+
+#define FRAME_REQUEST_HEADER 5    // length, type
+#define FRAME_RESPONSE_HEADER 12  // length, status, reserved, count, output length
+
+static inline void protocol_put_u16(unsigned char *p, uint16_t v) {
+    p[0] = v & 0xff;
+    p[1] = v >> 8;
+}
+
+static inline void protocol_put_u32(unsigned char *p, uint32_t v) {
+    p[0] = v & 0xff;
+    p[1] = (v >> 8) & 0xff;
+    p[2] = (v >> 16) & 0xff;
+    p[3] = v >> 24;
+}
+
+static inline uint16_t protocol_get_u16(const unsigned char *p) {
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static inline uint32_t protocol_get_u32(const unsigned char *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) |
+           ((uint32_t)p[3] << 24);
+}
+
+#endif
@@ -0,0 +1,174 @@
+#include "queue.h"
+
+// Durable job queues.
+//
+// visible_at is in milliseconds since the epoch. Claims take the visible
+// jobs of a queue in the order they became visible, which the index
+// serves without sorting; a claim pushes visible_at past the timeout and
+// counts the attempt.
+
+#define QUEUE_NOW_MS "CAST((julianday('now') - 2440587.5) * 86400000 AS INTEGER)"
+
+static const char *table_sql =
+    "CREATE TABLE IF NOT EXISTS forth_jobs ("
+    "id INTEGER PRIMARY KEY, "
+    "queue INTEGER NOT NULL, "
+    "payload INTEGER NOT NULL, "
+    "visible_at INTEGER NOT NULL, "
+    "attempts INTEGER NOT NULL DEFAULT 0);"
+    "CREATE INDEX IF NOT EXISTS forth_jobs_ready ON forth_jobs (queue, visible_at)";
+
+// Dictionary slots of the SQL words the primitives run, once defined
+static int claim_word = -1;
+static int ack_batch_word = -1;
+
+// Prepare sql on vm's database and define it as an SQL word
+static int define_sql(forth_vm_t *vm, const char *name, const char *sql) {
+    sqlite3_stmt *stmt = NULL;
+    if (sqlite3_prepare_v2(vm->db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+        fprintf(stderr, "Failed to prepare %s: %s\n", name, sqlite3_errmsg(vm->db));
+        sqlite3_finalize(stmt);
+        return -1;
+    }
+    return add_word(vm, name, WORD_SQL, stmt);
+}
+
+int queue_init(forth_vm_t *vm) {
+    if (sqlite3_exec(vm->db, table_sql, NULL, NULL, NULL) != SQLITE_OK) {
+        fprintf(stderr, "Failed to create jobs table: %s\n", sqlite3_errmsg(vm->db));
+        return -1;
+    }
+
+    // ( payload queue -- id )
+    if (define_sql(vm, "enqueue",
+                   "INSERT INTO forth_jobs (queue, payload, visible_at) "
+                   "VALUES (?2, ?1, " QUEUE_NOW_MS ") RETURNING id") < 0) {
+        return -1;
+    }
+
+    // ( n queue ms -- id1 payload1 ... )
+    int claim = define_sql(vm, "(dequeue-batch)",
+        "UPDATE forth_jobs SET visible_at = " QUEUE_NOW_MS " + ?3, attempts = attempts + 1 "
+        "WHERE id IN (SELECT id FROM forth_jobs WHERE queue = ?2 AND visible_at <= " QUEUE_NOW_MS " "
+        "ORDER BY visible_at LIMIT ?1) RETURNING id, payload");
+    if (claim < 0) return -1;
+
+    // ( id -- )
+    if (define_sql(vm, "ack", "DELETE FROM forth_jobs WHERE id = ?1") < 0) {
+        return -1;
+    }
+
+    // ( id1 ... idN -- ) for N = QUEUE_MAX_BATCH; short batches repeat an id
+    char sql[64 + QUEUE_MAX_BATCH * 5];
+    int len = snprintf(sql, sizeof(sql), "DELETE FROM forth_jobs WHERE id IN (");
+    for (int i = 1; i <= QUEUE_MAX_BATCH; i++) {
+        len += snprintf(sql + len, sizeof(sql) - len, i > 1 ? ", ?%d" : "?%d", i);
+    }
+    snprintf(sql + len, sizeof(sql) - len, ")");
+    int ack_batch = define_sql(vm, "(ack-batch)", sql);
+    if (ack_batch < 0) return -1;
+
+    // ( queue -- n ): jobs not acked yet, claimed or not
+    if (define_sql(vm, "job-count", "SELECT count(*) FROM forth_jobs WHERE queue = ?1") < 0) {
+        return -1;
+    }
+
+    // Tasks on pool workers read these
+    __atomic_store_n(&claim_word, claim, __ATOMIC_RELEASE);
+    __atomic_store_n(&ack_batch_word, ack_batch, __ATOMIC_RELEASE);
+    return 0;
+}
+
+// Slot of one of the queue's SQL words; -1, reported, before queue-init
+static int queue_word(int *slot) {
+    int word_idx = __atomic_load_n(slot, __ATOMIC_ACQUIRE);
+    if (word_idx < 0) {
+        forth_error("No job queue: run queue-init first");
+    }
+    return word_idx;
+}
+
+// queue-init ( -- ): create the jobs table if needed and define the queue
+// words
+void prim_queue_init(void) {
+    forth_vm_t *vm = forth_current();
+
+    // Words are prepared on the dictionary's own connection
+    if (vm->stmts) {
+        forth_error("queue-init must run on the interpreter");
+        return;
+    }
+    if (__atomic_load_n(&claim_word, __ATOMIC_ACQUIRE) >= 0) return;  // Defined already
+    queue_init(vm);
+}
+
+// dequeue-batch ( n queue ms -- id1 payload1 ... count ): claim up to n
+// jobs for ms milliseconds
+void prim_dequeue_batch(void) {
+    forth_vm_t *vm = forth_current();
+    int claim = queue_word(&claim_word);
+    if (claim < 0) return;
+
+    // Run again after a group commit, the arguments are gone already
+    int base = vm->stack_ptr;
+    if (!vm->commit_future) {
+        if (stack_depth(vm) < 3) {
+            forth_error("Stack underflow");
+            return;
+        }
+        int n = vm->data_stack[vm->stack_ptr - 3];
+        if (n < 0 || n > QUEUE_MAX_BATCH) {
+            forth_error("Batch size out of range");
+            return;
+        }
+        base -= 3;
+    }
+
+    forth_execute_word(vm, claim);
+    if (vm->commit_future || vm->budget_exhausted) {
+        return;  // Parked until the commit; runs again
+    }
+    push(vm, (vm->stack_ptr - base) / 2);
+}
+
+// ack-batch ( id1 payload1 ... count -- ): ack a batch as dequeue-batch
+// left it, in one statement. The stack is left alone if it is not one.
+void prim_ack_batch(void) {
+    forth_vm_t *vm = forth_current();
+    int ack_batch = queue_word(&ack_batch_word);
+    if (ack_batch < 0) return;
+
+    if (!vm->commit_future) {
+        if (stack_depth(vm) < 1) {
+            forth_error("Stack underflow");
+            return;
+        }
+        int count = vm->data_stack[vm->stack_ptr - 1];
+        if (count < 0 || count > QUEUE_MAX_BATCH) {
+            forth_error("Batch size out of range");
+            return;
+        }
+        int below = stack_depth(vm) - (count * 2 + 1);
+        if (below < 0) {
+            forth_error("Stack underflow");
+            return;
+        }
+        if (count > 0 && below + QUEUE_MAX_BATCH > STACK_SIZE) {
+            forth_error("Stack overflow");
+            return;
+        }
+
+        pop(vm);
+        if (count == 0) return;
+        int ids[QUEUE_MAX_BATCH];
+        for (int i = count - 1; i >= 0; i--) {
+            pop(vm);
+            ids[i] = pop(vm);
+        }
+        for (int i = 0; i < QUEUE_MAX_BATCH; i++) {
+            push(vm, ids[i < count ? i : 0]);
+        }
+    }
+
+    forth_execute_word(vm, ack_batch);
+}
@@ -0,0 +1,32 @@
+#ifndef QUEUE_H
+#define QUEUE_H
+
+#include "forth.h"
+
+// Durable job queues.
+//
+// Jobs are rows of the forth_jobs table: an integer payload on a numbered
+// queue. `dequeue-batch` claims up to n visible jobs in one UPDATE ...
+// RETURNING statement, which hides them from other consumers for a
+// visibility timeout; a job that is not acked by then becomes visible
+// again and is claimed by the next consumer, so every job runs at least
+// once. `ack` and `ack-batch` delete finished jobs.
+//
+// The statements are SQL words in the dictionary, so they are prepared
+// once per connection like any other, run on pool workers' connections,
+// and writes made by tasks are committed in groups with --group-commit.
+// Queues are opt-in: `queue-init` creates the table, if it is not there,
+// and defines the words for the session.
+
+// Jobs claimed by one dequeue-batch at most
+#define QUEUE_MAX_BATCH 32
+
+// Create the jobs table on vm's database and define the queue words
+int queue_init(forth_vm_t *vm);
+
+// Primitives
+void prim_queue_init(void);
+void prim_dequeue_batch(void);
+void prim_ack_batch(void);
+
+#endif
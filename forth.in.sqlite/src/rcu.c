@@ -0,0 +1,155 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include "rcu.h"
+
+// Epoch-based implementation.
+//
+// A global epoch advances on every retire, and each retired object is
+// tagged with the epoch it was retired in. A quiescent thread records the
+// current epoch, so an object can be freed once every online thread has
+// recorded its epoch or a later one: each of them has since passed a point
+// where it held no references, after the object was unpublished.
+
+typedef struct {
+    uint64_t epoch;  // Last quiescent point
+    int online;
+    int used;
+} rcu_thread_t;
+
+typedef struct rcu_retired {
+    void *obj;
+    void (*free_fn)(void *obj);
+    uint64_t epoch;
+    struct rcu_retired *next;
+} rcu_retired_t;
+
+static rcu_thread_t threads[RCU_MAX_THREADS];
+static uint64_t global_epoch = 0;
+
+static pthread_mutex_t rcu_lock = PTHREAD_MUTEX_INITIALIZER;
+static rcu_retired_t *retired = NULL;
+static int retired_count = 0;
+
+static __thread rcu_thread_t *self = NULL;
+
+int rcu_register_thread(void) {
+    if (self) return 0;
+
+    pthread_mutex_lock(&rcu_lock);
+    for (int i = 0; i < RCU_MAX_THREADS; i++) {
+        if (!threads[i].used) {
+            self = &threads[i];
+            self->used = 1;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&rcu_lock);
+
+    if (!self) return -1;
+    rcu_thread_online();
+    return 0;
+}
+
+void rcu_unregister_thread(void) {
+    if (!self) return;
+    rcu_thread_offline();
+    pthread_mutex_lock(&rcu_lock);
+    self->used = 0;
+    pthread_mutex_unlock(&rcu_lock);
+    self = NULL;
+}
+
+void rcu_quiescent(void) {
+    if (!self) return;
+    __atomic_store_n(&self->epoch, __atomic_load_n(&global_epoch, __ATOMIC_ACQUIRE),
+                     __ATOMIC_RELEASE);
+}
+
+void rcu_thread_offline(void) {
+    if (!self) return;
+    __atomic_store_n(&self->online, 0, __ATOMIC_RELEASE);
+}
+
+void rcu_thread_online(void) {
+    if (!self) return;
+    __atomic_store_n(&self->epoch, __atomic_load_n(&global_epoch, __ATOMIC_SEQ_CST),
+                     __ATOMIC_SEQ_CST);
+    __atomic_store_n(&self->online, 1, __ATOMIC_SEQ_CST);
+}
+
+void rcu_retire(void *obj, void (*free_fn)(void *obj)) {
+    rcu_retired_t *entry = malloc(sizeof(rcu_retired_t));
+    if (!entry) {
+        return;  // Leak rather than free under a reader
+    }
+    entry->obj = obj;
+    entry->free_fn = free_fn;
+
+    pthread_mutex_lock(&rcu_lock);
+    entry->epoch = __atomic_add_fetch(&global_epoch, 1, __ATOMIC_SEQ_CST);
+    entry->next = retired;
+    retired = entry;
+    retired_count++;
+    pthread_mutex_unlock(&rcu_lock);
+}
+
+// Oldest epoch an online thread may still be reading in
+static uint64_t safe_epoch(void) {
+    uint64_t oldest = __atomic_load_n(&global_epoch, __ATOMIC_SEQ_CST);
+    for (int i = 0; i < RCU_MAX_THREADS; i++) {
+        if (!__atomic_load_n(&threads[i].used, __ATOMIC_ACQUIRE) ||
+            !__atomic_load_n(&threads[i].online, __ATOMIC_SEQ_CST)) {
+            continue;
+        }
+        uint64_t epoch = __atomic_load_n(&threads[i].epoch, __ATOMIC_ACQUIRE);
+        if (epoch < oldest) oldest = epoch;
+    }
+    return oldest;
+}
+
+int rcu_reclaim(void) {
+    if (!__atomic_load_n(&retired, __ATOMIC_RELAXED)) {
+        return 0;
+    }
+
+    pthread_mutex_lock(&rcu_lock);
+    uint64_t safe = safe_epoch();
+    rcu_retired_t *ready = NULL;
+    rcu_retired_t **link = &retired;
+    while (*link) {
+        rcu_retired_t *entry = *link;
+        if (entry->epoch <= safe) {
+            *link = entry->next;
+            entry->next = ready;
+            ready = entry;
+            retired_count--;
+        } else {
+            link = &entry->next;
+        }
+    }
+    int pending = retired_count;
+    pthread_mutex_unlock(&rcu_lock);
+
+    while (ready) {
+        rcu_retired_t *entry = ready;
+        ready = entry->next;
+        entry->free_fn(entry->obj);
+        free(entry);
+    }
+    return pending;
+}
+
+void rcu_reclaim_all(void) {
+    pthread_mutex_lock(&rcu_lock);
+    rcu_retired_t *entry = retired;
+    retired = NULL;
+    retired_count = 0;
+    pthread_mutex_unlock(&rcu_lock);
+
+    while (entry) {
+        rcu_retired_t *next = entry->next;
+        entry->free_fn(entry->obj);
+        free(entry);
+        entry = next;
+    }
+}
@@ -0,0 +1,35 @@
+#ifndef RCU_H
+#define RCU_H
+
+#include <stdint.h>
+
+// Deferred reclamation for data read without locks.
+//
+// Writers unpublish an object (replace the pointer readers load) and hand
+// it to rcu_retire; it is freed once every registered thread has passed a
+// quiescent point, where it holds no pointer it loaded before. Threads
+// announce quiescent points between units of work and go offline while
+// they block, so that a thread waiting for input never holds reclamation
+// up.
+
+#define RCU_MAX_THREADS 256
+
+// Per-thread registration; idempotent, and threads start online
+int rcu_register_thread(void);
+void rcu_unregister_thread(void);
+
+// Called by readers between units of work; one load and one store
+void rcu_quiescent(void);
+void rcu_thread_offline(void);
+void rcu_thread_online(void);
+
+// Free obj with free_fn once no reader can still hold it
+void rcu_retire(void *obj, void (*free_fn)(void *obj));
+
+// Free what has become safe to free; returns the number still pending
+int rcu_reclaim(void);
+
+// Free everything pending; only when no other thread reads any more
+void rcu_reclaim_all(void);
+
+#endif
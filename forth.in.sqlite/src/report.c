@@ -0,0 +1,67 @@
+#include <time.h>
+#include "report.h"
+
+// This process's row in forth_runs, once a report has been saved
+static sqlite3_int64 run_id = 0;
+
+static void report_error(const char *format, const char *what) {
+    char msg[128];
+    snprintf(msg, sizeof(msg), format, what);
+    forth_error(msg);
+}
+
+// Callers are inside the report's transaction
+static sqlite3_int64 report_run_id(forth_vm_t *vm) {
+    if (run_id) {
+        return run_id;
+    }
+
+    sqlite3_stmt *stmt;
+    if (sqlite3_exec(vm->db, REPORT_RUNS_TABLE_SQL, NULL, NULL, NULL) != SQLITE_OK ||
+        sqlite3_prepare_v2(vm->db, "INSERT INTO forth_runs (started) VALUES (?1)",
+                           -1, &stmt, NULL) != SQLITE_OK) {
+        return 0;
+    }
+    sqlite3_bind_int64(stmt, 1, (sqlite3_int64)time(NULL));
+    if (sqlite3_step(stmt) == SQLITE_DONE) {
+        run_id = sqlite3_last_insert_rowid(vm->db);
+    }
+    sqlite3_finalize(stmt);
+    return run_id;
+}
+
+int report_flush(forth_vm_t *vm, const char *what, const char *create_sql,
+                 const char *insert_sql, report_bind_fn bind) {
+    if (sqlite3_exec(vm->db, create_sql, NULL, NULL, NULL) != SQLITE_OK) {
+        report_error("Failed to create %s table", what);
+        return -1;
+    }
+
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(vm->db, insert_sql, -1, &stmt, NULL) != SQLITE_OK) {
+        report_error("Failed to prepare %s insert", what);
+        return -1;
+    }
+
+    sqlite3_exec(vm->db, "BEGIN", NULL, NULL, NULL);
+    sqlite3_int64 run = report_run_id(vm);
+    if (!run) {
+        report_error("Failed to record %s run", what);
+        sqlite3_exec(vm->db, "ROLLBACK", NULL, NULL, NULL);
+        sqlite3_finalize(stmt);
+        return -1;
+    }
+
+    for (int i = 0; i < dict_size(vm); i++) {
+        if (!bind(stmt, i)) continue;
+
+        sqlite3_bind_int64(stmt, 1, run);
+        sqlite3_bind_text(stmt, 2, forth_word(vm, i)->name, -1, SQLITE_STATIC);
+        sqlite3_step(stmt);
+        sqlite3_reset(stmt);
+    }
+    sqlite3_exec(vm->db, "COMMIT", NULL, NULL, NULL);
+
+    sqlite3_finalize(stmt);
+    return 0;
+}
@@ -0,0 +1,27 @@
+#ifndef REPORT_H
+#define REPORT_H
+
+#include "forth.h"
+
+// Per-word report tables.
+//
+// --profile, --stats and --perf each append one row per word to a table
+// at exit. The rows of one process share a run id, an autoincrement key
+// of forth_runs, so runs started within the same second stay apart and
+// the three tables join on it.
+
+#define REPORT_RUNS_TABLE_SQL \
+    "CREATE TABLE IF NOT EXISTS forth_runs (" \
+    "run INTEGER PRIMARY KEY AUTOINCREMENT, " \
+    "started INTEGER NOT NULL);"
+
+// Bind the columns of word_idx's row from ?3 on; returns 0 to skip the
+// word. ?1 is the run id and ?2 the word's name.
+typedef int (*report_bind_fn)(sqlite3_stmt *stmt, int word_idx);
+
+// Create table with create_sql and insert a row for every word that bind
+// does not skip, in one transaction; what names the report in errors
+int report_flush(forth_vm_t *vm, const char *what, const char *create_sql,
+                 const char *insert_sql, report_bind_fn bind);
+
+#endif
@@ -0,0 +1,164 @@
+#define _GNU_SOURCE
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include "sample.h"
+
+// Sampling profiler.
+//
+// SIGPROF fires every 1/hz seconds of the interpreter thread's CPU time.
+// The timer is that thread's own and signals only it, so the handler never
+// runs on pool, I/O, shard or other threads, and never runs twice at once.
+// It copies the VM return stack into a fixed open-addressing table of
+// distinct stacks, so it never allocates or locks. Stacks are written in the folded format
+// ("outer;inner count" per line) that flame graph tools read. Samples taken
+// between words are attributed to the interpreter itself.
+
+typedef struct {
+    uint32_t hash;
+    int depth;
+    int frames[SAMPLE_MAX_DEPTH];
+    uint64_t count;
+} sample_stack_t;
+
+static sample_stack_t stacks[SAMPLE_MAX_STACKS];
+static forth_vm_t *volatile sampled_vm = NULL;
+static volatile uint64_t samples_total = 0;
+static volatile uint64_t samples_dropped = 0;
+static timer_t sample_timer;
+static int timer_armed = 0;
+
+// Older C libraries only name the field in the kernel's headers
+#ifndef sigev_notify_thread_id
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
+
+static uint32_t hash_frames(const int *frames, int depth) {
+    uint32_t h = 2166136261u;  // FNV-1a
+    for (int i = 0; i < depth; i++) {
+        h = (h ^ (uint32_t)frames[i]) * 16777619u;
+    }
+    return h ? h : 1;  // 0 marks an empty slot
+}
+
+static void sample_handler(int sig) {
+    (void)sig;
+    forth_vm_t *vm = sampled_vm;
+    if (!vm) return;
+
+    int frames[SAMPLE_MAX_DEPTH];
+    int depth = vm->rstack_depth;
+    if (depth > RETURN_STACK_SIZE) depth = RETURN_STACK_SIZE;
+    if (depth > SAMPLE_MAX_DEPTH) depth = SAMPLE_MAX_DEPTH;
+    for (int i = 0; i < depth; i++) {
+        frames[i] = vm->return_stack[i];
+    }
+
+    samples_total++;
+    uint32_t hash = hash_frames(frames, depth);
+    for (int probe = 0; probe < SAMPLE_MAX_STACKS; probe++) {
+        sample_stack_t *slot = &stacks[(hash + probe) % SAMPLE_MAX_STACKS];
+        if (slot->hash == 0) {
+            slot->depth = depth;
+            memcpy(slot->frames, frames, depth * sizeof(int));
+            slot->count = 1;
+            slot->hash = hash;
+            return;
+        }
+        if (slot->hash == hash && slot->depth == depth &&
+            memcmp(slot->frames, frames, depth * sizeof(int)) == 0) {
+            slot->count++;
+            return;
+        }
+    }
+    samples_dropped++;
+}
+
+int sampler_start(forth_vm_t *vm, int hz) {
+    if (hz < 1 || hz > 100000) {
+        forth_error("Sample frequency must be between 1 and 100000 Hz");
+        return -1;
+    }
+
+    memset(stacks, 0, sizeof(stacks));
+    samples_total = 0;
+    samples_dropped = 0;
+    sampled_vm = vm;
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = sample_handler;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    if (sigaction(SIGPROF, &action, NULL) != 0) {
+        forth_error("Failed to install SIGPROF handler");
+        return -1;
+    }
+
+    // CPU time of the calling thread, signalled to that thread only
+    struct sigevent event;
+    memset(&event, 0, sizeof(event));
+    event.sigev_notify = SIGEV_THREAD_ID;
+    event.sigev_signo = SIGPROF;
+    event.sigev_notify_thread_id = (pid_t)syscall(SYS_gettid);
+    if (timer_create(CLOCK_THREAD_CPUTIME_ID, &event, &sample_timer) != 0) {
+        forth_error("Failed to create profiling timer");
+        return -1;
+    }
+    timer_armed = 1;
+
+    long period_ns = 1000000000L / hz;
+    struct itimerspec timer;
+    timer.it_interval.tv_sec = period_ns / 1000000000L;
+    timer.it_interval.tv_nsec = period_ns % 1000000000L;
+    timer.it_value = timer.it_interval;
+    if (timer_settime(sample_timer, 0, &timer, NULL) != 0) {
+        forth_error("Failed to start profiling timer");
+        sampler_stop();
+        return -1;
+    }
+
+    return 0;
+}
+
+void sampler_stop(void) {
+    if (timer_armed) {
+        timer_delete(sample_timer);
+        timer_armed = 0;
+    }
+    signal(SIGPROF, SIG_IGN);
+    sampled_vm = NULL;
+}
+
+int sampler_write_folded(forth_vm_t *vm, const char *path) {
+    FILE *out = fopen(path, "w");
+    if (!out) {
+        forth_error("Failed to open sample output file");
+        return -1;
+    }
+
+    for (int i = 0; i < SAMPLE_MAX_STACKS; i++) {
+        sample_stack_t *slot = &stacks[i];
+        if (slot->hash == 0) continue;
+
+        fputs("forth", out);
+        if (slot->depth == 0) {
+            fputs(";[interpreter]", out);
+        }
+        for (int f = 0; f < slot->depth; f++) {
+            int idx = slot->frames[f];
+            fprintf(out, ";%s", (idx >= 0 && idx < dict_size(vm)) ?
+                    forth_word(vm, idx)->name : "[unknown]");
+        }
+        fprintf(out, " %llu\n", (unsigned long long)slot->count);
+    }
+
+    fclose(out);
+
+    if (samples_dropped > 0) {
+        fprintf(stderr, "Sampler: %llu of %llu samples dropped (stack table full)\n",
+                (unsigned long long)samples_dropped, (unsigned long long)samples_total);
+    }
+    return 0;
+}
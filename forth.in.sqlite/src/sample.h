@@ -0,0 +1,19 @@
+#ifndef SAMPLE_H
+#define SAMPLE_H
+
+#include "forth.h"
+
+// Default sampling frequency; prime so it does not beat with periodic work
+#define SAMPLE_DEFAULT_HZ 997
+
+// Distinct stacks kept; further new stacks are counted as dropped
+#define SAMPLE_MAX_STACKS 4096
+#define SAMPLE_MAX_DEPTH 32
+
+// Sampling profiler: a CPU-time timer signal records the VM return stack.
+// Call from the thread that runs vm; only its CPU time is sampled.
+int sampler_start(forth_vm_t *vm, int hz);
+void sampler_stop(void);
+int sampler_write_folded(forth_vm_t *vm, const char *path);
+
+#endif
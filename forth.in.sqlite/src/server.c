@@ -0,0 +1,489 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "server.h"
+#include "compiler.h"
+#include "protocol.h"
+#include "task.h"
+#include "rcu.h"
+#include "budget.h"
+#include "combine.h"
+
+// Unix-domain socket server.
+//
+// One epoll loop serves every client. A client owns a VM attached to the
+// server's dictionary and database (its own data and return stacks) and a
+// compiler for its own definitions. Lines are executed as soon as they are
+// complete; VM output goes through a cookie stream straight into the
+// client's pending output, which is written when the socket is writable.
+// A client that opens with PROTOCOL_MAGIC speaks length-prefixed frames
+// (see protocol.h) instead of lines. Either way every request already
+// buffered is answered in order before the socket is written, so pipelined
+// requests cost one read and one write per batch.
+
+typedef enum {
+    PROTO_UNKNOWN,
+    PROTO_TEXT,
+    PROTO_BINARY
+} server_proto_t;
+
+typedef struct server_conn {
+    int fd;
+    forth_vm_t vm;
+    forth_compiler_t compiler;
+    FILE *out;
+    server_proto_t proto;
+
+    // Partial input line or frame; a line longer than MAX_INPUT_LEN is
+    // discarded, a frame longer than PROTOCOL_MAX_FRAME closes the client
+    unsigned char in[PROTOCOL_MAX_FRAME + 4];
+    size_t in_len;
+    int discarding;
+
+    // Output not yet written to the socket
+    char *pending;
+    size_t pending_len;
+    size_t pending_sent;
+    size_t pending_cap;
+
+    uint32_t events;  // Currently registered epoll events
+    int closing;      // Close once pending output is written
+    struct server_conn *prev;
+    struct server_conn *next;
+} server_conn_t;
+
+static volatile sig_atomic_t server_stop = 0;
+static server_conn_t *connections = NULL;
+static int epoll_fd = -1;
+static uint64_t requests_served = 0;
+static uint64_t clients_served = 0;
+
+static void stop_handler(int sig) {
+    (void)sig;
+    server_stop = 1;
+}
+
+static int pending_append(server_conn_t *conn, const char *data, size_t size) {
+    if (conn->pending_len + size > conn->pending_cap) {
+        size_t capacity = conn->pending_cap ? conn->pending_cap : 4096;
+        while (capacity < conn->pending_len + size) capacity *= 2;
+        char *grown = realloc(conn->pending, capacity);
+        if (!grown) return -1;
+        conn->pending = grown;
+        conn->pending_cap = capacity;
+    }
+    memcpy(conn->pending + conn->pending_len, data, size);
+    conn->pending_len += size;
+    return 0;
+}
+
+static ssize_t conn_output_write(void *cookie, const char *buf, size_t size) {
+    server_conn_t *conn = cookie;
+    return pending_append(conn, buf, size) == 0 ? (ssize_t)size : -1;
+}
+
+static void update_events(server_conn_t *conn) {
+    size_t unsent = conn->pending_len - conn->pending_sent;
+    uint32_t events = 0;
+    if (!conn->closing && unsent < SERVER_MAX_PENDING) events |= EPOLLIN;
+    if (unsent > 0) events |= EPOLLOUT;
+
+    if (events != conn->events) {
+        struct epoll_event ev = {.events = events, .data.ptr = conn};
+        epoll_ctl(epoll_fd, EPOLL_CTL_MOD, conn->fd, &ev);
+        conn->events = events;
+    }
+}
+
+static void close_conn(server_conn_t *conn) {
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, conn->fd, NULL);
+    close(conn->fd);
+    task_forget_output(conn->out);
+
+    if (conn->prev) conn->prev->next = conn->next;
+    else connections = conn->next;
+    if (conn->next) conn->next->prev = conn->prev;
+
+    compiler_cleanup(&conn->compiler);
+    forth_cleanup(&conn->vm);
+    fclose(conn->out);
+    free(conn->pending);
+    free(conn);
+}
+
+// Write as much pending output as the socket takes; -1 if the client is gone
+static int flush_conn(server_conn_t *conn) {
+    while (conn->pending_sent < conn->pending_len) {
+        ssize_t n = send(conn->fd, conn->pending + conn->pending_sent,
+                         conn->pending_len - conn->pending_sent, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            return -1;
+        }
+        conn->pending_sent += n;
+    }
+
+    if (conn->pending_sent == conn->pending_len) {
+        conn->pending_len = conn->pending_sent = 0;
+        if (conn->closing) return -1;
+    }
+
+    update_events(conn);
+    return 0;
+}
+
+static void respond(server_conn_t *conn, size_t output_start, int status) {
+    fflush(conn->out);
+    if (conn->pending_len > output_start && conn->pending[conn->pending_len - 1] != '\n') {
+        pending_append(conn, "\n", 1);
+    }
+    const char *result = status == 0 ? "ok\n" : "error\n";
+    pending_append(conn, result, strlen(result));
+}
+
+static void serve_line(server_conn_t *conn, char *line) {
+    line[strcspn(line, "\r")] = '\0';
+    requests_served++;
+
+    if (strcmp(line, "quit") == 0) {
+        conn->closing = 1;
+        return;
+    }
+
+    size_t output_start = conn->pending_len;
+    int status = 0;
+    if (line[0] != '\0' && line[0] != '\\') {
+        status = compiler_interpret_line(&conn->compiler, line);
+    }
+    respond(conn, output_start, status);
+}
+
+static void consume_text(server_conn_t *conn, const char *data, size_t size) {
+    for (size_t i = 0; i < size && !conn->closing; i++) {
+        char c = data[i];
+        if (c != '\n') {
+            if (conn->in_len < MAX_INPUT_LEN - 1) {
+                conn->in[conn->in_len++] = c;
+            } else {
+                conn->discarding = 1;
+            }
+            continue;
+        }
+
+        if (conn->discarding) {
+            respond(conn, conn->pending_len, -1);
+            conn->discarding = 0;
+        } else {
+            conn->in[conn->in_len] = '\0';
+            serve_line(conn, (char*)conn->in);
+        }
+        conn->in_len = 0;
+    }
+}
+
+// Reserve a response header; frame_finish fills it in
+static size_t frame_begin(server_conn_t *conn) {
+    unsigned char header[FRAME_RESPONSE_HEADER] = {0};
+    size_t start = conn->pending_len;
+    pending_append(conn, (const char*)header, sizeof(header));
+    return start;
+}
+
+// Return everything above base_depth, deepest first, and finish the header
+static void frame_finish(server_conn_t *conn, size_t start, int base_depth, int status) {
+    fflush(conn->out);
+    size_t output_len = conn->pending_len - start - FRAME_RESPONSE_HEADER;
+
+    forth_vm_t *vm = &conn->vm;
+    int count = vm->stack_ptr > base_depth ? vm->stack_ptr - base_depth : 0;
+    for (int i = 0; i < count; i++) {
+        unsigned char value[VALUE_INT_SIZE];
+        value[0] = VALUE_INT;
+        protocol_put_u32(value + 1, (uint32_t)vm->data_stack[base_depth + i]);
+        pending_append(conn, (const char*)value, sizeof(value));
+    }
+    vm->stack_ptr -= count;
+
+    // The buffer may have moved while appending
+    unsigned char *header = (unsigned char*)conn->pending + start;
+    protocol_put_u32(header, (uint32_t)(conn->pending_len - start - 4));
+    header[4] = status == 0 ? FRAME_STATUS_OK : FRAME_STATUS_ERROR;
+    header[5] = 0;
+    protocol_put_u16(header + 6, (uint16_t)count);
+    protocol_put_u32(header + 8, (uint32_t)output_len);
+}
+
+static void serve_frame(server_conn_t *conn, const unsigned char *frame, size_t size) {
+    forth_vm_t *vm = &conn->vm;
+    int base_depth = vm->stack_ptr;
+    size_t start = frame_begin(conn);
+    int status = -1;
+    requests_served++;
+
+    const unsigned char *payload = frame + 1;
+    size_t payload_len = size - 1;
+
+    if (frame[0] == FRAME_EVAL && payload_len < MAX_INPUT_LEN) {
+        char line[MAX_INPUT_LEN];
+        memcpy(line, payload, payload_len);
+        line[payload_len] = '\0';
+        status = compiler_interpret_line(&conn->compiler, line);
+    } else if (frame[0] == FRAME_CALL && payload_len >= 6) {
+        int word_idx = (int)protocol_get_u32(payload);
+        int count = protocol_get_u16(payload + 4);
+        const unsigned char *value = payload + 6;
+
+        if (payload_len == 6 + (size_t)count * VALUE_INT_SIZE &&
+            vm->stack_ptr + count <= STACK_SIZE) {
+            status = 0;
+            for (int i = 0; i < count && status == 0; i++, value += VALUE_INT_SIZE) {
+                if (value[0] != VALUE_INT) {
+                    status = -1;
+                    break;
+                }
+                push(vm, (int)protocol_get_u32(value + 1));
+            }
+            if (status == 0) {
+                status = forth_call(vm, word_idx);
+            }
+        }
+    } else if (frame[0] == FRAME_LOOKUP && payload_len < MAX_WORD_LEN) {
+        char name[MAX_WORD_LEN];
+        memcpy(name, payload, payload_len);
+        name[payload_len] = '\0';
+        int word_idx = find_word(vm, name);
+        if (word_idx >= 0) {
+            push(vm, word_idx);
+            status = 0;
+        }
+    }
+
+    // A failed request leaves nothing behind for the next one
+    if (status != 0 && vm->stack_ptr > base_depth) {
+        vm->stack_ptr = base_depth;
+    }
+    frame_finish(conn, start, base_depth, status);
+}
+
+// Returns -1 on a protocol violation
+static int consume_frames(server_conn_t *conn, const char *data, size_t size) {
+    while (size > 0) {
+        size_t room = sizeof(conn->in) - conn->in_len;
+        size_t take = size < room ? size : room;
+        memcpy(conn->in + conn->in_len, data, take);
+        conn->in_len += take;
+        data += take;
+        size -= take;
+
+        size_t offset = 0;
+        while (conn->in_len - offset >= 4) {
+            uint32_t length = protocol_get_u32(conn->in + offset);
+            if (length == 0 || length > PROTOCOL_MAX_FRAME) return -1;
+            if (conn->in_len - offset - 4 < length) break;
+            serve_frame(conn, conn->in + offset + 4, length);
+            offset += 4 + length;
+        }
+
+        memmove(conn->in, conn->in + offset, conn->in_len - offset);
+        conn->in_len -= offset;
+    }
+    return 0;
+}
+
+static int read_conn(server_conn_t *conn) {
+    char buf[SERVER_READ_CHUNK];
+    ssize_t n = read(conn->fd, buf, sizeof(buf));
+    if (n < 0) {
+        return (errno == EAGAIN || errno == EINTR) ? 0 : -1;
+    }
+    if (n == 0) {
+        return -1;
+    }
+
+    const char *data = buf;
+    size_t size = n;
+
+    // Binary clients open with the magic, whose first byte no text line has
+    if (conn->proto == PROTO_UNKNOWN) {
+        if (data[0] != PROTOCOL_MAGIC[0] && conn->in_len == 0) {
+            conn->proto = PROTO_TEXT;
+        } else {
+            while (size > 0 && conn->in_len < PROTOCOL_MAGIC_LEN) {
+                conn->in[conn->in_len++] = *data++;
+                size--;
+            }
+            if (conn->in_len < PROTOCOL_MAGIC_LEN) return 0;
+            if (memcmp(conn->in, PROTOCOL_MAGIC, PROTOCOL_MAGIC_LEN) != 0) return -1;
+            conn->in_len = 0;
+            conn->proto = PROTO_BINARY;
+        }
+    }
+
+    if (conn->proto == PROTO_BINARY) {
+        if (consume_frames(conn, data, size) != 0) return -1;
+    } else {
+        consume_text(conn, data, size);
+    }
+
+    return flush_conn(conn);
+}
+
+static void accept_clients(int listen_fd, forth_vm_t *parent) {
+    for (;;) {
+        int fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                perror("accept");
+            }
+            return;
+        }
+
+        server_conn_t *conn = calloc(1, sizeof(server_conn_t));
+        cookie_io_functions_t io = {.write = conn_output_write};
+        if (!conn || !(conn->out = fopencookie(conn, "w", io))) {
+            free(conn);
+            close(fd);
+            continue;
+        }
+        conn->fd = fd;
+        forth_attach(&conn->vm, parent, conn->out);
+        conn->vm.event_loop = 1;
+        compiler_init(&conn->compiler, &conn->vm);
+
+        struct epoll_event ev = {.events = EPOLLIN, .data.ptr = conn};
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+            perror("epoll_ctl");
+            compiler_cleanup(&conn->compiler);
+            fclose(conn->out);
+            free(conn);
+            close(fd);
+            continue;
+        }
+        conn->events = EPOLLIN;
+
+        conn->next = connections;
+        if (connections) connections->prev = conn;
+        connections = conn;
+        clients_served++;
+    }
+}
+
+static int open_listener(const char *socket_path) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+        forth_error("Socket path too long");
+        return -1;
+    }
+    strcpy(addr.sun_path, socket_path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        perror("socket");
+        return -1;
+    }
+
+    unlink(socket_path);
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(fd, SOMAXCONN) != 0) {
+        perror("bind");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int server_run(forth_vm_t *vm, const char *socket_path) {
+    int listen_fd = open_listener(socket_path);
+    if (listen_fd < 0) return -1;
+
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    struct epoll_event listen_ev = {.events = EPOLLIN, .data.ptr = NULL};
+    int event_fd = task_event_fd();
+    struct epoll_event task_ev = {.events = EPOLLIN, .data.ptr = &task_ev};
+    if (epoll_fd < 0 || epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd, &listen_ev) != 0 ||
+        event_fd < 0 || epoll_ctl(epoll_fd, EPOLL_CTL_ADD, event_fd, &task_ev) != 0) {
+        perror("epoll");
+        close(listen_fd);
+        unlink(socket_path);
+        return -1;
+    }
+
+    // No SA_RESTART: a signal interrupts epoll_wait so the loop can stop
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = stop_handler;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    printf("Serving on %s\n", socket_path);
+    fflush(stdout);
+
+    struct epoll_event events[SERVER_MAX_EVENTS];
+    while (!server_stop) {
+        // Tasks spawned by clients run between events, and words replaced
+        // by the last batch of requests are freed once nothing can run them
+        task_run_round();
+        // Rows buffered by this batch of requests are written before waiting
+        if (combine_active) combine_flush_all(vm);
+        rcu_quiescent();
+        rcu_reclaim();
+        rcu_thread_offline();
+        int count = epoll_wait(epoll_fd, events, SERVER_MAX_EVENTS, task_next_timeout_ms());
+        rcu_thread_online();
+        if (count < 0) {
+            if (errno == EINTR) continue;
+            perror("epoll_wait");
+            break;
+        }
+
+        for (int i = 0; i < count; i++) {
+            server_conn_t *conn = events[i].data.ptr;
+            if (!conn) {
+                accept_clients(listen_fd, vm);
+                continue;
+            }
+            if (events[i].data.ptr == &task_ev) {
+                // Tasks woken by I/O threads run at the top of the loop
+                uint64_t wakeups;
+                ssize_t n = read(event_fd, &wakeups, sizeof(wakeups));
+                (void)n;
+                continue;
+            }
+
+            int result = 0;
+            if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+                result = (events[i].events & EPOLLIN) ? read_conn(conn) : -1;
+            } else if (events[i].events & EPOLLIN) {
+                result = read_conn(conn);
+            } else if (events[i].events & EPOLLOUT) {
+                result = flush_conn(conn);
+            }
+            if (result != 0) {
+                close_conn(conn);
+            }
+        }
+    }
+
+    while (connections) {
+        close_conn(connections);
+    }
+    close(epoll_fd);
+    close(listen_fd);
+    unlink(socket_path);
+
+    printf("Server stopped: %llu clients, %llu requests\n",
+           (unsigned long long)clients_served, (unsigned long long)requests_served);
+    if (budget_active) {
+        printf("Budgets: %llu runs aborted, %llu task turns preempted\n",
+               (unsigned long long)budget_aborted_count(),
+               (unsigned long long)budget_preempted_count());
+    }
+    return 0;
+}
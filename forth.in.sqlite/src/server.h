@@ -0,0 +1,21 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include "forth.h"
+
+// Events handled per epoll_wait call
+#define SERVER_MAX_EVENTS 64
+
+// Bytes read from a client per readiness event
+#define SERVER_READ_CHUNK 16384
+
+// A client with this much unsent output is not read from until it drains
+#define SERVER_MAX_PENDING (1 << 20)
+
+// Serve the dictionary of vm on a Unix-domain socket until SIGINT/SIGTERM.
+// Each client gets its own attached VM and compiler; every line it sends
+// is answered with the line's output followed by "ok" or "error", and
+// clients opening with PROTOCOL_MAGIC use the frames of protocol.h.
+int server_run(forth_vm_t *vm, const char *socket_path);
+
+#endif
@@ -0,0 +1,394 @@
+#define _GNU_SOURCE
+#include "shard.h"
+#include "async.h"
+#include "pool.h"
+#include "trace.h"
+
+// Sharded execution.
+//
+// Every shard has its own queue of futures and of names to replicate,
+// under its own lock, and its thread runs them in order, replication
+// first. The main database is attached to each shard connection as
+// `dict`, so replicating a word is one INSERT ... SELECT of its row.
+//
+// shard-all and shard-sum submit one future per shard and collect them in
+// shard order through await; a task parks on the first one still pending,
+// and vm->fanout tells the word, when it runs again, to go on collecting.
+
+typedef struct shard_name {
+    const char *table;
+    char *name;
+    struct shard_name *next;
+} shard_name_t;
+
+typedef struct {
+    pthread_t thread;
+    int index;
+    sqlite3 *db;
+    forth_stmt_cache_t *stmts;
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    async_future_t *head;
+    async_future_t *tail;
+    shard_name_t *names;
+    shard_name_t *names_tail;
+    int stopping;
+} shard_t;
+
+typedef struct shard_fanout {
+    int ids[SHARD_MAX];
+    int count;
+    int next;   // First future not collected yet
+    int sum;    // Add the results up instead of pushing them
+    int total;
+} shard_fanout_t;
+
+int shard_active = 0;
+
+static shard_t *shards = NULL;
+static int count = 0;
+static uint64_t statements[SHARD_MAX];  // Each written by its shard's thread
+
+static void replicate(shard_t *shard, const char *table, const char *name) {
+    char sql[128];
+    snprintf(sql, sizeof(sql), "INSERT OR REPLACE INTO main.%s SELECT * FROM dict.%s WHERE name = ?1",
+             table, table);
+    sqlite3_stmt *stmt = NULL;
+    int rc = sqlite3_prepare_v2(shard->db, sql, -1, &stmt, NULL);
+    if (rc == SQLITE_OK) {
+        sqlite3_bind_text(stmt, 1, name, -1, SQLITE_STATIC);
+        rc = sqlite3_step(stmt);
+    }
+    if (rc != SQLITE_DONE) {
+        fprintf(stderr, "Failed to replicate %s to a shard: %s\n", name, sqlite3_errmsg(shard->db));
+    }
+    sqlite3_finalize(stmt);
+}
+
+static void *shard_main(void *arg) {
+    shard_t *shard = arg;
+
+    pthread_mutex_lock(&shard->lock);
+    for (;;) {
+        while (!shard->head && !shard->names && !shard->stopping) {
+            pthread_cond_wait(&shard->wakeup, &shard->lock);
+        }
+
+        // Definitions before the statements queued after them
+        if (shard->names) {
+            shard_name_t *names = shard->names;
+            shard->names = shard->names_tail = NULL;
+            pthread_mutex_unlock(&shard->lock);
+            while (names) {
+                shard_name_t *next = names->next;
+                replicate(shard, names->table, names->name);
+                free(names->name);
+                free(names);
+                names = next;
+            }
+            pthread_mutex_lock(&shard->lock);
+            continue;
+        }
+
+        async_future_t *future = shard->head;
+        if (!future) break;  // Stopping with nothing left to run
+        shard->head = future->next;
+        if (!shard->head) shard->tail = NULL;
+        pthread_mutex_unlock(&shard->lock);
+
+        async_run(shard->db, shard->stmts, future);
+        statements[shard->index]++;
+        async_complete(future);
+        pthread_mutex_lock(&shard->lock);
+    }
+    pthread_mutex_unlock(&shard->lock);
+    return NULL;
+}
+
+static void close_shard(shard_t *shard) {
+    async_close(shard->db, shard->stmts);
+    pthread_mutex_destroy(&shard->lock);
+    pthread_cond_destroy(&shard->wakeup);
+}
+
+// Connection to a shard file with the main database attached and the
+// whole dictionary copied in
+static int open_shard(shard_t *shard, const char *main_path, int index) {
+    char path[4096];
+    snprintf(path, sizeof(path), "%s.shard%d", main_path, index);
+    shard->index = index;
+    pthread_mutex_init(&shard->lock, NULL);
+    pthread_cond_init(&shard->wakeup, NULL);
+
+    shard->stmts = calloc(MAX_DICT_SIZE, sizeof(forth_stmt_cache_t));
+    sqlite3_stmt *attach = NULL;
+    int rc = shard->stmts ? sqlite3_open(path, &shard->db) : SQLITE_NOMEM;
+    if (rc == SQLITE_OK) {
+        sqlite3_busy_timeout(shard->db, POOL_BUSY_TIMEOUT_MS);
+        trace_connection(shard->db);
+        rc = sqlite3_prepare_v2(shard->db, "ATTACH ?1 AS dict", -1, &attach, NULL);
+    }
+    if (rc == SQLITE_OK) {
+        sqlite3_bind_text(attach, 1, main_path, -1, SQLITE_STATIC);
+        rc = sqlite3_step(attach) == SQLITE_DONE ? SQLITE_OK : SQLITE_ERROR;
+    }
+    sqlite3_finalize(attach);
+    if (rc == SQLITE_OK) {
+        rc = sqlite3_exec(shard->db,
+                          FORTH_WORDS_TABLE_SQL FORTH_SQL_WORDS_TABLE_SQL
+                          "BEGIN;"
+                          "INSERT OR REPLACE INTO main.forth_words SELECT * FROM dict.forth_words;"
+                          "INSERT OR REPLACE INTO main.forth_sql_words SELECT * FROM dict.forth_sql_words;"
+                          "COMMIT;",
+                          NULL, NULL, NULL);
+    }
+    if (rc != SQLITE_OK) {
+        fprintf(stderr, "Failed to open shard %s: %s\n", path,
+                shard->db ? sqlite3_errmsg(shard->db) : "out of memory");
+        close_shard(shard);
+        return -1;
+    }
+    return 0;
+}
+
+int shard_start(forth_vm_t *vm, int shard_count) {
+    if (shard_count < 1 || shard_count > SHARD_MAX) {
+        fprintf(stderr, "Shard count must be between 1 and %d\n", SHARD_MAX);
+        return -1;
+    }
+    const char *path = sqlite3_db_filename(vm->db, "main");
+    if (!path || !path[0]) {
+        fprintf(stderr, "Shards need an on-disk database\n");
+        return -1;
+    }
+
+    shards = calloc(shard_count, sizeof(shard_t));
+    if (!shards) return -1;
+    for (int i = 0; i < shard_count; i++) {
+        if (open_shard(&shards[i], path, i) != 0) {
+            for (int j = 0; j < i; j++) close_shard(&shards[j]);
+            free(shards);
+            shards = NULL;
+            return -1;
+        }
+    }
+
+    // Shard threads read the dictionary tables while the interpreter writes
+    sqlite3_busy_timeout(vm->db, POOL_BUSY_TIMEOUT_MS);
+
+    for (int i = 0; i < shard_count; i++) {
+        if (pthread_create(&shards[i].thread, NULL, shard_main, &shards[i]) != 0) {
+            fprintf(stderr, "Failed to start shard %d\n", i);
+            for (int j = 0; j < i; j++) {
+                pthread_mutex_lock(&shards[j].lock);
+                shards[j].stopping = 1;
+                pthread_cond_signal(&shards[j].wakeup);
+                pthread_mutex_unlock(&shards[j].lock);
+                pthread_join(shards[j].thread, NULL);
+            }
+            for (int j = 0; j < shard_count; j++) close_shard(&shards[j]);
+            free(shards);
+            shards = NULL;
+            return -1;
+        }
+    }
+    count = shard_count;
+    shard_active = 1;
+    return 0;
+}
+
+void shard_stop(void) {
+    for (int i = 0; i < count; i++) {
+        pthread_mutex_lock(&shards[i].lock);
+        shards[i].stopping = 1;
+        pthread_cond_signal(&shards[i].wakeup);
+        pthread_mutex_unlock(&shards[i].lock);
+    }
+    for (int i = 0; i < count; i++) {
+        pthread_join(shards[i].thread, NULL);
+        close_shard(&shards[i]);
+    }
+    free(shards);
+    shards = NULL;
+    shard_active = 0;
+}
+
+void shard_replicate(const char *table, const char *name) {
+    for (int i = 0; i < count; i++) {
+        shard_name_t *entry = calloc(1, sizeof(shard_name_t));
+        if (!entry || !(entry->name = strdup(name))) {
+            free(entry);
+            fprintf(stderr, "Failed to replicate %s to shard %d\n", name, i);
+            continue;
+        }
+        entry->table = table;
+
+        shard_t *shard = &shards[i];
+        pthread_mutex_lock(&shard->lock);
+        if (shard->names_tail) shard->names_tail->next = entry;
+        else shard->names = entry;
+        shard->names_tail = entry;
+        pthread_cond_signal(&shard->wakeup);
+        pthread_mutex_unlock(&shard->lock);
+    }
+}
+
+int shard_count(void) {
+    return count;
+}
+
+uint64_t shard_statements_count(int shard) {
+    return statements[shard];
+}
+
+static void enqueue(shard_t *shard, async_future_t *future) {
+    pthread_mutex_lock(&shard->lock);
+    if (shard->tail) shard->tail->next = future;
+    else shard->head = future;
+    shard->tail = future;
+    pthread_cond_signal(&shard->wakeup);
+    pthread_mutex_unlock(&shard->lock);
+}
+
+// The SQL word whose index is on top of the stack, with its arguments
+// below it; NULL, reported, otherwise
+static forth_word_t *routed_word(forth_vm_t *vm, int *word_idx, int below, const char *name) {
+    char msg[64];
+    if (stack_depth(vm) < 1) {
+        snprintf(msg, sizeof(msg), "Stack underflow in %s", name);
+        forth_error(msg);
+        return NULL;
+    }
+    *word_idx = pop(vm);
+    if (!shard_active) {
+        snprintf(msg, sizeof(msg), "%s needs --shards", name);
+        forth_error(msg);
+        return NULL;
+    }
+    if (*word_idx < 0 || *word_idx >= dict_size(vm) ||
+        forth_word(vm, *word_idx)->type != WORD_SQL) {
+        snprintf(msg, sizeof(msg), "%s needs an SQL word", name);
+        forth_error(msg);
+        return NULL;
+    }
+
+    forth_word_t *word = forth_word(vm, *word_idx);
+    int param_count = sqlite3_bind_parameter_count(word->data.compiled);
+    if (param_count > ASYNC_MAX_PARAMS || stack_depth(vm) < param_count + below) {
+        snprintf(msg, sizeof(msg), "Stack underflow in %s", name);
+        forth_error(msg);
+        return NULL;
+    }
+    return word;
+}
+
+// shard-for ( key -- shard ): the shard a key belongs to
+void prim_shard_for(void) {
+    forth_vm_t *vm = forth_current();
+    if (stack_depth(vm) < 1) {
+        forth_error("Stack underflow in shard-for");
+        return;
+    }
+    uint32_t hash = (uint32_t)pop(vm) * 0x9E3779B1u;
+    hash ^= hash >> 16;
+    push(vm, count ? (int)(((uint64_t)hash * (uint64_t)count) >> 32) : 0);
+}
+
+// shard-count ( -- n )
+void prim_shard_count(void) {
+    push(forth_current(), count);
+}
+
+// shard-exec ( x1..xn shard word -- future ): run an SQL word on a shard
+void prim_shard_exec(void) {
+    forth_vm_t *vm = forth_current();
+    int word_idx;
+    forth_word_t *word = routed_word(vm, &word_idx, 1, "shard-exec");
+    if (!word) return;
+
+    int shard = pop(vm);
+    if (shard < 0 || shard >= count) {
+        forth_error("No such shard");
+        vm->stack_ptr -= sqlite3_bind_parameter_count(word->data.compiled);
+        return;
+    }
+
+    async_future_t *future = async_future_new(vm, word_idx, word);
+    if (!future) return;
+    enqueue(&shards[shard], future);
+    push(vm, future->id);
+}
+
+static void fan_out(int sum, const char *name) {
+    forth_vm_t *vm = forth_current();
+    shard_fanout_t *fanout = vm->fanout;
+
+    if (!fanout) {
+        // Collecting would wait for the shards' threads
+        if (task_refuse_wait(vm, name)) return;
+        int word_idx;
+        forth_word_t *word = routed_word(vm, &word_idx, 0, name);
+        if (!word) return;
+        fanout = calloc(1, sizeof(shard_fanout_t));
+        if (!fanout) {
+            forth_error("Failed to allocate fan-out");
+            return;
+        }
+        fanout->sum = sum;
+
+        // Every shard takes the same arguments
+        int param_count = sqlite3_bind_parameter_count(word->data.compiled);
+        int params[ASYNC_MAX_PARAMS];
+        memcpy(params, vm->data_stack + vm->stack_ptr - param_count, param_count * sizeof(int));
+        for (int i = 0; i < count; i++) {
+            if (i > 0) {
+                memcpy(vm->data_stack + vm->stack_ptr, params, param_count * sizeof(int));
+                vm->stack_ptr += param_count;
+            }
+            async_future_t *future = async_future_new(vm, word_idx, word);
+            if (!future) {
+                vm->stack_ptr -= param_count;
+                break;
+            }
+            fanout->ids[fanout->count++] = future->id;
+            enqueue(&shards[i], future);
+        }
+        vm->fanout = fanout;
+    }
+
+    // Collect in shard order; a task parks on a pending future and runs
+    // this word again once it is done
+    while (fanout->next < fanout->count) {
+        int depth = vm->stack_ptr;
+        push(vm, fanout->ids[fanout->next]);
+        prim_await();
+        if (vm->wait_future) {
+            vm->stack_ptr--;  // The id await left to retry with
+            return;
+        }
+        fanout->next++;
+        if (fanout->sum) {
+            while (vm->stack_ptr > depth) {
+                fanout->total += pop(vm);
+            }
+        }
+    }
+
+    if (fanout->sum) {
+        push(vm, fanout->total);
+    }
+    vm->fanout = NULL;
+    free(fanout);
+}
+
+// shard-all ( x1..xn word -- results ): run an SQL word on every shard at
+// once; the results of shard 0 first
+void prim_shard_all(void) {
+    fan_out(0, "shard-all");
+}
+
+// shard-sum ( x1..xn word -- total ): run an SQL word on every shard at
+// once and add up all the numbers it returns
+void prim_shard_sum(void) {
+    fan_out(1, "shard-sum");
+}
@@ -0,0 +1,46 @@
+#ifndef SHARD_H
+#define SHARD_H
+
+#include "forth.h"
+
+// Sharded execution.
+//
+// With N shards, each of N threads owns a database file next to the main
+// one (forth.db.shard0 ...) and the only connection to it, so writes to
+// different shards commit in parallel. SQL words are routed to a shard by
+// index, which shard-for derives from a key, and run there as futures
+// (async.h): `shard-exec` returns one for await, and `shard-all` and
+// `shard-sum` run a word on every shard at once and merge the results.
+// Tables are per shard: schema words are run with shard-all.
+//
+// The dictionary stays in the main database and is replicated into every
+// shard file: completely when the shards start and word by word as words
+// are defined, so each shard file carries the words that wrote it.
+
+#define SHARD_MAX 64
+
+// Checked when words are saved; zero unless shards were started
+extern int shard_active;
+
+// Open count shard files next to vm's database and start their threads
+int shard_start(forth_vm_t *vm, int count);
+
+// Run what is queued and stop the threads
+void shard_stop(void);
+
+// Copy a saved definition (table is forth_words or forth_sql_words) into
+// every shard
+void shard_replicate(const char *table, const char *name);
+
+// Shard count, and statements each shard has run (read after shard_stop)
+int shard_count(void);
+uint64_t shard_statements_count(int shard);
+
+// Primitives
+void prim_shard_for(void);
+void prim_shard_count(void);
+void prim_shard_exec(void);
+void prim_shard_all(void);
+void prim_shard_sum(void);
+
+#endif
@@ -0,0 +1,192 @@
+#include "snapshot.h"
+#include "budget.h"
+#include "combine.h"
+#include "pool.h"
+
+// Read snapshots.
+//
+// The statements that begin, pin and end the read transaction are
+// prepared once per connection. A VM in a snapshot keeps the snapshot
+// connection in vm->db and its cache in vm->stmts, where SQL words find
+// them, and the connection it came from in the snapshot_conn_t.
+
+static pthread_mutex_t idle_lock = PTHREAD_MUTEX_INITIALIZER;
+static snapshot_conn_t *idle = NULL;
+static int idle_count = 0;
+static int warned_rollback = 0;
+
+static uint64_t pinned = 0;
+static uint64_t opened = 0;
+
+static void conn_close(snapshot_conn_t *conn) {
+    if (conn->stmts) {
+        for (int i = 0; i < MAX_DICT_SIZE; i++) {
+            sqlite3_finalize(conn->stmts[i].stmt);
+        }
+        free(conn->stmts);
+    }
+    sqlite3_finalize(conn->begin);
+    sqlite3_finalize(conn->pin);
+    sqlite3_finalize(conn->end);
+    sqlite3_close(conn->db);
+    free(conn);
+}
+
+static snapshot_conn_t *conn_open(const char *path) {
+    snapshot_conn_t *conn = calloc(1, sizeof(snapshot_conn_t));
+    if (!conn) return NULL;
+    conn->stmts = calloc(MAX_DICT_SIZE, sizeof(forth_stmt_cache_t));
+    if (!conn->stmts ||
+        sqlite3_open_v2(path, &conn->db, SQLITE_OPEN_READONLY, NULL) != SQLITE_OK ||
+        sqlite3_prepare_v2(conn->db, "BEGIN", -1, &conn->begin, NULL) != SQLITE_OK ||
+        sqlite3_prepare_v2(conn->db, "PRAGMA schema_version", -1, &conn->pin, NULL) != SQLITE_OK ||
+        sqlite3_prepare_v2(conn->db, "COMMIT", -1, &conn->end, NULL) != SQLITE_OK) {
+        fprintf(stderr, "Failed to open snapshot connection: %s\n",
+                conn->db ? sqlite3_errmsg(conn->db) : "out of memory");
+        conn_close(conn);
+        return NULL;
+    }
+    sqlite3_busy_timeout(conn->db, POOL_BUSY_TIMEOUT_MS);
+    if (budget_active) budget_attach(conn->db);
+    __atomic_add_fetch(&opened, 1, __ATOMIC_RELAXED);
+
+    // Checked once: only WAL lets writers go on
+    sqlite3_stmt *mode = NULL;
+    if (!__atomic_load_n(&warned_rollback, __ATOMIC_RELAXED) &&
+        sqlite3_prepare_v2(conn->db, "PRAGMA journal_mode", -1, &mode, NULL) == SQLITE_OK &&
+        sqlite3_step(mode) == SQLITE_ROW &&
+        strcmp((const char*)sqlite3_column_text(mode, 0), "wal") != 0 &&
+        !__atomic_exchange_n(&warned_rollback, 1, __ATOMIC_RELAXED)) {
+        fprintf(stderr, "Snapshots block writers unless the database is in WAL mode\n");
+    }
+    sqlite3_finalize(mode);
+    return conn;
+}
+
+// Run one of the connection's own statements to completion
+static int run(sqlite3_stmt *stmt) {
+    int rc;
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+    }
+    sqlite3_reset(stmt);
+    return rc == SQLITE_DONE ? 0 : -1;
+}
+
+static void release(snapshot_conn_t *conn) {
+    pthread_mutex_lock(&idle_lock);
+    if (idle_count < SNAPSHOT_MAX_IDLE) {
+        conn->next = idle;
+        idle = conn;
+        idle_count++;
+        conn = NULL;
+    }
+    pthread_mutex_unlock(&idle_lock);
+    if (conn) conn_close(conn);
+}
+
+int snapshot_begin(forth_vm_t *vm) {
+    if (vm->snapshot) {
+        forth_error("Snapshot already open");
+        return -1;
+    }
+    const char *path = sqlite3_db_filename(vm->db, "main");
+    if (!path || !path[0]) {
+        forth_error("Snapshots need an on-disk database");
+        return -1;
+    }
+
+    // Rows still buffered for the interpreter's connection belong in it
+    if (combine_active && !vm->stmts) {
+        combine_flush_all(vm);
+    }
+
+    pthread_mutex_lock(&idle_lock);
+    snapshot_conn_t *conn = idle;
+    if (conn) {
+        idle = conn->next;
+        idle_count--;
+    }
+    pthread_mutex_unlock(&idle_lock);
+    if (!conn && !(conn = conn_open(path))) {
+        return -1;
+    }
+
+    if (run(conn->begin) != 0 || run(conn->pin) != 0) {
+        fprintf(stderr, "Failed to pin snapshot: %s\n", sqlite3_errmsg(conn->db));
+        if (!sqlite3_get_autocommit(conn->db)) run(conn->end);
+        release(conn);
+        return -1;
+    }
+
+    conn->home_db = vm->db;
+    conn->home_stmts = vm->stmts;
+    vm->db = conn->db;
+    vm->stmts = conn->stmts;
+    vm->snapshot = conn;
+    __atomic_add_fetch(&pinned, 1, __ATOMIC_RELAXED);
+    return 0;
+}
+
+void snapshot_end(forth_vm_t *vm) {
+    snapshot_conn_t *conn = vm->snapshot;
+    if (!conn) return;
+
+    vm->db = conn->home_db;
+    vm->stmts = conn->home_stmts;
+    vm->snapshot = NULL;
+
+    // A word left mid-statement would keep the transaction open
+    sqlite3_stmt *stmt = NULL;
+    while ((stmt = sqlite3_next_stmt(conn->db, stmt))) {
+        sqlite3_reset(stmt);
+    }
+    if (!sqlite3_get_autocommit(conn->db) && run(conn->end) != 0) {
+        conn_close(conn);
+        return;
+    }
+    release(conn);
+}
+
+void snapshot_rehome(forth_vm_t *vm, sqlite3 *db, forth_stmt_cache_t *stmts) {
+    vm->snapshot->home_db = db;
+    vm->snapshot->home_stmts = stmts;
+}
+
+void snapshot_stop(forth_vm_t *vm) {
+    snapshot_end(vm);
+
+    pthread_mutex_lock(&idle_lock);
+    snapshot_conn_t *conn = idle;
+    idle = NULL;
+    idle_count = 0;
+    pthread_mutex_unlock(&idle_lock);
+
+    while (conn) {
+        snapshot_conn_t *next = conn->next;
+        conn_close(conn);
+        conn = next;
+    }
+}
+
+uint64_t snapshot_pinned_count(void) {
+    return __atomic_load_n(&pinned, __ATOMIC_RELAXED);
+}
+
+uint64_t snapshot_opened_count(void) {
+    return __atomic_load_n(&opened, __ATOMIC_RELAXED);
+}
+
+// snapshot-begin ( -- ): run SQL against the database as it is now
+void prim_snapshot_begin(void) {
+    snapshot_begin(forth_current());
+}
+
+// snapshot-end ( -- ): back to the VM's own connection
+void prim_snapshot_end(void) {
+    forth_vm_t *vm = forth_current();
+    if (!vm->snapshot) {
+        forth_error("No snapshot open");
+        return;
+    }
+    snapshot_end(vm);
+}
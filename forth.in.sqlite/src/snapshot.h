@@ -0,0 +1,57 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include "forth.h"
+
+// Read snapshots.
+//
+// `snapshot-begin` moves the VM onto a read-only connection of its own and
+// opens a read transaction there, so every SQL and compiled word until
+// `snapshot-end` sees the database as it was at that moment. In WAL mode
+// writers on other connections commit meanwhile; in rollback-journal mode
+// the snapshot holds a shared lock and they wait for it. Connections and
+// the statements prepared on them go back to an idle list at
+// `snapshot-end` and are reused by the next snapshot, from any VM.
+//
+// A VM's snapshot ends with its task, or when the VM is cleaned up. Words
+// cannot be defined while the interpreter is in one.
+
+// Idle connections kept for reuse; more are closed once released
+#define SNAPSHOT_MAX_IDLE 16
+
+typedef struct snapshot_conn {
+    sqlite3 *db;
+    forth_stmt_cache_t *stmts;
+    sqlite3_stmt *begin;
+    sqlite3_stmt *pin;   // First read, which starts the read transaction
+    sqlite3_stmt *end;
+
+    // Connection the VM goes back to at snapshot-end
+    sqlite3 *home_db;
+    forth_stmt_cache_t *home_stmts;
+
+    struct snapshot_conn *next;  // Idle list
+} snapshot_conn_t;
+
+// Pin a snapshot for vm; -1, reported, if it could not
+int snapshot_begin(forth_vm_t *vm);
+
+// Release vm's snapshot, if it has one
+void snapshot_end(forth_vm_t *vm);
+
+// The connection a VM in a snapshot returns to has changed (a task that
+// moved to another pool worker)
+void snapshot_rehome(forth_vm_t *vm, sqlite3 *db, forth_stmt_cache_t *stmts);
+
+// End vm's snapshot and close the idle connections, at exit
+void snapshot_stop(forth_vm_t *vm);
+
+// Snapshots pinned and connections opened for them so far
+uint64_t snapshot_pinned_count(void);
+uint64_t snapshot_opened_count(void);
+
+// Primitives
+void prim_snapshot_begin(void);
+void prim_snapshot_end(void);
+
+#endif
@@ -0,0 +1,147 @@
+#define _POSIX_C_SOURCE 199309L
+#include <time.h>
+#include "startup.h"
+
+// Startup phase breakdown for --startup-report.
+//
+// Phases are timed with CLOCK_MONOTONIC at their boundaries in forth_init,
+// the compiler's word loader, the compiler's line loop and the interpreter
+// loop. Script lines that only define words are charged whole, compiling
+// and saving included, until a line executes a token, whose execution ends
+// the measurement. Each loaded compiled word keeps its own SELECT, SQL
+// generation and prepare times so the slowest words can be listed;
+// whatever falls between phases is reported as other.
+
+int startup_active = 0;
+
+typedef struct {
+    char name[MAX_WORD_LEN];
+    uint64_t ns[STARTUP_PHASE_COUNT];
+    uint64_t total_ns;
+} startup_word_t;
+
+static const char *phase_names[STARTUP_PHASE_COUNT] = {
+    "db open",
+    "table creation",
+    "primitive registration",
+    "word load: select",
+    "word load: sql generation",
+    "word load: prepare",
+    "sql word load",
+    "script definitions",
+    "first token",
+};
+
+static uint64_t phase_ns[STARTUP_PHASE_COUNT];
+static uint64_t start_ns;
+static uint64_t end_ns;
+
+static startup_word_t *words = NULL;
+static int word_count = 0;
+static int word_capacity = 0;
+static startup_word_t *current_word = NULL;
+
+uint64_t startup_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+void startup_begin(void) {
+    memset(phase_ns, 0, sizeof(phase_ns));
+    word_count = 0;
+    current_word = NULL;
+    end_ns = 0;
+    start_ns = startup_now();
+    startup_active = 1;
+}
+
+void startup_add(startup_phase_t phase, uint64_t ns) {
+    // Words compiled by the script before its first token are not loads
+    int word_phase = phase >= STARTUP_WORD_SELECT && phase <= STARTUP_WORD_PREPARE;
+    if (word_phase && !current_word) return;
+
+    phase_ns[phase] += ns;
+    if (current_word) {
+        current_word->ns[phase] += ns;
+        current_word->total_ns += ns;
+    }
+}
+
+void startup_word_begin(const char *name) {
+    if (word_count == word_capacity) {
+        int capacity = word_capacity ? word_capacity * 2 : 64;
+        startup_word_t *grown = realloc(words, capacity * sizeof(startup_word_t));
+        if (!grown) return;
+        words = grown;
+        word_capacity = capacity;
+    }
+
+    current_word = &words[word_count++];
+    memset(current_word, 0, sizeof(startup_word_t));
+    strncpy(current_word->name, name, MAX_WORD_LEN - 1);
+}
+
+void startup_word_end(void) {
+    current_word = NULL;
+}
+
+void startup_first_token(uint64_t ns) {
+    phase_ns[STARTUP_FIRST_TOKEN] += ns;
+    end_ns = startup_now();
+    startup_active = 0;
+}
+
+static int compare_phase(const void *a, const void *b) {
+    uint64_t x = phase_ns[*(const int*)a];
+    uint64_t y = phase_ns[*(const int*)b];
+    return (x < y) - (x > y);
+}
+
+static int compare_word(const void *a, const void *b) {
+    uint64_t x = ((const startup_word_t*)a)->total_ns;
+    uint64_t y = ((const startup_word_t*)b)->total_ns;
+    return (x < y) - (x > y);
+}
+
+void startup_report(FILE *out, int top_n) {
+    // Without a first token (empty script, REPL quit) measure up to now
+    uint64_t total = (end_ns ? end_ns : startup_now()) - start_ns;
+
+    int order[STARTUP_PHASE_COUNT];
+    uint64_t accounted = 0;
+    for (int i = 0; i < STARTUP_PHASE_COUNT; i++) {
+        order[i] = i;
+        accounted += phase_ns[i];
+    }
+    qsort(order, STARTUP_PHASE_COUNT, sizeof(int), compare_phase);
+
+    fprintf(out, "Startup: %.3f ms to %s\n", total / 1e6,
+            end_ns ? "first token" : "exit (no tokens run)");
+    fprintf(out, "%-28s %12s %7s\n", "phase", "time(us)", "share");
+    for (int i = 0; i < STARTUP_PHASE_COUNT; i++) {
+        int phase = order[i];
+        if (phase_ns[phase] == 0) continue;
+        fprintf(out, "%-28s %12.1f %6.1f%%\n", phase_names[phase], phase_ns[phase] / 1e3,
+                total ? 100.0 * phase_ns[phase] / total : 0.0);
+    }
+    if (total > accounted) {
+        fprintf(out, "%-28s %12.1f %6.1f%%\n", "other", (total - accounted) / 1e3,
+                100.0 * (total - accounted) / total);
+    }
+
+    if (word_count == 0 || top_n <= 0) return;
+
+    qsort(words, word_count, sizeof(startup_word_t), compare_word);
+    if (top_n > word_count) top_n = word_count;
+
+    fprintf(out, "\nSlowest %d of %d words to load\n", top_n, word_count);
+    fprintf(out, "%-20s %12s %12s %12s %12s\n", "word", "total(us)", "select(us)", "sqlgen(us)",
+            "prepare(us)");
+    for (int i = 0; i < top_n; i++) {
+        startup_word_t *word = &words[i];
+        fprintf(out, "%-20s %12.1f %12.1f %12.1f %12.1f\n", word->name, word->total_ns / 1e3,
+                word->ns[STARTUP_WORD_SELECT] / 1e3, word->ns[STARTUP_WORD_SQLGEN] / 1e3,
+                word->ns[STARTUP_WORD_PREPARE] / 1e3);
+    }
+}
@@ -0,0 +1,41 @@
+#ifndef STARTUP_H
+#define STARTUP_H
+
+#include "forth.h"
+
+// Default number of slowest words listed by the report
+#define STARTUP_DEFAULT_TOP 10
+
+// Phases of startup, from opening the database to the first token
+typedef enum {
+    STARTUP_DB_OPEN,
+    STARTUP_TABLES,
+    STARTUP_PRIMITIVES,
+    STARTUP_WORD_SELECT,
+    STARTUP_WORD_SQLGEN,
+    STARTUP_WORD_PREPARE,
+    STARTUP_SQL_WORDS,
+    STARTUP_DEFINITIONS,  // Script lines before the first executed token
+    STARTUP_FIRST_TOKEN,
+    STARTUP_PHASE_COUNT
+} startup_phase_t;
+
+// Checked at each phase boundary; cleared once the first token has run
+extern int startup_active;
+
+// Starts the clock; everything up to the first token is attributed
+void startup_begin(void);
+uint64_t startup_now(void);
+
+// Charge time to a phase; word phases are also charged to the word
+// between startup_word_begin and startup_word_end
+void startup_add(startup_phase_t phase, uint64_t ns);
+void startup_word_begin(const char *name);
+void startup_word_end(void);
+
+// Called with the first token's execution time; ends the measurement
+void startup_first_token(uint64_t ns);
+
+void startup_report(FILE *out, int top_n);
+
+#endif
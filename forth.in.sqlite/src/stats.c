@@ -0,0 +1,193 @@
+#include <time.h>
+#include "stats.h"
+#include "report.h"
+#include "trace.h"
+
+// Per-statement SQLite metrics.
+//
+// After each compiled or SQL word runs, its statement counters
+// (SQLITE_STMTSTATUS_VM_STEP, FULLSCAN_STEP, SORT, AUTOINDEX) are read and
+// reset, and the run time reported by the sqlite3_trace_v2 profile callback
+// is added. Runs crossing a threshold are written to forth_slow_statements
+// as they happen; totals go to forth_stmt_stats by stats_flush().
+
+int stats_active = 0;
+
+static stats_entry_t entries[MAX_DICT_SIZE];
+static stats_thresholds_t limits;
+static sqlite3_stmt *pending_stmt = NULL;  // Statement pending_ns belongs to
+static uint64_t pending_ns = 0;
+static sqlite3_stmt *slow_insert = NULL;
+
+static int trace_callback(unsigned type, void *ctx, void *p, void *x) {
+    (void)ctx;
+    if (type == SQLITE_TRACE_PROFILE) {
+        if (p != pending_stmt) {
+            pending_stmt = p;
+            pending_ns = 0;
+        }
+        pending_ns += *(sqlite3_int64*)x;
+    }
+    // Replaces the trace's own callback on this connection
+    if (trace_active) {
+        trace_statement_end(type, ctx, p, x);
+    }
+    return 0;
+}
+
+int stats_enable(forth_vm_t *vm, const stats_thresholds_t *thresholds) {
+    const char *create_slow_table =
+        "CREATE TABLE IF NOT EXISTS forth_slow_statements ("
+        "at INTEGER,"
+        "name TEXT,"
+        "sql TEXT,"
+        "vm_steps INTEGER,"
+        "fullscan_steps INTEGER,"
+        "sorts INTEGER,"
+        "autoindexes INTEGER,"
+        "time_ns INTEGER);";
+
+    if (sqlite3_exec(vm->db, create_slow_table, NULL, NULL, NULL) != SQLITE_OK) {
+        forth_error("Failed to create slow statement table");
+        return -1;
+    }
+
+    const char *sql = "INSERT INTO forth_slow_statements "
+                      "(at, name, sql, vm_steps, fullscan_steps, sorts, autoindexes, time_ns) "
+                      "VALUES (?, ?, ?, ?, ?, ?, ?, ?)";
+    if (sqlite3_prepare_v2(vm->db, sql, -1, &slow_insert, NULL) != SQLITE_OK) {
+        forth_error("Failed to prepare slow statement insert");
+        return -1;
+    }
+
+    if (sqlite3_trace_v2(vm->db, SQLITE_TRACE_PROFILE, trace_callback, NULL) != SQLITE_OK) {
+        forth_error("Failed to install statement trace");
+        sqlite3_finalize(slow_insert);
+        slow_insert = NULL;
+        return -1;
+    }
+
+    memset(entries, 0, sizeof(entries));
+    if (thresholds) {
+        limits = *thresholds;
+    } else {
+        memset(&limits, 0, sizeof(limits));
+    }
+    pending_stmt = NULL;
+    pending_ns = 0;
+    stats_active = 1;
+    return 0;
+}
+
+void stats_disable(forth_vm_t *vm) {
+    stats_active = 0;
+    if (trace_active) {
+        sqlite3_trace_v2(vm->db, SQLITE_TRACE_PROFILE, trace_statement_end, NULL);
+    } else {
+        sqlite3_trace_v2(vm->db, 0, NULL, NULL);
+    }
+    if (slow_insert) {
+        sqlite3_finalize(slow_insert);
+        slow_insert = NULL;
+    }
+}
+
+static int crosses(uint64_t value, uint64_t limit) {
+    return limit > 0 && value >= limit;
+}
+
+static void log_slow(forth_vm_t *vm, int word_idx, sqlite3_stmt *stmt,
+                     const stats_entry_t *run) {
+    sqlite3_bind_int64(slow_insert, 1, (sqlite3_int64)time(NULL));
+    sqlite3_bind_text(slow_insert, 2, forth_word(vm, word_idx)->name, -1, SQLITE_STATIC);
+    sqlite3_bind_text(slow_insert, 3, sqlite3_sql(stmt), -1, SQLITE_STATIC);
+    sqlite3_bind_int64(slow_insert, 4, (sqlite3_int64)run->vm_steps);
+    sqlite3_bind_int64(slow_insert, 5, (sqlite3_int64)run->fullscan_steps);
+    sqlite3_bind_int64(slow_insert, 6, (sqlite3_int64)run->sorts);
+    sqlite3_bind_int64(slow_insert, 7, (sqlite3_int64)run->autoindexes);
+    sqlite3_bind_int64(slow_insert, 8, (sqlite3_int64)run->time_ns);
+    sqlite3_step(slow_insert);
+    sqlite3_reset(slow_insert);
+}
+
+void stats_record(forth_vm_t *vm, int word_idx, sqlite3_stmt *stmt) {
+    stats_entry_t run;
+    run.runs = 1;
+    run.vm_steps = sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_VM_STEP, 1);
+    run.fullscan_steps = sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_FULLSCAN_STEP, 1);
+    run.sorts = sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_SORT, 1);
+    run.autoindexes = sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_AUTOINDEX, 1);
+    run.time_ns = (pending_stmt == stmt) ? pending_ns : 0;
+    pending_stmt = NULL;
+    pending_ns = 0;
+
+    stats_entry_t *entry = &entries[word_idx];
+    entry->runs++;
+    entry->vm_steps += run.vm_steps;
+    entry->fullscan_steps += run.fullscan_steps;
+    entry->sorts += run.sorts;
+    entry->autoindexes += run.autoindexes;
+    entry->time_ns += run.time_ns;
+
+    if (slow_insert && (crosses(run.time_ns, limits.time_ns) ||
+                        crosses(run.vm_steps, limits.vm_steps) ||
+                        crosses(run.fullscan_steps, limits.fullscan_steps))) {
+        log_slow(vm, word_idx, stmt, &run);
+    }
+}
+
+void stats_report(forth_vm_t *vm, FILE *out) {
+    int shown = 0;
+    for (int i = 0; i < dict_size(vm); i++) {
+        stats_entry_t *entry = &entries[i];
+        if (entry->runs == 0) continue;
+
+        if (!shown++) {
+            fprintf(out, "\n%-20s %8s %10s %10s %6s %6s %10s\n", "word", "runs",
+                    "vm_steps", "fullscan", "sorts", "autoix", "time(us)");
+        }
+        fprintf(out, "%-20s %8llu %10llu %10llu %6llu %6llu %10.1f\n",
+                forth_word(vm, i)->name,
+                (unsigned long long)entry->runs,
+                (unsigned long long)entry->vm_steps,
+                (unsigned long long)entry->fullscan_steps,
+                (unsigned long long)entry->sorts,
+                (unsigned long long)entry->autoindexes,
+                entry->time_ns / 1e3);
+    }
+
+    if (!shown) {
+        fprintf(out, "No statement stats%s\n", stats_active ? "" : " (start with --stats)");
+    }
+}
+
+static int bind_stats_row(sqlite3_stmt *stmt, int word_idx) {
+    stats_entry_t *entry = &entries[word_idx];
+    if (entry->runs == 0) return 0;
+
+    sqlite3_bind_int64(stmt, 3, (sqlite3_int64)entry->runs);
+    sqlite3_bind_int64(stmt, 4, (sqlite3_int64)entry->vm_steps);
+    sqlite3_bind_int64(stmt, 5, (sqlite3_int64)entry->fullscan_steps);
+    sqlite3_bind_int64(stmt, 6, (sqlite3_int64)entry->sorts);
+    sqlite3_bind_int64(stmt, 7, (sqlite3_int64)entry->autoindexes);
+    sqlite3_bind_int64(stmt, 8, (sqlite3_int64)entry->time_ns);
+    return 1;
+}
+
+// Append this run's totals to the forth_stmt_stats table
+int stats_flush(forth_vm_t *vm) {
+    return report_flush(vm, "statement stats",
+        "CREATE TABLE IF NOT EXISTS forth_stmt_stats ("
+        "run INTEGER,"
+        "name TEXT,"
+        "runs INTEGER,"
+        "vm_steps INTEGER,"
+        "fullscan_steps INTEGER,"
+        "sorts INTEGER,"
+        "autoindexes INTEGER,"
+        "time_ns INTEGER);",
+        "INSERT INTO forth_stmt_stats "
+        "(run, name, runs, vm_steps, fullscan_steps, sorts, autoindexes, time_ns) "
+        "VALUES (?, ?, ?, ?, ?, ?, ?, ?)",
+        bind_stats_row);
+}
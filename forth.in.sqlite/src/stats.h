@@ -0,0 +1,37 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include "forth.h"
+
+// Per-word SQLite statement metrics for compiled and SQL words
+typedef struct {
+    uint64_t runs;
+    uint64_t vm_steps;
+    uint64_t fullscan_steps;
+    uint64_t sorts;
+    uint64_t autoindexes;
+    uint64_t time_ns;
+} stats_entry_t;
+
+// A statement run is logged as slow when it crosses any nonzero threshold
+typedef struct {
+    uint64_t time_ns;
+    uint64_t vm_steps;
+    uint64_t fullscan_steps;
+} stats_thresholds_t;
+
+// Checked after every non-primitive word; zero unless stats were enabled
+extern int stats_active;
+
+// Statistics control
+int stats_enable(forth_vm_t *vm, const stats_thresholds_t *thresholds);
+void stats_disable(forth_vm_t *vm);
+
+// Called after a word's statement has been stepped and reset
+void stats_record(forth_vm_t *vm, int word_idx, sqlite3_stmt *stmt);
+
+// Reporting
+void stats_report(forth_vm_t *vm, FILE *out);
+int stats_flush(forth_vm_t *vm);
+
+#endif
@@ -0,0 +1,715 @@
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include "task.h"
+#include "pool.h"
+#include "chan.h"
+#include "budget.h"
+#include "async.h"
+#include "snapshot.h"
+
+// Task scheduler.
+//
+// Ready tasks wait in a FIFO run queue and sleeping tasks in a list sorted
+// by wake time. A task runs its pre-resolved body cell by cell until a word
+// sets vm->yield; the scheduler then requeues it (pause) or parks it
+// (ms). The interpreter itself is not a task: `pause` and `ms` outside a
+// task run the other tasks instead, and `run-tasks` runs them all to
+// completion. When the worker pool is running, spawned tasks go to it
+// instead and these queues stay empty.
+//
+// Every started task is in the id registry until it is freed, so that
+// join can tell a running task from a finished one. The registry is the
+// only state shared with the pool's workers and has its own lock.
+//
+// Tasks waiting on a future are woken by the I/O thread that completes
+// it. Those wakeups go onto a locked list that the scheduler drains into
+// the run queue, and bump an event count that an idle scheduler (or the
+// server's epoll loop, through an eventfd) waits on.
+
+#define TASK_INITIAL_CODE 16
+
+static forth_task_t *ready_head = NULL;
+static forth_task_t *ready_tail = NULL;
+static forth_task_t *sleepers = NULL;
+
+static pthread_mutex_t registry_lock = PTHREAD_MUTEX_INITIALIZER;
+static forth_task_t *registry[TASK_REGISTRY_BUCKETS];
+static int live_tasks = 0;
+static int parked_tasks = 0;
+static int next_task_id = 1;
+
+static pthread_mutex_t remote_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t remote_cond = PTHREAD_COND_INITIALIZER;
+static forth_task_t *remote_head = NULL;
+static forth_task_t *remote_tail = NULL;
+static uint64_t remote_events = 0;
+static int remote_parked = 0;
+static int event_fd = -1;
+
+uint64_t task_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+forth_task_t *task_new(forth_vm_t *parent) {
+    forth_task_t *task = calloc(1, sizeof(forth_task_t));
+    if (!task) return NULL;
+
+    task->code = malloc(TASK_INITIAL_CODE * sizeof(task_cell_t));
+    if (!task->code) {
+        free(task);
+        return NULL;
+    }
+    task->code_capacity = TASK_INITIAL_CODE;
+    forth_attach(&task->vm, parent, parent->out);
+    task->vm.task = task;
+    return task;
+}
+
+static int append_cell(forth_task_t *task, task_cell_kind_t kind, int value) {
+    if (task->code_len == task->code_capacity) {
+        int capacity = task->code_capacity * 2;
+        task_cell_t *grown = realloc(task->code, capacity * sizeof(task_cell_t));
+        if (!grown) return -1;
+        task->code = grown;
+        task->code_capacity = capacity;
+    }
+    task->code[task->code_len].kind = kind;
+    task->code[task->code_len].value = value;
+    return task->code_len++;
+}
+
+int task_append_token(forth_task_t *task, const char *token) {
+    char *endptr;
+    long value = strtol(token, &endptr, 10);
+    if (*endptr == '\0') {
+        return append_cell(task, TASK_LITERAL, (int)value) < 0 ? -1 : 0;
+    }
+
+    int word_idx = find_word(&task->vm, token);
+    if (word_idx < 0) return -1;
+    return append_cell(task, TASK_WORD, word_idx) < 0 ? -1 : 0;
+}
+
+// Registry: callers hold registry_lock
+static forth_task_t *registry_find(int id) {
+    forth_task_t *task = registry[id % TASK_REGISTRY_BUCKETS];
+    while (task && task->id != id) {
+        task = task->registry_next;
+    }
+    return task;
+}
+
+static void registry_remove(forth_task_t *task) {
+    forth_task_t **link = &registry[task->id % TASK_REGISTRY_BUCKETS];
+    while (*link != task) {
+        link = &(*link)->registry_next;
+    }
+    *link = task->registry_next;
+}
+
+static void enqueue(forth_task_t *task) {
+    task->state = TASK_READY;
+    task->next = NULL;
+    if (ready_tail) ready_tail->next = task;
+    else ready_head = task;
+    ready_tail = task;
+}
+
+static void park(forth_task_t *task) {
+    task->state = TASK_SLEEPING;
+    forth_task_t **link = &sleepers;
+    while (*link && (*link)->vm.wake_ns <= task->vm.wake_ns) {
+        link = &(*link)->next;
+    }
+    task->next = *link;
+    *link = task;
+}
+
+static void wake_sleepers(void) {
+    if (!sleepers) return;
+    uint64_t now = task_now_ns();
+    while (sleepers && sleepers->vm.wake_ns <= now) {
+        forth_task_t *task = sleepers;
+        sleepers = task->next;
+        enqueue(task);
+    }
+}
+
+// Callers hold remote_lock
+static void signal_remote(void) {
+    __atomic_add_fetch(&remote_events, 1, __ATOMIC_RELEASE);
+    pthread_cond_broadcast(&remote_cond);
+    if (event_fd >= 0) {
+        uint64_t one = 1;
+        ssize_t n = write(event_fd, &one, sizeof(one));
+        (void)n;
+    }
+}
+
+static void wake_remote(void) {
+    if (!__atomic_load_n(&remote_head, __ATOMIC_ACQUIRE)) return;
+
+    pthread_mutex_lock(&remote_lock);
+    forth_task_t *task = remote_head;
+    __atomic_store_n(&remote_head, NULL, __ATOMIC_RELAXED);
+    remote_tail = NULL;
+    pthread_mutex_unlock(&remote_lock);
+
+    while (task) {
+        forth_task_t *next = task->next;
+        __atomic_sub_fetch(&remote_parked, 1, __ATOMIC_SEQ_CST);
+        enqueue(task);
+        task = next;
+    }
+}
+
+// Block until a remote event newer than seen, or until the deadline
+static void wait_remote(uint64_t seen, uint64_t deadline_ns) {
+    pthread_mutex_lock(&remote_lock);
+    while (__atomic_load_n(&remote_events, __ATOMIC_RELAXED) == seen) {
+        uint64_t now = task_now_ns();
+        if (now >= deadline_ns) break;
+
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        uint64_t wait = deadline_ns - now;
+        ts.tv_sec += wait / 1000000000ull;
+        ts.tv_nsec += wait % 1000000000ull;
+        if (ts.tv_nsec >= 1000000000) {
+            ts.tv_sec++;
+            ts.tv_nsec -= 1000000000;
+        }
+        pthread_cond_timedwait(&remote_cond, &remote_lock, &ts);
+    }
+    pthread_mutex_unlock(&remote_lock);
+}
+
+static void spawn_cells(forth_vm_t *vm, const task_cell_t *cells, int len, const char *word);
+
+static uint64_t remote_seen(void) {
+    return __atomic_load_n(&remote_events, __ATOMIC_ACQUIRE);
+}
+
+int task_start(forth_task_t *task) {
+    pthread_mutex_lock(&registry_lock);
+    int id = task->id = next_task_id++;
+    if (next_task_id < 0) next_task_id = 1;
+    task->registry_next = registry[task->id % TASK_REGISTRY_BUCKETS];
+    registry[task->id % TASK_REGISTRY_BUCKETS] = task;
+    live_tasks++;
+    pthread_mutex_unlock(&registry_lock);
+
+    if (pool_active) {
+        task->pooled = 1;
+        task->state = TASK_READY;
+        pool_submit(task);  // A worker may finish and free it at once
+    } else {
+        enqueue(task);
+    }
+    return id;
+}
+
+void task_free(forth_task_t *task) {
+    if (!task) return;
+    forth_cleanup(&task->vm);
+    free(task->code);
+    free(task);
+}
+
+// Keep the task for join if it left results, otherwise free it
+static void finish(forth_task_t *task) {
+    fflush(task->vm.out);
+    snapshot_end(&task->vm);
+    free(task->code);
+    task->code = NULL;
+
+    pthread_mutex_lock(&registry_lock);
+    live_tasks--;
+    int keep = task->vm.stack_ptr > 0;
+    if (keep) {
+        task->state = TASK_DONE;
+        task->done = 1;
+    } else {
+        registry_remove(task);
+    }
+    pthread_mutex_unlock(&registry_lock);
+
+    if (!keep) {
+        task_free(task);
+    }
+}
+
+task_state_t task_resume(forth_task_t *task) {
+    forth_vm_t *vm = &task->vm;
+    forth_set_current(vm);
+    if (budget_active) budget_begin(vm);
+
+    while (task->ip < task->code_len) {
+        task_cell_t cell = task->code[task->ip++];
+        if (cell.kind == TASK_LITERAL) {
+            push(vm, cell.value);
+            continue;
+        }
+        if (cell.kind == TASK_BRANCH) {
+            if (stack_depth(vm) < 1) {
+                forth_error("Stack underflow in if{");
+            } else if (pop(vm) != 0) {
+                continue;
+            }
+            task->ip += cell.value;
+            continue;
+        }
+        if (cell.kind == TASK_JUMP) {
+            task->ip += cell.value;
+            continue;
+        }
+        if (cell.kind == TASK_SPAWN) {
+            spawn_cells(vm, task->code + task->ip, cell.value, "spawn{");
+            task->ip += cell.value;
+            continue;
+        }
+
+        forth_execute_word(vm, cell.value);
+        if (vm->budget_exhausted) {
+            // Aborted: nothing is left for join
+            vm->yield = 0;
+            vm->stack_ptr = 0;
+            break;
+        }
+        if (vm->yield) {
+            vm->yield = 0;
+            // Once parked the task may already be running elsewhere
+            if (budget_active) budget_end(vm);
+            if (vm->wait_chan) {
+                // Retry the blocked word at once if the channel is ready
+                chan_t *chan = vm->wait_chan;
+                vm->wait_chan = NULL;
+                __atomic_add_fetch(&parked_tasks, 1, __ATOMIC_SEQ_CST);
+                if (chan_park(task, chan, vm->wait_send)) {
+                    return TASK_BLOCKED;
+                }
+                __atomic_sub_fetch(&parked_tasks, 1, __ATOMIC_SEQ_CST);
+                vm->budget_running = budget_active;  // Still the same turn
+                continue;
+            }
+            if (vm->wait_future) {
+                async_future_t *future = vm->wait_future;
+                vm->wait_future = NULL;
+                __atomic_add_fetch(&remote_parked, 1, __ATOMIC_SEQ_CST);
+                if (async_park(task, future)) {
+                    return TASK_BLOCKED;
+                }
+                __atomic_sub_fetch(&remote_parked, 1, __ATOMIC_SEQ_CST);
+                vm->budget_running = budget_active;
+                continue;
+            }
+            return vm->wake_ns ? TASK_SLEEPING : TASK_READY;
+        }
+    }
+
+    if (budget_active) budget_end(vm);
+    finish(task);
+    return TASK_DONE;
+}
+
+void task_wake(forth_task_t *task) {
+    __atomic_sub_fetch(&parked_tasks, 1, __ATOMIC_SEQ_CST);
+    if (task->pooled) {
+        task->state = TASK_READY;
+        pool_submit(task);
+    } else {
+        enqueue(task);
+    }
+}
+
+void task_wake_remote(forth_task_t *task) {
+    if (task->pooled) {
+        __atomic_sub_fetch(&remote_parked, 1, __ATOMIC_SEQ_CST);
+        task->state = TASK_READY;
+        pool_submit(task);
+        return;
+    }
+
+    pthread_mutex_lock(&remote_lock);
+    task->next = NULL;
+    if (remote_tail) remote_tail->next = task;
+    else __atomic_store_n(&remote_head, task, __ATOMIC_RELEASE);
+    remote_tail = task;
+    signal_remote();
+    pthread_mutex_unlock(&remote_lock);
+}
+
+void task_notify(void) {
+    pthread_mutex_lock(&remote_lock);
+    signal_remote();
+    pthread_mutex_unlock(&remote_lock);
+}
+
+int task_event_fd(void) {
+    pthread_mutex_lock(&remote_lock);
+    if (event_fd < 0) {
+        event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    }
+    int fd = event_fd;
+    pthread_mutex_unlock(&remote_lock);
+    return fd;
+}
+
+int task_run_round(void) {
+    forth_vm_t *current = forth_current();
+    wake_remote();
+    wake_sleepers();
+
+    // Tasks requeued during the round wait for the next one
+    forth_task_t *last = ready_tail;
+    int ran = 0;
+    while (ready_head) {
+        forth_task_t *task = ready_head;
+        ready_head = task->next;
+        if (!ready_head) ready_tail = NULL;
+
+        int was_last = task == last;
+        task_state_t state = task_resume(task);  // May free the task
+        if (state == TASK_READY) enqueue(task);
+        else if (state == TASK_SLEEPING) park(task);
+        ran++;
+        if (was_last) break;
+    }
+
+    forth_set_current(current);
+    return ran;
+}
+
+void task_run_until(uint64_t deadline_ns) {
+    for (;;) {
+        uint64_t seen = remote_seen();
+        task_run_round();
+        uint64_t now = task_now_ns();
+        if (now >= deadline_ns) return;
+        if (ready_head) continue;
+
+        // Nothing to run: sleep until the deadline, the next wakeup or a
+        // task woken from another thread
+        uint64_t until = deadline_ns;
+        if (sleepers && sleepers->vm.wake_ns < until) until = sleepers->vm.wake_ns;
+        if (until > now) {
+            wait_remote(seen, until);
+        }
+    }
+}
+
+void task_run_all(void) {
+    if (pool_active) {
+        pool_wait_idle();
+        return;
+    }
+    while (task_help(0) == 0) {
+    }
+}
+
+int task_next_timeout_ms(void) {
+    if (ready_head || __atomic_load_n(&remote_head, __ATOMIC_ACQUIRE)) return 0;
+    if (!sleepers) return -1;
+    uint64_t now = task_now_ns();
+    if (sleepers->vm.wake_ns <= now) return 0;
+    return (int)((sleepers->vm.wake_ns - now + 999999) / 1000000);
+}
+
+int task_parked_count(void) {
+    return __atomic_load_n(&parked_tasks, __ATOMIC_SEQ_CST);
+}
+
+int task_help(int attempt) {
+    if (pool_active) {
+        if (task_count() <= task_parked_count()) return -1;
+        pool_help(attempt);
+        return 0;
+    }
+
+    uint64_t seen = remote_seen();
+    wake_remote();
+    if (ready_head) {
+        task_run_round();
+    } else if (sleepers) {
+        task_run_until(sleepers->vm.wake_ns);
+    } else if (__atomic_load_n(&remote_parked, __ATOMIC_SEQ_CST) > 0) {
+        // Only tasks waiting on futures: sleep until one is woken. The
+        // caller may itself wait for a future that completed before seen
+        // was read, so the sleep is bounded.
+        wait_remote(seen, task_now_ns() + TASK_IDLE_WAIT_NS);
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+int task_count(void) {
+    pthread_mutex_lock(&registry_lock);
+    int count = live_tasks;
+    pthread_mutex_unlock(&registry_lock);
+    return count;
+}
+
+void task_forget_output(FILE *out) {
+    pthread_mutex_lock(&registry_lock);
+    for (int i = 0; i < TASK_REGISTRY_BUCKETS; i++) {
+        for (forth_task_t *task = registry[i]; task; task = task->registry_next) {
+            if (task->vm.out == out) task->vm.out = stdout;
+        }
+    }
+    pthread_mutex_unlock(&registry_lock);
+}
+
+// Start a task running a copy of cells, with n values from vm's stack
+static void spawn_cells(forth_vm_t *vm, const task_cell_t *cells, int len, const char *word) {
+    char msg[64];
+    snprintf(msg, sizeof(msg), "Stack underflow in %s", word);
+    if (stack_depth(vm) < 1) {
+        forth_error(msg);
+        return;
+    }
+    int count = pop(vm);
+    if (count < 0 || stack_depth(vm) < count) {
+        forth_error(msg);
+        return;
+    }
+
+    forth_task_t *task = task_new(vm);
+    task_cell_t *code = task ? malloc((len > 0 ? len : 1) * sizeof(task_cell_t)) : NULL;
+    if (!code) {
+        forth_error("Failed to allocate task");
+        task_free(task);
+        return;
+    }
+    memcpy(code, cells, len * sizeof(task_cell_t));
+    free(task->code);
+    task->code = code;
+    task->code_len = task->code_capacity = len;
+
+    memcpy(task->vm.data_stack, vm->data_stack + vm->stack_ptr - count, count * sizeof(int));
+    task->vm.stack_ptr = count;
+    vm->stack_ptr -= count;
+
+    push(vm, task_start(task));
+}
+
+// Compile body tokens into task up to the `}` or `}else{` that ends them
+// and return it, or NULL at the end of the line. Nested spawn{ and if{
+// bodies are compiled in place, since a task has no input to parse.
+// Unknown words clear *valid; the rest of the body is still consumed.
+static const char *compile_body(forth_vm_t *vm, forth_task_t *task, int *valid) {
+    char *token;
+    while ((token = forth_next_token(vm))) {
+        if (strcmp(token, "}") == 0 || strcmp(token, "}else{") == 0) {
+            return token;
+        }
+
+        if (strcmp(token, "'") == 0) {
+            // Resolved now: the task body has no input to parse
+            char *name = forth_next_token(vm);
+            int word_idx = name ? find_word(vm, name) : -1;
+            if (word_idx < 0) {
+                fprintf(stderr, "Unknown word in spawn{: %s\n", name ? name : "'");
+                *valid = 0;
+            } else if (append_cell(task, TASK_LITERAL, word_idx) < 0) {
+                *valid = 0;
+            }
+            continue;
+        }
+
+        if (strcmp(token, "spawn{") == 0) {
+            // TASK_SPAWN, then the child's body
+            int at = append_cell(task, TASK_SPAWN, 0);
+            const char *end = compile_body(vm, task, valid);
+            while (end && strcmp(end, "}") != 0) {
+                fprintf(stderr, "}else{ without if{ in spawn{\n");
+                *valid = 0;
+                end = compile_body(vm, task, valid);
+            }
+            if (!end) return NULL;
+            if (at >= 0) task->code[at].value = task->code_len - at - 1;
+            continue;
+        }
+
+        if (strcmp(token, "if{") == 0) {
+            // TASK_BRANCH over the true part, which ends in a TASK_JUMP
+            // over the else part if there is one
+            int branch = append_cell(task, TASK_BRANCH, 0);
+            const char *end = compile_body(vm, task, valid);
+            if (!end) return NULL;
+            if (strcmp(end, "}else{") == 0) {
+                int jump = append_cell(task, TASK_JUMP, 0);
+                if (branch >= 0) task->code[branch].value = task->code_len - branch - 1;
+                end = compile_body(vm, task, valid);
+                while (end && strcmp(end, "}") != 0) {
+                    fprintf(stderr, "}else{ without if{ in spawn{\n");
+                    *valid = 0;
+                    end = compile_body(vm, task, valid);
+                }
+                if (!end) return NULL;
+                if (jump >= 0) task->code[jump].value = task->code_len - jump - 1;
+            } else if (branch >= 0) {
+                task->code[branch].value = task->code_len - branch - 1;
+            }
+            continue;
+        }
+
+        if (task_append_token(task, token) != 0) {
+            fprintf(stderr, "Unknown word in spawn{: %s\n", token);
+            *valid = 0;
+        }
+    }
+    return NULL;
+}
+
+// spawn{ body } ( x1..xn n -- task ): start a task running body with
+// x1..xn on its stack
+void prim_spawn(void) {
+    forth_vm_t *vm = forth_current();
+    forth_task_t *body = task_new(vm);
+    if (!body) {
+        forth_error("Failed to allocate task");
+        return;
+    }
+
+    int valid = 1;
+    const char *end = compile_body(vm, body, &valid);
+    while (end && strcmp(end, "}") != 0) {
+        fprintf(stderr, "}else{ without if{ in spawn{\n");
+        valid = 0;
+        end = compile_body(vm, body, &valid);
+    }
+    if (!end) {
+        forth_error("spawn{ without }");
+    } else if (valid) {
+        spawn_cells(vm, body->code, body->code_len, "spawn{");
+        task_free(body);
+        return;
+    }
+
+    // The arguments are dropped either way
+    if (stack_depth(vm) >= 1) {
+        int count = pop(vm);
+        if (count > 0 && count <= stack_depth(vm)) vm->stack_ptr -= count;
+    }
+    task_free(body);
+}
+
+// respawn ( x1..xn n -- task ): in a task, start another running the
+// same body; with if{ this splits work recursively
+void prim_respawn(void) {
+    forth_vm_t *vm = forth_current();
+    if (!vm->task) {
+        forth_error("respawn outside a task");
+        return;
+    }
+    spawn_cells(vm, vm->task->code, vm->task->code_len, "respawn");
+}
+
+// Reported to the client, whose request it is, rather than the server log
+int task_refuse_wait(forth_vm_t *vm, const char *word) {
+    if (!vm->event_loop) return 0;
+    fprintf(vm->out, "Forth Error: %s would block the server\n", word);
+    return 1;
+}
+
+// pause ( -- ): in a task, let the others run; outside, run them once
+void prim_pause(void) {
+    forth_vm_t *vm = forth_current();
+    if (vm->task) {
+        vm->yield = 1;
+        vm->wake_ns = 0;
+    } else {
+        task_run_round();
+    }
+}
+
+// ms ( n -- ): sleep n milliseconds, running other tasks meanwhile
+void prim_ms(void) {
+    forth_vm_t *vm = forth_current();
+    if (stack_depth(vm) < 1) {
+        forth_error("Stack underflow in ms");
+        return;
+    }
+    int ms = pop(vm);
+    uint64_t deadline = task_now_ns() + (uint64_t)(ms > 0 ? ms : 0) * 1000000ull;
+
+    if (vm->task) {
+        vm->yield = 1;
+        vm->wake_ns = deadline;
+    } else if (ms <= 0 || !task_refuse_wait(vm, "ms")) {
+        task_run_until(deadline);
+    }
+}
+
+// run-tasks ( -- ): run until every task has finished
+void prim_run_tasks(void) {
+    forth_vm_t *vm = forth_current();
+    if (vm->task) {
+        forth_error("run-tasks inside a task");
+        return;
+    }
+    if (task_refuse_wait(vm, "run-tasks")) return;
+    task_run_all();
+}
+
+// join ( task -- x1..xn ): wait for a task and take what it left on its
+// stack. Cooperative tasks yield and retry; the interpreter and pool
+// workers run other tasks while they wait.
+void prim_join(void) {
+    forth_vm_t *vm = forth_current();
+    if (stack_depth(vm) < 1) {
+        forth_error("Stack underflow in join");
+        return;
+    }
+    int id = pop(vm);
+
+    for (int attempt = 0; ; attempt++) {
+        pthread_mutex_lock(&registry_lock);
+        forth_task_t *task = registry_find(id);
+        int done = task && task->done;
+        if (done) {
+            registry_remove(task);
+        }
+        pthread_mutex_unlock(&registry_lock);
+
+        if (!task) {
+            return;  // Finished with nothing to collect
+        }
+        if (done) {
+            int count = task->vm.stack_ptr;
+            if (vm->stack_ptr + count > STACK_SIZE) {
+                forth_error("Stack overflow in join");
+                count = STACK_SIZE - vm->stack_ptr;
+            }
+            memcpy(vm->data_stack + vm->stack_ptr, task->vm.data_stack, count * sizeof(int));
+            vm->stack_ptr += count;
+            task_free(task);
+            return;
+        }
+
+        if (vm->task && !vm->task->pooled) {
+            // Run join again once the other tasks have had a turn
+            push(vm, id);
+            vm->task->ip--;
+            vm->yield = 1;
+            vm->wake_ns = 0;
+            return;
+        }
+
+        if (task_refuse_wait(vm, "join")) {
+            push(vm, id);  // Still joinable
+            return;
+        }
+        if (task_help(attempt) != 0) {
+            forth_error("join would wait forever: every task is blocked");
+            return;
+        }
+        forth_set_current(vm);
+    }
+}
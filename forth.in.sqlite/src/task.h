@@ -0,0 +1,124 @@
+#ifndef TASK_H
+#define TASK_H
+
+#include "forth.h"
+
+// Tasks within one process.
+//
+// A task is a VM attached to its spawner's dictionary (its own data and
+// return stacks) plus the pre-resolved tokens of its body and an
+// instruction pointer. Tasks run until a word yields: `pause` requeues the
+// task, `ms` parks it until a deadline. Switching tasks saves nothing but
+// the instruction pointer, so it costs about as much as a word call.
+// Without a worker pool tasks are scheduled cooperatively on the
+// interpreter's thread; with one (pool.h) they run on the workers.
+//
+// Bodies are compiled whole when spawn{ runs, since a task has no input
+// to parse: a nested spawn{ ... } becomes a TASK_SPAWN cell followed by
+// the child's cells, and if{ ... }else{ ... } becomes branches. respawn
+// starts another task on the body of the task running it, so with if{ a
+// body can split its work recursively.
+//
+// A task that finishes with values on its stack is kept until `join`
+// collects them; one that finishes empty is freed at once, and joining it
+// returns nothing.
+
+typedef enum {
+    TASK_LITERAL,
+    TASK_WORD,
+    TASK_BRANCH,  // Pop a flag; if zero skip value cells
+    TASK_JUMP,    // Skip value cells
+    TASK_SPAWN    // Start a task on the next value cells, then skip them
+} task_cell_kind_t;
+
+typedef struct {
+    task_cell_kind_t kind;
+    int value;  // Literal, dictionary index or cell count
+} task_cell_t;
+
+typedef enum {
+    TASK_READY,
+    TASK_SLEEPING,
+    TASK_BLOCKED,  // Parked on a channel, which requeues it
+    TASK_DONE
+} task_state_t;
+
+typedef struct forth_task {
+    int id;
+    task_state_t state;  // Owned by the thread running or parking the task
+    int done;            // Finished; read by joiners under the registry lock
+    forth_vm_t vm;
+    task_cell_t *code;
+    int code_len;
+    int code_capacity;
+    int ip;
+    int pooled;                         // Runs on the worker pool
+    struct forth_task *next;            // Run queue, sleep list or pool queue
+    struct forth_task *registry_next;   // Id lookup chain
+} forth_task_t;
+
+// Buckets of the id registry that join uses to find tasks
+#define TASK_REGISTRY_BUCKETS 1024
+
+// Longest an idle scheduler sleeps while only tasks waiting on futures
+// are left
+#define TASK_IDLE_WAIT_NS 1000000ull
+
+// Building and starting a task; a task that is never started is freed.
+// task_start returns the task's id.
+forth_task_t *task_new(forth_vm_t *parent);
+int task_append_token(forth_task_t *task, const char *token);
+int task_start(forth_task_t *task);
+void task_free(forth_task_t *task);
+
+// Run a task until it yields (TASK_READY or TASK_SLEEPING), parks
+// (TASK_BLOCKED) or finishes (TASK_DONE). After TASK_BLOCKED the task
+// belongs to the channel and after TASK_DONE it may have been freed.
+task_state_t task_resume(forth_task_t *task);
+
+// Make a parked task runnable again, on whichever scheduler it belongs to
+void task_wake(forth_task_t *task);
+
+// Same for a task parked on a future (async.h), from any thread; the
+// cooperative scheduler picks it up on its next round. task_notify only
+// wakes a scheduler idling in task_help or task_run_until, and
+// task_event_fd is readable after either, for event loops.
+void task_wake_remote(forth_task_t *task);
+void task_notify(void);
+int task_event_fd(void);
+
+// Scheduling: run every ready task once, or until none are left
+int task_run_round(void);
+void task_run_all(void);
+void task_run_until(uint64_t deadline_ns);
+
+// Milliseconds until a task needs the CPU: 0 if one is ready, -1 if none
+// is waiting at all; for event loops that run tasks between events
+int task_next_timeout_ms(void);
+int task_count(void);
+int task_parked_count(void);
+
+// Run other tasks for a while on behalf of code outside any task that is
+// waiting for one of them; -1 if every task is parked and none can run.
+// Waits for a wakeup when the only tasks left are waiting on futures.
+int task_help(int attempt);
+
+// Outside a task, code that waits runs other tasks inline, which on an
+// event loop stalls every client: reports that word would block and
+// returns nonzero on a VM that runs on one
+int task_refuse_wait(forth_vm_t *vm, const char *word);
+
+// Tasks writing to out are redirected to stdout (out is about to close)
+void task_forget_output(FILE *out);
+
+uint64_t task_now_ns(void);
+
+// Task words
+void prim_spawn(void);
+void prim_respawn(void);
+void prim_pause(void);
+void prim_ms(void);
+void prim_run_tasks(void);
+void prim_join(void);
+
+#endif
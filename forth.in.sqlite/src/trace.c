@@ -0,0 +1,240 @@
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <time.h>
+#include "trace.h"
+
+// Chrome trace-event timeline export.
+//
+// Each thread records events into its own single-producer ring buffer; the
+// only synchronisation on the hot path is a release store of the ring head.
+// A background writer thread drains every ring to a trace-event JSON file
+// (loadable in chrome://tracing or Perfetto) every few milliseconds, so
+// tracing never waits on file I/O. Rings are registered once per thread
+// under a mutex and never freed while tracing runs.
+
+int trace_active = 0;
+
+typedef struct {
+    uint64_t ts_ns;
+    char phase;  // 'B', 'E' or 'i'
+    uint8_t category;
+    char name[TRACE_NAME_LEN];
+} trace_event_t;
+
+typedef struct trace_ring {
+    trace_event_t events[TRACE_RING_SIZE];
+    uint64_t head;  // Written by the owning thread
+    uint64_t tail;  // Written by the writer thread
+    uint64_t dropped;
+    int tid;
+    struct trace_ring *next;
+} trace_ring_t;
+
+static const char *category_names[] = {"word", "sql", "commit", "file"};
+
+static __thread trace_ring_t *thread_ring = NULL;
+static trace_ring_t *rings = NULL;
+static pthread_mutex_t rings_lock = PTHREAD_MUTEX_INITIALIZER;
+static int next_tid = 1;
+
+static FILE *trace_file = NULL;
+static pthread_t writer_thread;
+static int writer_stop = 0;
+static int events_written = 0;
+static uint64_t trace_epoch_ns;
+
+// The commit hook fired on this thread and its statement has not returned
+static __thread int commit_open = 0;
+
+static uint64_t monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static trace_ring_t *register_thread(void) {
+    trace_ring_t *ring = calloc(1, sizeof(trace_ring_t));
+    if (!ring) return NULL;
+
+    pthread_mutex_lock(&rings_lock);
+    ring->tid = next_tid++;
+    ring->next = rings;
+    rings = ring;
+    pthread_mutex_unlock(&rings_lock);
+
+    thread_ring = ring;
+    return ring;
+}
+
+static void record(char phase, trace_category_t category, const char *name) {
+    trace_ring_t *ring = thread_ring ? thread_ring : register_thread();
+    if (!ring) return;
+
+    uint64_t head = ring->head;
+    uint64_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+    if (head - tail >= TRACE_RING_SIZE) {
+        ring->dropped++;
+        return;
+    }
+
+    trace_event_t *event = &ring->events[head % TRACE_RING_SIZE];
+    event->ts_ns = monotonic_ns();
+    event->phase = phase;
+    event->category = (uint8_t)category;
+    strncpy(event->name, name, TRACE_NAME_LEN - 1);
+    event->name[TRACE_NAME_LEN - 1] = '\0';
+
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+}
+
+void trace_begin(trace_category_t category, const char *name) {
+    record('B', category, name);
+}
+
+// Spans nest, so a commit left open when its statement could not report
+// back ends no later than the span around it
+void trace_end(trace_category_t category, const char *name) {
+    if (commit_open) {
+        commit_open = 0;
+        record('E', TRACE_COMMIT, "commit");
+    }
+    record('E', category, name);
+}
+
+void trace_instant(trace_category_t category, const char *name) {
+    record('i', category, name);
+}
+
+static void write_json_string(FILE *out, const char *s) {
+    fputc('"', out);
+    for (; *s; s++) {
+        unsigned char c = (unsigned char)*s;
+        if (c == '"' || c == '\\') {
+            fputc('\\', out);
+            fputc(c, out);
+        } else if (c < 0x20) {
+            fprintf(out, "\\u%04x", c);
+        } else {
+            fputc(c, out);
+        }
+    }
+    fputc('"', out);
+}
+
+static void drain_rings(void) {
+    pthread_mutex_lock(&rings_lock);
+    trace_ring_t *list = rings;
+    pthread_mutex_unlock(&rings_lock);
+
+    for (trace_ring_t *ring = list; ring; ring = ring->next) {
+        uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+        uint64_t tail = ring->tail;
+
+        for (; tail != head; tail++) {
+            trace_event_t *event = &ring->events[tail % TRACE_RING_SIZE];
+            fprintf(trace_file, "%s\n{\"name\":", events_written++ ? "," : "");
+            write_json_string(trace_file, event->name);
+            fprintf(trace_file, ",\"cat\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":1,\"tid\":%d%s}",
+                    category_names[event->category], event->phase,
+                    (event->ts_ns - trace_epoch_ns) / 1e3, ring->tid,
+                    event->phase == 'i' ? ",\"s\":\"t\"" : "");
+        }
+
+        __atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+    }
+}
+
+static void *writer_main(void *arg) {
+    (void)arg;
+    struct timespec pause = {0, 5 * 1000000L};
+
+    while (!__atomic_load_n(&writer_stop, __ATOMIC_ACQUIRE)) {
+        drain_rings();
+        nanosleep(&pause, NULL);
+    }
+    drain_rings();
+    return NULL;
+}
+
+// A commit writes and syncs after the hook returns, and the statement that
+// runs it returns once it is durable
+static int commit_hook(void *arg) {
+    (void)arg;
+    if (trace_active && !commit_open) {
+        record('B', TRACE_COMMIT, "commit");
+        commit_open = 1;
+    }
+    return 0;  // Never veto the commit
+}
+
+int trace_statement_end(unsigned type, void *ctx, void *p, void *x) {
+    (void)ctx;
+    (void)p;
+    (void)x;
+    if (type == SQLITE_TRACE_PROFILE && commit_open) {
+        commit_open = 0;
+        record('E', TRACE_COMMIT, "commit");
+    }
+    return 0;
+}
+
+static void watch_connection(sqlite3 *db) {
+    sqlite3_commit_hook(db, commit_hook, NULL);
+    sqlite3_trace_v2(db, SQLITE_TRACE_PROFILE, trace_statement_end, NULL);
+}
+
+void trace_connection(sqlite3 *db) {
+    if (trace_active) {
+        watch_connection(db);
+    }
+}
+
+int trace_start(forth_vm_t *vm, const char *path) {
+    trace_file = fopen(path, "w");
+    if (!trace_file) {
+        forth_error("Failed to open trace output file");
+        return -1;
+    }
+
+    fprintf(trace_file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+    trace_epoch_ns = monotonic_ns();
+    events_written = 0;
+    writer_stop = 0;
+
+    if (pthread_create(&writer_thread, NULL, writer_main, NULL) != 0) {
+        forth_error("Failed to start trace writer");
+        fclose(trace_file);
+        trace_file = NULL;
+        return -1;
+    }
+
+    watch_connection(vm->db);
+    trace_active = 1;
+    return 0;
+}
+
+void trace_stop(forth_vm_t *vm) {
+    if (!trace_file) return;
+
+    // Other connections keep their hooks, which check trace_active
+    trace_active = 0;
+    sqlite3_commit_hook(vm->db, NULL, NULL);
+    sqlite3_trace_v2(vm->db, 0, NULL, NULL);
+
+    __atomic_store_n(&writer_stop, 1, __ATOMIC_RELEASE);
+    pthread_join(writer_thread, NULL);
+
+    uint64_t dropped = 0;
+    for (trace_ring_t *ring = rings; ring; ring = ring->next) {
+        dropped += ring->dropped;
+    }
+
+    fprintf(trace_file, "\n]}\n");
+    fclose(trace_file);
+    trace_file = NULL;
+
+    if (dropped > 0) {
+        fprintf(stderr, "Trace: %llu events dropped (ring buffer full)\n",
+                (unsigned long long)dropped);
+    }
+}
@@ -0,0 +1,38 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "forth.h"
+
+// Events per thread ring; a full ring drops events rather than blocking
+#define TRACE_RING_SIZE 16384
+#define TRACE_NAME_LEN 48
+
+// Event categories, written as the "cat" field
+typedef enum {
+    TRACE_WORD,
+    TRACE_SQL,
+    TRACE_COMMIT,
+    TRACE_FILE
+} trace_category_t;
+
+// Checked at every trace point; zero unless tracing was started
+extern int trace_active;
+
+// Tracing control: starts the background writer, stop drains and closes
+int trace_start(forth_vm_t *vm, const char *path);
+void trace_stop(forth_vm_t *vm);
+
+// Show the commits of a connection other than vm's as spans; connections
+// opened while tracing call it, it does nothing otherwise
+void trace_connection(sqlite3 *db);
+
+// sqlite3_trace_v2 callback that ends a commit span when the statement
+// that committed returns; a connection's other profile callback calls it
+int trace_statement_end(unsigned type, void *ctx, void *p, void *x);
+
+// Trace points; begin/end pairs nest per thread
+void trace_begin(trace_category_t category, const char *name);
+void trace_end(trace_category_t category, const char *name);
+void trace_instant(trace_category_t category, const char *name);
+
+#endif
@@ -1,4 +1,6 @@
 #include "vdbe.h"
+#include "trace.h"
+#include "startup.h"
 
 // Initialize a VDBE program
 int vdbe_init_program(vdbe_program_t *program) {
@@ -6,6 +8,9 @@ int vdbe_init_program(vdbe_program_t *program) {
 
     program->instruction_capacity = 64;
     program->instruction_count = 0;
+#ifdef FORTH_INSN_COUNTERS
+    program->exec_count = 0;
+#endif
     program->instructions = malloc(program->instruction_capacity * sizeof(vdbe_instruction_t));
 
     if (!program->instructions) {
@@ -128,14 +133,25 @@ int vdbe_program_to_sql(vdbe_program_t *program, char *sql_buffer, size_t buffer
 int vdbe_compile_to_sqlite(vdbe_program_t *program, sqlite3 *db, sqlite3_stmt **stmt) {
     if (!program || !db || !stmt) return -1;
 
+    uint64_t phase_start = startup_active ? startup_now() : 0;
     char sql[2048];
     if (vdbe_program_to_sql(program, sql, sizeof(sql)) != 0) {
         return -1;
     }
 
-    printf("Compiling SQL: %s\n", sql);
+    if (startup_active) {
+        uint64_t now = startup_now();
+        startup_add(STARTUP_WORD_SQLGEN, now - phase_start);
+        phase_start = now;
+    }
 
-    if (sqlite3_prepare_v2(db, sql, -1, stmt, NULL) != SQLITE_OK) {
+    if (trace_active) trace_begin(TRACE_SQL, "prepare");
+    int rc = sqlite3_prepare_v2(db, sql, -1, stmt, NULL);
+    if (trace_active) trace_end(TRACE_SQL, "prepare");
+    if (startup_active) {
+        startup_add(STARTUP_WORD_PREPARE, startup_now() - phase_start);
+    }
+    if (rc != SQLITE_OK) {
         fprintf(stderr, "SQL compilation error: %s\n", sqlite3_errmsg(db));
         return -1;
     }
@@ -216,4 +232,113 @@ int vdbe_execute_program(sqlite3_stmt *stmt, forth_vm_t *vm) {
 
     sqlite3_reset(stmt);
     return 0;
-}
\ No newline at end of file
+}
+
+// Copy a program so a dictionary entry can keep it after compilation
+vdbe_program_t *vdbe_copy_program(const vdbe_program_t *program) {
+    if (!program) return NULL;
+
+    vdbe_program_t *copy = malloc(sizeof(vdbe_program_t));
+    if (!copy) return NULL;
+
+    int count = program->instruction_count;
+    copy->instruction_count = count;
+    copy->instruction_capacity = count > 0 ? count : 1;
+    copy->instructions = malloc(copy->instruction_capacity * sizeof(vdbe_instruction_t));
+    if (!copy->instructions) {
+        free(copy);
+        return NULL;
+    }
+    memcpy(copy->instructions, program->instructions, count * sizeof(vdbe_instruction_t));
+
+#ifdef FORTH_INSN_COUNTERS
+    copy->exec_count = 0;
+#endif
+
+    return copy;
+}
+
+void vdbe_free_program(vdbe_program_t *program) {
+    if (!program) return;
+    vdbe_cleanup_program(program);
+    free(program);
+}
+
+// A compiled word is a single straight-line SELECT, so every instruction
+// of its program runs exactly once per execution: one counter per word
+// says as much as one per instruction. Words run on pool workers too.
+void vdbe_count_execution(vdbe_program_t *program) {
+#ifdef FORTH_INSN_COUNTERS
+    __atomic_add_fetch(&program->exec_count, 1, __ATOMIC_RELAXED);
+#else
+    (void)program;
+#endif
+}
+
+// Merge this session's count into forth_exec_counts, with the
+// instructions it executed
+int vdbe_save_counts(vdbe_program_t *program, sqlite3 *db, const char *name) {
+#ifdef FORTH_INSN_COUNTERS
+    if (!program || !db || !name) return -1;
+
+    uint64_t count = __atomic_load_n(&program->exec_count, __ATOMIC_RELAXED);
+    if (count == 0) return 0;
+
+    const char *create_counts_table =
+        "CREATE TABLE IF NOT EXISTS forth_exec_counts ("
+        "name TEXT PRIMARY KEY,"
+        "executions INTEGER,"
+        "instructions INTEGER);";
+
+    if (sqlite3_exec(db, create_counts_table, NULL, NULL, NULL) != SQLITE_OK) {
+        return -1;
+    }
+
+    sqlite3_stmt *stmt;
+    const char *sql = "INSERT INTO forth_exec_counts (name, executions, instructions) VALUES (?, ?, ?) "
+                      "ON CONFLICT (name) DO UPDATE SET "
+                      "executions = executions + excluded.executions, "
+                      "instructions = instructions + excluded.instructions";
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+        return -1;
+    }
+
+    sqlite3_bind_text(stmt, 1, name, -1, SQLITE_STATIC);
+    sqlite3_bind_int64(stmt, 2, (sqlite3_int64)count);
+    sqlite3_bind_int64(stmt, 3, (sqlite3_int64)(count * program->instruction_count));
+    int rc = sqlite3_step(stmt);
+    sqlite3_finalize(stmt);
+    return rc == SQLITE_DONE ? 0 : -1;
+#else
+    (void)program; (void)db; (void)name;
+    return 0;
+#endif
+}
+
+const char* vdbe_opcode_name(vdbe_opcode_t opcode) {
+    switch (opcode) {
+        case VDBE_INTEGER:   return "INTEGER";
+        case VDBE_ADD:       return "ADD";
+        case VDBE_SUBTRACT:  return "SUBTRACT";
+        case VDBE_MULTIPLY:  return "MULTIPLY";
+        case VDBE_DIVIDE:    return "DIVIDE";
+        case VDBE_PRINT:     return "PRINT";
+        case VDBE_DUP:       return "DUP";
+        case VDBE_DROP:      return "DROP";
+        case VDBE_SWAP:      return "SWAP";
+        case VDBE_OVER:      return "OVER";
+        case VDBE_EMIT:      return "EMIT";
+        case VDBE_CALL_WORD: return "CALL_WORD";
+        case VDBE_RETURN:    return "RETURN";
+    }
+    return "UNKNOWN";
+}
+
+// Print a program one instruction per line
+void vdbe_dump_program(vdbe_program_t *program, FILE *out) {
+    for (int i = 0; i < program->instruction_count; i++) {
+        vdbe_instruction_t *instr = &program->instructions[i];
+        fprintf(out, "%4d  %-10s %6d %4d %4d\n", i, vdbe_opcode_name(instr->opcode),
+                instr->p1, instr->p2, instr->p3);
+    }
+}
@@ -30,10 +30,13 @@ typedef struct {
 } vdbe_instruction_t;
 
 // VDBE program structure
-typedef struct {
+typedef struct vdbe_program {
     vdbe_instruction_t *instructions;
     int instruction_count;
     int instruction_capacity;
+#ifdef FORTH_INSN_COUNTERS
+    uint64_t exec_count;  // Runs of the word's statement, updated atomically
+#endif
 } vdbe_program_t;
 
 // VDBE compiler functions
@@ -49,6 +52,16 @@ int vdbe_emit_arithmetic(vdbe_program_t *program, const char *operation);
 int vdbe_emit_io(vdbe_program_t *program, const char *operation);
 int vdbe_emit_literal(vdbe_program_t *program, int value);
 
+// Retained copies of compiled programs (owned by dictionary entries)
+vdbe_program_t *vdbe_copy_program(const vdbe_program_t *program);
+void vdbe_free_program(vdbe_program_t *program);
+
+// Per-word execution counters (built with FORTH_INSN_COUNTERS)
+void vdbe_count_execution(vdbe_program_t *program);
+int vdbe_save_counts(vdbe_program_t *program, sqlite3 *db, const char *name);
+void vdbe_dump_program(vdbe_program_t *program, FILE *out);
+const char* vdbe_opcode_name(vdbe_opcode_t opcode);
+
 // VDBE to SQL translation
 const char* vdbe_opcode_to_sql(vdbe_opcode_t opcode, int p1, int p2, int p3);
 int vdbe_program_to_sql(vdbe_program_t *program, char *sql_buffer, size_t buffer_size);
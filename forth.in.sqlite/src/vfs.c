@@ -0,0 +1,750 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <libgen.h>
+#include <limits.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <linux/io_uring.h>
+#include "vfs.h"
+
+// Write-coalescing VFS.
+//
+// The shim's file object is followed by the wrapped VFS's own. Queued
+// writes need the file descriptor of the wrapped file, which the unix VFS
+// keeps as the fourth member of its file object. That layout is private,
+// so the shim reads it only from SQLite versions it has been checked
+// against, and trusts it only if fstat() shows it is the file that was
+// opened. Other files, and files where either check fails, pass every
+// call through.
+//
+// The first sync of a journal or WAL the VFS created is submitted with the
+// writes like any other, and then the directory is synced so that the new
+// entry is durable, as the unix VFS would.
+
+vfs_mode_t vfs_mode = VFS_DEFAULT;
+
+typedef struct {
+    sqlite3_int64 offset;
+    int len;
+    unsigned char *data;
+} vfs_write_t;
+
+typedef struct vfs_file {
+    sqlite3_file base;
+    sqlite3_file *real;
+    int fd;               // -1 when calls pass through
+    const char *name;     // Valid until xClose
+    int dir_sync;         // First sync also syncs the directory
+    vfs_write_t writes[VFS_MAX_PENDING];
+    int count;
+    size_t bytes;
+    pthread_t owner;      // Thread that queued the pending writes
+    struct vfs_file *dirty_next;  // Files with pending writes, under dirty_lock
+    int dirty;
+} vfs_file_t;
+
+// Leading members of the unix VFS's unixFile
+typedef struct {
+    const sqlite3_io_methods *methods;
+    sqlite3_vfs *vfs;
+    void *inode;
+    int h;
+} unix_file_prefix_t;
+
+typedef struct {
+    int fd;  // -1 before setup, -2 if io_uring is unavailable
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    unsigned entries;
+    void *sq_ptr, *cq_ptr;
+    size_t sq_len, cq_len, sqe_len;
+} vfs_ring_t;
+
+static sqlite3_vfs shim;
+static sqlite3_vfs *real_vfs = NULL;
+static sqlite3_io_methods methods;
+
+static pthread_mutex_t dirty_lock = PTHREAD_MUTEX_INITIALIZER;
+static vfs_file_t *dirty_files = NULL;
+static __thread int thread_dirty = 0;  // Files this thread may have left pending
+
+static pthread_key_t ring_key;
+static __thread vfs_ring_t ring = {-1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+
+static uint64_t writes = 0;
+static uint64_t runs = 0;
+static uint64_t syncs = 0;
+static uint64_t submits = 0;
+
+#define COUNT(counter, n) __atomic_add_fetch(&(counter), (n), __ATOMIC_RELAXED)
+
+// io_uring
+
+static void ring_close(void *arg) {
+    vfs_ring_t *r = arg;
+    if (r->fd < 0) return;
+    munmap(r->sqes, r->sqe_len);
+    if (r->cq_ptr != r->sq_ptr) munmap(r->cq_ptr, r->cq_len);
+    munmap(r->sq_ptr, r->sq_len);
+    close(r->fd);
+    r->fd = -1;
+}
+
+// This thread's ring, set up on first use; NULL if io_uring is unavailable
+static vfs_ring_t *thread_ring(void) {
+    if (ring.fd >= 0) return &ring;
+    if (ring.fd == -2 || vfs_mode != VFS_URING) return NULL;
+
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    int fd = (int)syscall(__NR_io_uring_setup, VFS_RING_ENTRIES, &params);
+    if (fd < 0) {
+        ring.fd = -2;
+        return NULL;
+    }
+
+    vfs_ring_t r;
+    memset(&r, 0, sizeof(r));
+    r.fd = fd;
+    r.entries = params.sq_entries;
+    r.sq_len = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    r.cq_len = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    int single = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single && r.cq_len > r.sq_len) r.sq_len = r.cq_len;
+
+    r.sq_ptr = mmap(NULL, r.sq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                    fd, IORING_OFF_SQ_RING);
+    r.cq_ptr = single ? r.sq_ptr
+                      : mmap(NULL, r.cq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                             fd, IORING_OFF_CQ_RING);
+    r.sqe_len = params.sq_entries * sizeof(struct io_uring_sqe);
+    r.sqes = mmap(NULL, r.sqe_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                  fd, IORING_OFF_SQES);
+    if (r.sq_ptr == MAP_FAILED || r.cq_ptr == MAP_FAILED || r.sqes == MAP_FAILED) {
+        if (r.sqes != MAP_FAILED) munmap(r.sqes, r.sqe_len);
+        if (!single && r.cq_ptr != MAP_FAILED) munmap(r.cq_ptr, r.cq_len);
+        if (r.sq_ptr != MAP_FAILED) munmap(r.sq_ptr, r.sq_len);
+        close(fd);
+        ring.fd = -2;
+        return NULL;
+    }
+
+    char *sq = r.sq_ptr, *cq = r.cq_ptr;
+    r.sq_head = (unsigned*)(sq + params.sq_off.head);
+    r.sq_tail = (unsigned*)(sq + params.sq_off.tail);
+    r.sq_mask = (unsigned*)(sq + params.sq_off.ring_mask);
+    r.sq_array = (unsigned*)(sq + params.sq_off.array);
+    r.cq_head = (unsigned*)(cq + params.cq_off.head);
+    r.cq_tail = (unsigned*)(cq + params.cq_off.tail);
+    r.cq_mask = (unsigned*)(cq + params.cq_off.ring_mask);
+    r.cqes = (struct io_uring_cqe*)(cq + params.cq_off.cqes);
+
+    ring = r;
+    pthread_setspecific(ring_key, &ring);
+    return &ring;
+}
+
+static struct io_uring_sqe *ring_sqe(vfs_ring_t *r, unsigned index) {
+    unsigned tail = *r->sq_tail + index;
+    unsigned slot = tail & *r->sq_mask;
+    r->sq_array[slot] = slot;
+    struct io_uring_sqe *sqe = &r->sqes[slot];
+    memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+// Submit `count` prepared entries and wait for all of them; results land
+// in res[i], by user_data
+static int ring_run(vfs_ring_t *r, unsigned count, int *res) {
+    __atomic_store_n(r->sq_tail, *r->sq_tail + count, __ATOMIC_RELEASE);
+
+    unsigned done = 0;
+    unsigned to_submit = count;
+    while (done < count) {
+        int rc = (int)syscall(__NR_io_uring_enter, r->fd, to_submit, count - done,
+                              IORING_ENTER_GETEVENTS, NULL, 0);
+        COUNT(submits, 1);
+        if (rc < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        to_submit -= (unsigned)rc < to_submit ? (unsigned)rc : to_submit;
+
+        unsigned head = *r->cq_head;
+        unsigned tail = __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE);
+        for (; head != tail; head++) {
+            struct io_uring_cqe *cqe = &r->cqes[head & *r->cq_mask];
+            if (cqe->user_data < count) res[cqe->user_data] = cqe->res;
+            done++;
+        }
+        __atomic_store_n(r->cq_head, head, __ATOMIC_RELEASE);
+    }
+    return 0;
+}
+
+// Write queue
+
+static int compare_writes(const void *a, const void *b) {
+    const vfs_write_t *x = a, *y = b;
+    return x->offset < y->offset ? -1 : x->offset > y->offset;
+}
+
+static int pwrite_run(int fd, struct iovec *iov, int iovcnt, sqlite3_int64 offset) {
+    while (iovcnt > 0) {
+        ssize_t n = pwritev(fd, iov, iovcnt, offset);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        offset += n;
+        while (iovcnt > 0 && (size_t)n >= iov->iov_len) {
+            n -= (ssize_t)iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if (iovcnt > 0) {
+            iov->iov_base = (char*)iov->iov_base + n;
+            iov->iov_len -= (size_t)n;
+        }
+    }
+    return 0;
+}
+
+static void mark_clean(vfs_file_t *f) {
+    if (!f->dirty) return;
+    pthread_mutex_lock(&dirty_lock);
+    for (vfs_file_t **p = &dirty_files; *p; p = &(*p)->dirty_next) {
+        if (*p == f) {
+            *p = f->dirty_next;
+            break;
+        }
+    }
+    f->dirty = 0;
+    pthread_mutex_unlock(&dirty_lock);
+}
+
+// Write out the queue, then fdatasync if `sync`
+static int flush_file(vfs_file_t *f, int sync) {
+    if (f->count == 0 && !sync) return SQLITE_OK;
+
+    qsort(f->writes, f->count, sizeof(vfs_write_t), compare_writes);
+    struct iovec iov[VFS_MAX_PENDING];
+    int run_start[VFS_MAX_PENDING + 1];
+    int run_count = 0;
+    for (int i = 0; i < f->count; i++) {
+        iov[i].iov_base = f->writes[i].data;
+        iov[i].iov_len = (size_t)f->writes[i].len;
+        if (i == 0 || f->writes[i - 1].offset + f->writes[i - 1].len != f->writes[i].offset ||
+            i - run_start[run_count - 1] == IOV_MAX) {
+            run_start[run_count++] = i;
+        }
+    }
+    run_start[run_count] = f->count;
+    COUNT(runs, run_count);
+
+    int status = 0;
+    vfs_ring_t *r = thread_ring();
+    int first = 0;
+    while (r && first < run_count) {
+        // Writes of this round, and the sync after the last of them
+        unsigned round = run_count - first;
+        if (round > r->entries - 1) round = r->entries - 1;
+        if (round > VFS_RING_ENTRIES - 1) round = VFS_RING_ENTRIES - 1;
+        int with_sync = sync && first + (int)round == run_count;
+        int res[VFS_RING_ENTRIES];
+        for (unsigned i = 0; i < round; i++) {
+            int run = first + (int)i;
+            struct io_uring_sqe *sqe = ring_sqe(r, i);
+            sqe->opcode = IORING_OP_WRITEV;
+            sqe->fd = f->fd;
+            sqe->off = (uint64_t)f->writes[run_start[run]].offset;
+            sqe->addr = (uint64_t)(uintptr_t)&iov[run_start[run]];
+            sqe->len = (unsigned)(run_start[run + 1] - run_start[run]);
+            sqe->user_data = i;
+        }
+        if (with_sync) {
+            struct io_uring_sqe *sqe = ring_sqe(r, round);
+            sqe->opcode = IORING_OP_FSYNC;
+            sqe->fd = f->fd;
+            sqe->fsync_flags = IORING_FSYNC_DATASYNC;
+            sqe->flags = IOSQE_IO_DRAIN;
+            sqe->user_data = round;
+        }
+        if (ring_run(r, round + (with_sync ? 1 : 0), res) != 0) {
+            ring_close(r);  // Not used again: system calls from here
+            ring.fd = -2;
+            r = NULL;
+            break;
+        }
+
+        for (unsigned i = 0; i < round; i++) {
+            int run = first + (int)i;
+            size_t expected = 0;
+            for (int w = run_start[run]; w < run_start[run + 1]; w++) expected += iov[w].iov_len;
+            if (res[i] < 0 || (size_t)res[i] != expected) {
+                // Short or failed: write the whole run again in place
+                if (pwrite_run(f->fd, &iov[run_start[run]], run_start[run + 1] - run_start[run],
+                               f->writes[run_start[run]].offset) != 0) {
+                    status = -1;
+                }
+            }
+        }
+        if (with_sync) {
+            sync = 0;
+            if (res[round] < 0 && fdatasync(f->fd) != 0) status = -1;
+        }
+        first += (int)round;
+    }
+    for (int run = first; run < run_count; run++) {
+        if (pwrite_run(f->fd, &iov[run_start[run]], run_start[run + 1] - run_start[run],
+                       f->writes[run_start[run]].offset) != 0) {
+            status = -1;
+        }
+    }
+    if (sync) {
+        if (r) {
+            // Nothing to write: the sync alone
+            int res[1];
+            struct io_uring_sqe *sqe = ring_sqe(r, 0);
+            sqe->opcode = IORING_OP_FSYNC;
+            sqe->fd = f->fd;
+            sqe->fsync_flags = IORING_FSYNC_DATASYNC;
+            if (ring_run(r, 1, res) != 0 || res[0] < 0) {
+                if (fdatasync(f->fd) != 0) status = -1;
+            }
+        } else if (fdatasync(f->fd) != 0) {
+            status = -1;
+        }
+    }
+
+    for (int i = 0; i < f->count; i++) {
+        free(f->writes[i].data);
+    }
+    f->count = 0;
+    f->bytes = 0;
+    mark_clean(f);
+    return status == 0 ? SQLITE_OK : SQLITE_IOERR_WRITE;
+}
+
+// Write out the files, other than `except`, that this thread has pending
+// writes for
+static int flush_thread_files(vfs_file_t *except) {
+    if (!thread_dirty) return SQLITE_OK;
+    pthread_t self = pthread_self();
+    for (;;) {
+        vfs_file_t *found = NULL;
+        pthread_mutex_lock(&dirty_lock);
+        for (vfs_file_t *f = dirty_files; f; f = f->dirty_next) {
+            if (f != except && pthread_equal(f->owner, self)) {
+                found = f;
+                break;
+            }
+        }
+        pthread_mutex_unlock(&dirty_lock);
+        if (!found) break;
+        int rc = flush_file(found, 0);
+        if (rc != SQLITE_OK) return rc;
+    }
+    thread_dirty = except && except->dirty;
+    return SQLITE_OK;
+}
+
+static int overlaps(vfs_file_t *f, sqlite3_int64 offset, int len) {
+    for (int i = 0; i < f->count; i++) {
+        if (f->writes[i].offset < offset + len && offset < f->writes[i].offset + f->writes[i].len) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// io methods
+
+static int shim_close(sqlite3_file *file) {
+    vfs_file_t *f = (vfs_file_t*)file;
+    int rc = flush_file(f, 0);
+    int close_rc = f->real->pMethods->xClose(f->real);
+    return rc != SQLITE_OK ? rc : close_rc;
+}
+
+static int shim_read(sqlite3_file *file, void *buf, int amount, sqlite3_int64 offset) {
+    vfs_file_t *f = (vfs_file_t*)file;
+    if (f->count && overlaps(f, offset, amount)) {
+        int rc = flush_file(f, 0);
+        if (rc != SQLITE_OK) return SQLITE_IOERR_READ;
+    }
+    return f->real->pMethods->xRead(f->real, buf, amount, offset);
+}
+
+static int shim_write(sqlite3_file *file, const void *buf, int amount, sqlite3_int64 offset) {
+    vfs_file_t *f = (vfs_file_t*)file;
+    if (f->fd < 0) {
+        return f->real->pMethods->xWrite(f->real, buf, amount, offset);
+    }
+    COUNT(writes, 1);
+
+    pthread_t self = pthread_self();
+    if (f->count && !pthread_equal(f->owner, self)) {
+        int rc = flush_file(f, 0);
+        if (rc != SQLITE_OK) return rc;
+    }
+
+    // Writes to different files reach the disk in the order they were
+    // made, as the journal protocol needs when it does not sync between
+    // them
+    int rc = flush_thread_files(f);
+    if (rc != SQLITE_OK) return rc;
+
+    // A page written again replaces its queued copy; other overlaps are
+    // written out first so that the order of writes is kept
+    for (int i = 0; i < f->count; i++) {
+        if (f->writes[i].offset == offset && f->writes[i].len == amount) {
+            memcpy(f->writes[i].data, buf, (size_t)amount);
+            return SQLITE_OK;
+        }
+    }
+    if (f->count && overlaps(f, offset, amount)) {
+        int rc = flush_file(f, 0);
+        if (rc != SQLITE_OK) return rc;
+    }
+
+    unsigned char *data = malloc((size_t)amount);
+    if (!data) {
+        int rc = flush_file(f, 0);
+        return rc != SQLITE_OK ? rc : f->real->pMethods->xWrite(f->real, buf, amount, offset);
+    }
+    memcpy(data, buf, (size_t)amount);
+    f->writes[f->count].offset = offset;
+    f->writes[f->count].len = amount;
+    f->writes[f->count].data = data;
+    f->count++;
+    f->bytes += (size_t)amount;
+    f->owner = self;
+
+    if (!f->dirty) {
+        pthread_mutex_lock(&dirty_lock);
+        f->dirty = 1;
+        f->dirty_next = dirty_files;
+        dirty_files = f;
+        pthread_mutex_unlock(&dirty_lock);
+        thread_dirty = 1;
+    }
+    if (f->count == VFS_MAX_PENDING || f->bytes >= VFS_MAX_PENDING_BYTES) {
+        return flush_file(f, 0);
+    }
+    return SQLITE_OK;
+}
+
+static int shim_truncate(sqlite3_file *file, sqlite3_int64 size) {
+    vfs_file_t *f = (vfs_file_t*)file;
+    int rc = flush_file(f, 0);
+    if (rc != SQLITE_OK) return rc;
+    return f->real->pMethods->xTruncate(f->real, size);
+}
+
+// fsync the directory holding path
+static int sync_directory(const char *path) {
+    char dir_path[PATH_MAX];
+    snprintf(dir_path, sizeof(dir_path), "%s", path);
+    int dir = open(dirname(dir_path), O_RDONLY);
+    if (dir < 0) return -1;
+    int rc = fsync(dir);
+    close(dir);
+    return rc;
+}
+
+static int shim_sync(sqlite3_file *file, int flags) {
+    vfs_file_t *f = (vfs_file_t*)file;
+    if (f->fd < 0) {
+        return f->real->pMethods->xSync(f->real, flags);
+    }
+    COUNT(syncs, 1);
+    int rc = flush_file(f, 1);
+    if (rc != SQLITE_OK) return SQLITE_IOERR_FSYNC;
+    if (f->dir_sync) {
+        f->dir_sync = 0;
+        COUNT(syncs, 1);
+        if (sync_directory(f->name) != 0) return SQLITE_IOERR_DIR_FSYNC;
+    }
+    return SQLITE_OK;
+}
+
+static int shim_file_size(sqlite3_file *file, sqlite3_int64 *size) {
+    vfs_file_t *f = (vfs_file_t*)file;
+    int rc = flush_file(f, 0);
+    if (rc != SQLITE_OK) return rc;
+    return f->real->pMethods->xFileSize(f->real, size);
+}
+
+static int shim_lock(sqlite3_file *file, int level) {
+    vfs_file_t *f = (vfs_file_t*)file;
+    return f->real->pMethods->xLock(f->real, level);
+}
+
+static int shim_unlock(sqlite3_file *file, int level) {
+    vfs_file_t *f = (vfs_file_t*)file;
+    int rc = flush_file(f, 0);
+    if (rc != SQLITE_OK) return rc;
+    return f->real->pMethods->xUnlock(f->real, level);
+}
+
+static int shim_check_reserved_lock(sqlite3_file *file, int *out) {
+    vfs_file_t *f = (vfs_file_t*)file;
+    return f->real->pMethods->xCheckReservedLock(f->real, out);
+}
+
+static int shim_file_control(sqlite3_file *file, int op, void *arg) {
+    vfs_file_t *f = (vfs_file_t*)file;
+    switch (op) {
+        // These never look at the file's contents or size
+        case SQLITE_FCNTL_SYNC:
+        case SQLITE_FCNTL_SYNC_OMITTED:
+        case SQLITE_FCNTL_BUSYHANDLER:
+        case SQLITE_FCNTL_HAS_MOVED:
+        case SQLITE_FCNTL_SIZE_HINT:
+            return f->real->pMethods->xFileControl(f->real, op, arg);
+    }
+    if (f->count) {
+        int rc = flush_file(f, 0);
+        if (rc != SQLITE_OK) return rc;
+    }
+    return f->real->pMethods->xFileControl(f->real, op, arg);
+}
+
+static int shim_sector_size(sqlite3_file *file) {
+    vfs_file_t *f = (vfs_file_t*)file;
+    return f->real->pMethods->xSectorSize(f->real);
+}
+
+static int shim_device_characteristics(sqlite3_file *file) {
+    vfs_file_t *f = (vfs_file_t*)file;
+    return f->real->pMethods->xDeviceCharacteristics(f->real);
+}
+
+static int shim_shm_map(sqlite3_file *file, int page, int size, int extend, void volatile **out) {
+    vfs_file_t *f = (vfs_file_t*)file;
+    return f->real->pMethods->xShmMap(f->real, page, size, extend, out);
+}
+
+// WAL frames must be in the file before the wal-index points readers at
+// them
+static int shim_shm_lock(sqlite3_file *file, int offset, int n, int flags) {
+    vfs_file_t *f = (vfs_file_t*)file;
+    flush_thread_files(NULL);
+    return f->real->pMethods->xShmLock(f->real, offset, n, flags);
+}
+
+static void shim_shm_barrier(sqlite3_file *file) {
+    vfs_file_t *f = (vfs_file_t*)file;
+    flush_thread_files(NULL);
+    f->real->pMethods->xShmBarrier(f->real);
+}
+
+static int shim_shm_unmap(sqlite3_file *file, int delete_flag) {
+    vfs_file_t *f = (vfs_file_t*)file;
+    return f->real->pMethods->xShmUnmap(f->real, delete_flag);
+}
+
+// Memory-mapped pages would not show queued writes: always read
+static int shim_fetch(sqlite3_file *file, sqlite3_int64 offset, int amount, void **out) {
+    (void)file;
+    (void)offset;
+    (void)amount;
+    *out = NULL;
+    return SQLITE_OK;
+}
+
+static int shim_unfetch(sqlite3_file *file, sqlite3_int64 offset, void *page) {
+    (void)file;
+    (void)offset;
+    (void)page;
+    return SQLITE_OK;
+}
+
+// VFS methods
+
+// Descriptor of a file the unix VFS just opened, if it can be confirmed
+static int wrapped_fd(sqlite3_file *real, const char *name) {
+    int version = sqlite3_libversion_number();
+    if (version < VFS_UNIX_CHECKED_MIN || version > VFS_UNIX_CHECKED_MAX) return -1;
+    if (!name || strcmp(real_vfs->zName, "unix") != 0) return -1;
+    int fd = ((unix_file_prefix_t*)real)->h;
+    struct stat by_fd, by_name;
+    if (fd < 0 || fstat(fd, &by_fd) != 0 || stat(name, &by_name) != 0 ||
+        by_fd.st_dev != by_name.st_dev || by_fd.st_ino != by_name.st_ino) {
+        return -1;
+    }
+    return fd;
+}
+
+static int shim_open(sqlite3_vfs *vfs, const char *name, sqlite3_file *file, int flags,
+                     int *out_flags) {
+    (void)vfs;
+    vfs_file_t *f = (vfs_file_t*)file;
+    memset(f, 0, sizeof(*f));
+    f->real = (sqlite3_file*)(f + 1);
+    f->fd = -1;
+
+    int rc = real_vfs->xOpen(real_vfs, name, f->real, flags, out_flags);
+    if (rc != SQLITE_OK) {
+        return rc;
+    }
+
+    int queued = SQLITE_OPEN_MAIN_DB | SQLITE_OPEN_MAIN_JOURNAL | SQLITE_OPEN_WAL;
+    if (flags & queued) {
+        f->fd = wrapped_fd(f->real, name);
+    }
+    f->name = name;
+    f->dir_sync = (flags & SQLITE_OPEN_CREATE) && (flags & (SQLITE_OPEN_MAIN_JOURNAL | SQLITE_OPEN_WAL));
+    f->base.pMethods = &methods;
+    return SQLITE_OK;
+}
+
+// Deleting a journal commits: what it protected has to be written first
+static int shim_delete(sqlite3_vfs *vfs, const char *name, int sync_dir) {
+    (void)vfs;
+    int rc = flush_thread_files(NULL);
+    if (rc != SQLITE_OK) return SQLITE_IOERR_DELETE;
+    return real_vfs->xDelete(real_vfs, name, sync_dir);
+}
+
+static int shim_access(sqlite3_vfs *vfs, const char *name, int flags, int *out) {
+    (void)vfs;
+    return real_vfs->xAccess(real_vfs, name, flags, out);
+}
+
+static int shim_full_pathname(sqlite3_vfs *vfs, const char *name, int size, char *out) {
+    (void)vfs;
+    return real_vfs->xFullPathname(real_vfs, name, size, out);
+}
+
+static void *shim_dl_open(sqlite3_vfs *vfs, const char *name) {
+    (void)vfs;
+    return real_vfs->xDlOpen(real_vfs, name);
+}
+
+static void shim_dl_error(sqlite3_vfs *vfs, int size, char *out) {
+    (void)vfs;
+    real_vfs->xDlError(real_vfs, size, out);
+}
+
+static void (*shim_dl_sym(sqlite3_vfs *vfs, void *handle, const char *name))(void) {
+    (void)vfs;
+    return real_vfs->xDlSym(real_vfs, handle, name);
+}
+
+static void shim_dl_close(sqlite3_vfs *vfs, void *handle) {
+    (void)vfs;
+    real_vfs->xDlClose(real_vfs, handle);
+}
+
+static int shim_randomness(sqlite3_vfs *vfs, int size, char *out) {
+    (void)vfs;
+    return real_vfs->xRandomness(real_vfs, size, out);
+}
+
+static int shim_sleep(sqlite3_vfs *vfs, int microseconds) {
+    (void)vfs;
+    return real_vfs->xSleep(real_vfs, microseconds);
+}
+
+static int shim_current_time(sqlite3_vfs *vfs, double *out) {
+    (void)vfs;
+    return real_vfs->xCurrentTime(real_vfs, out);
+}
+
+static int shim_get_last_error(sqlite3_vfs *vfs, int size, char *out) {
+    (void)vfs;
+    return real_vfs->xGetLastError(real_vfs, size, out);
+}
+
+static int shim_current_time_int64(sqlite3_vfs *vfs, sqlite3_int64 *out) {
+    (void)vfs;
+    return real_vfs->xCurrentTimeInt64(real_vfs, out);
+}
+
+int vfs_register(void) {
+    if (real_vfs) return 0;
+    sqlite3_vfs *base = sqlite3_vfs_find(NULL);
+    if (!base || base->iVersion < 2) {
+        fprintf(stderr, "The default VFS cannot be wrapped\n");
+        return -1;
+    }
+    real_vfs = base;
+    pthread_key_create(&ring_key, ring_close);
+
+    methods.iVersion = 3;
+    methods.xClose = shim_close;
+    methods.xRead = shim_read;
+    methods.xWrite = shim_write;
+    methods.xTruncate = shim_truncate;
+    methods.xSync = shim_sync;
+    methods.xFileSize = shim_file_size;
+    methods.xLock = shim_lock;
+    methods.xUnlock = shim_unlock;
+    methods.xCheckReservedLock = shim_check_reserved_lock;
+    methods.xFileControl = shim_file_control;
+    methods.xSectorSize = shim_sector_size;
+    methods.xDeviceCharacteristics = shim_device_characteristics;
+    methods.xShmMap = shim_shm_map;
+    methods.xShmLock = shim_shm_lock;
+    methods.xShmBarrier = shim_shm_barrier;
+    methods.xShmUnmap = shim_shm_unmap;
+    methods.xFetch = shim_fetch;
+    methods.xUnfetch = shim_unfetch;
+
+    memset(&shim, 0, sizeof(shim));
+    shim.iVersion = 2;
+    shim.szOsFile = (int)sizeof(vfs_file_t) + base->szOsFile;
+    shim.mxPathname = base->mxPathname;
+    shim.zName = "forth-coalesce";
+    shim.xOpen = shim_open;
+    shim.xDelete = shim_delete;
+    shim.xAccess = shim_access;
+    shim.xFullPathname = shim_full_pathname;
+    shim.xDlOpen = shim_dl_open;
+    shim.xDlError = shim_dl_error;
+    shim.xDlSym = shim_dl_sym;
+    shim.xDlClose = shim_dl_close;
+    shim.xRandomness = shim_randomness;
+    shim.xSleep = shim_sleep;
+    shim.xCurrentTime = shim_current_time;
+    shim.xGetLastError = shim_get_last_error;
+    shim.xCurrentTimeInt64 = shim_current_time_int64;
+
+    if (sqlite3_vfs_register(&shim, 1) != SQLITE_OK) {
+        real_vfs = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+const char *vfs_mode_name(vfs_mode_t mode) {
+    switch (mode) {
+        case VFS_COALESCE: return "coalesce";
+        case VFS_URING: return "uring";
+        default: return "default";
+    }
+}
+
+uint64_t vfs_writes_count(void) {
+    return __atomic_load_n(&writes, __ATOMIC_RELAXED);
+}
+
+uint64_t vfs_runs_count(void) {
+    return __atomic_load_n(&runs, __ATOMIC_RELAXED);
+}
+
+uint64_t vfs_syncs_count(void) {
+    return __atomic_load_n(&syncs, __ATOMIC_RELAXED);
+}
+
+uint64_t vfs_submits_count(void) {
+    return __atomic_load_n(&submits, __ATOMIC_RELAXED);
+}
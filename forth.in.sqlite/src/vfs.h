@@ -0,0 +1,56 @@
+#ifndef VFS_H
+#define VFS_H
+
+#include "forth.h"
+
+// Write-coalescing VFS shim.
+//
+// Wraps the default VFS. Writes to database files, rollback journals and
+// WALs are queued per file instead of going to the kernel one pwrite at a
+// time; a sync writes the queue sorted by offset, with adjacent pages
+// merged into one vectored write, and the fdatasync in the same batch. In
+// io_uring mode the batch is one io_uring_enter per thread ring (set up
+// with raw system calls); in coalesce mode, or where io_uring is
+// unavailable, it is a pwritev per run and an fdatasync.
+//
+// Queued writes are made visible before anything could observe the file:
+// reads that overlap them, size queries, truncation, unlocking, closing,
+// and, for WALs, the shared-memory operations that publish frames to other
+// connections. Each connection must stay on one thread at a time.
+
+typedef enum {
+    VFS_DEFAULT,   // SQLite's own VFS
+    VFS_COALESCE,  // Queue and merge writes, pwritev and fdatasync
+    VFS_URING      // Queue and merge writes, io_uring submissions
+} vfs_mode_t;
+
+// Writes and bytes held per file before they are written without a sync
+#define VFS_MAX_PENDING 256
+#define VFS_MAX_PENDING_BYTES (8 * 1024 * 1024)
+
+// SQLite versions whose unixFile layout the shim has been checked against;
+// with any other library every file passes through
+#define VFS_UNIX_CHECKED_MIN 3040000
+#define VFS_UNIX_CHECKED_MAX 3040001
+
+// Submission queue entries per thread ring
+#define VFS_RING_ENTRIES 64
+
+// Set before forth_init, which registers the shim as the default VFS
+extern vfs_mode_t vfs_mode;
+
+// Register the shim as the default VFS; -1 (and the default VFS stays) if
+// it cannot be
+int vfs_register(void);
+
+// Name of the mode, for --vfs and reports
+const char *vfs_mode_name(vfs_mode_t mode);
+
+// Counters: xWrite calls, vectored writes issued, syncs, and io_uring_enter
+// calls (0 without a ring)
+uint64_t vfs_writes_count(void);
+uint64_t vfs_runs_count(void);
+uint64_t vfs_syncs_count(void);
+uint64_t vfs_submits_count(void);
+
+#endif
@@ -0,0 +1,47 @@
+#!/bin/sh
+# Word tests.
+#
+# Runs each tests/NAME.fth in a scratch directory of its own, with the
+# options on its "\ Flags:" line, and compares what it prints with
+# tests/NAME.expected: standard output, a "--- stderr" line, then standard
+# error. With -u the expected files are rewritten from the output instead.
+#
+# Usage: tests/run.sh [-u] [NAME...]
+
+BIN=${BIN:-bin}
+DIR=$(cd "$(dirname "$0")" && pwd)
+FORTH=$(cd "$BIN" && pwd)/forth-sqlite
+
+update=0
+if [ "$1" = "-u" ]; then
+    update=1
+    shift
+fi
+if [ $# -eq 0 ]; then
+    set -- $(cd "$DIR" && ls *.fth | sed 's/\.fth$//')
+fi
+
+WORK=$(mktemp -d /tmp/forth-tests-XXXXXX)
+trap 'rm -rf "$WORK"' EXIT
+
+failed=0
+for name in "$@"; do
+    rm -rf "$WORK/run"
+    mkdir "$WORK/run"
+    cp "$DIR/$name.fth" "$WORK/run/"
+    flags=$(sed -n 's/^\\ Flags: //p' "$DIR/$name.fth")
+    (cd "$WORK/run" && "$FORTH" $flags "$name.fth" > ../out 2> ../err)
+    { cat "$WORK/out"; echo "--- stderr"; cat "$WORK/err"; } > "$WORK/actual"
+
+    if [ $update -eq 1 ]; then
+        cp "$WORK/actual" "$DIR/$name.expected"
+        echo "updated $name"
+    elif diff -u "$DIR/$name.expected" "$WORK/actual" > "$WORK/diff"; then
+        echo "ok $name"
+    else
+        echo "FAIL $name"
+        cat "$WORK/diff"
+        failed=1
+    fi
+done
+exit $failed